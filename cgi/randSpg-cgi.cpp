@@ -141,8 +141,10 @@ char **getcgivars() {
 #include <sstream>
 #include <iostream>
 
+#include "combinatoricsCacheFile.h"
 #include "elemInfo.h"
 #include "randSpg.h"
+#include "randSpgGenerator.h"
 #include "randSpgOptions.h"
 #include "utilityFunctions.h"
 
@@ -218,6 +220,11 @@ int main() {
   // We don't want to use a log file here
   e_verbosity = 'n';
 
+  // The server may keep a combinatorics cache file between requests. It is
+  // set with an environment variable so that users cannot choose the file.
+  const char* cacheFile = getenv("RANDSPG_COMBINATORICS_CACHE_FILE");
+  if (cacheFile) CombinatoricsCacheFile::setFileName(cacheFile);
+
   // Set up lattice mins and maxes
   latticeStruct mins  = options.getLatticeMins();
   latticeStruct maxes = options.getLatticeMaxes();
@@ -233,8 +240,13 @@ int main() {
   input.maxVolume = options.getMaxVolume();
   input.forcedWyckAssignments = options.getForcedWyckAssignments();
   input.verbosity = options.getVerbosity();
+  input.maxVerbosePossibilities = options.getMaxVerbosePossibilities();
   input.maxAttempts = options.getMaxAttempts();
   input.forceMostGeneralWyckPos = options.forceMostGeneralWyckPos();
+  input.wyckSampling = options.getWyckSampling();
+  input.numParallelAttempts = options.getNumParallelAttempts();
+  input.earlyAbortThreshold = options.getEarlyAbortThreshold();
+  input.timeLimit = options.getTimeLimit();
 
   // Set up various other options
   vector<uint> spacegroups = options.getSpacegroups();
@@ -282,18 +294,52 @@ int main() {
     invalidInput(error.str());
   }
 
+  size_t maxParallelAttempts = 4;
+  if (input.numParallelAttempts > maxParallelAttempts) {
+    stringstream error;
+    error << "Error: for the html version of this program, we only allow up to " << maxParallelAttempts
+          << " parallel attempts per crystal so that we do not overload the server.<br> You have requested "
+          << input.numParallelAttempts << " parallel attempts. Please reduce this "
+          << "amount or compile and use the executable version of the "
+          << "program <a href=\"http://www.github.com/psavery/randSpg\">here</a>.<br>\n";
+    invalidInput(error.str());
+  }
+
+  // The whole request has to finish within this many seconds so that one
+  // request cannot hold the server. The token stops the crystal that is
+  // being made, or the search for the Wyckoff position possibilities of a
+  // spacegroup, when the time runs out.
+  double maxRequestTime = 60;
+  shared_ptr<RandSpgCancelToken> requestToken =
+    make_shared<RandSpgCancelToken>();
+  requestToken->setTimeLimit(maxRequestTime);
+  input.cancelToken = requestToken;
+
   auto setupWallTime = chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start_setupWall).count() * 1e-9;
 
   // Let's time it!
   auto start_loopWall = std::chrono::high_resolution_clock::now();
 
   // Loop through the ones we are going to create
-  for (size_t i = 0; i < spacegroups.size(); i++) {
+  bool outOfTime = false;
+  for (size_t i = 0; i < spacegroups.size() && !outOfTime; i++) {
     uint spg = spacegroups.at(i);
     // Change the input spg to have the right spacegroup
     input.spg = spg;
+    RandSpgGenerator generator(input);
     for (size_t j = 0; j < numOfEach; j++) {
-      Crystal c = RandSpg::randSpgCrystal(input);
+      randSpgStatus status;
+      Crystal c = generator.generate(status);
+
+      if (status == randSpgTimedOut && requestToken->getDeadline() <=
+                                       RandSpgCancelToken::clock::now()) {
+        ss << "The time limit of " << maxRequestTime << " seconds for one "
+           << "request was reached, so the rest of the crystals were not "
+           << "generated. Use the <a href=\"http://www.github.com/psavery/randSpg\">executable version</a> "
+           << "of the program to generate more.<br><br>\n";
+        outOfTime = true;
+        break;
+      }
 
       // The volume is set to zero if the job failed.
       if (c.getVolume() == 0) {
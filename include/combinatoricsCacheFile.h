@@ -0,0 +1,86 @@
+/**********************************************************************
+  combinatoricsCacheFile.h - Optional file that stores system possibilities
+                             between runs so that they do not need to be
+                             found again.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+/* The file starts with a header that contains a magic string, the format
+   version, a random id, and a hash of the Wyckoff database. If the magic
+   string, version, or hash do not match, the file is started over with a
+   new id.
+
+   After the header come records that are only ever appended. Each record
+   contains the key (see getKey()) followed by the arrays of a
+   systemPossibilities object. The file is memory-mapped for reading (it is
+   read into memory on Windows), and an index of the keys is built the
+   first time it is used.
+
+   Several processes may share a file. A process holds a shared lock
+   (flock()) while it reads the file, and an exclusive lock while it checks
+   the header, starts the file over, or appends to it, so a file is never
+   cut short while another process reads it. A process that finds a new id
+   in the header builds its index again.
+*/
+
+#ifndef COMBINATORICS_CACHE_FILE_H
+#define COMBINATORICS_CACHE_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "randSpgCombinatorics.h"
+
+class CombinatoricsCacheFile {
+ public:
+  /* Set the file to use. An empty file name (the default) turns the file
+   * cache off. The file is created if it does not exist.
+   *
+   * @param fileName The name of the file.
+   */
+  static void setFileName(const std::string& fileName);
+
+  static std::string fileName();
+
+  /* Get the key for the inputs of
+   * RandSpgCombinatorics::getSystemPossibilities(). The order of the atom
+   * types is kept since it is the order of the types in the results.
+   */
+  static std::string getKey(uint spg, const std::vector<uint>& atoms,
+                            const wyckConstraints& constraints,
+                            bool findOnlyOne, bool onlyNonUnique);
+
+  /* Look for a key in the file.
+   *
+   * @param key The key from getKey().
+   * @param possibilities Set to the stored possibilities if they are found.
+   *
+   * @return True if they were found. False if they were not, if the record
+   *         is not valid for the spacegroup of the key, or if the file
+   *         cache is off.
+   */
+  static bool load(const std::string& key, systemPossibilities& possibilities);
+
+  /* Append possibilities to the file. Does nothing if the file cache is off
+   * or if the key is already in the file.
+   */
+  static void store(const std::string& key,
+                    const systemPossibilities& possibilities);
+
+  // A hash of the Wyckoff database. Files made with a different database
+  // are not used.
+  static uint64_t getDatabaseHash();
+};
+
+#endif
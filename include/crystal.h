@@ -18,6 +18,8 @@
 #define CRYSTAL_H
 
 #include <cstdlib>
+#include <memory>
+#include <string>
 #include <vector>
 
 // For some reason, uint isn't always defined on windows...
@@ -64,6 +66,8 @@ struct latticeStruct {
     a(_a), b(_b), c(_c), alpha(_alpha), beta(_beta), gamma(_gamma) {}
 };
 
+class RandSpgContext;
+
 // Only use fractional coordinates for now...
 class Crystal {
  public:
@@ -78,17 +82,23 @@ class Crystal {
                    std::vector<atomStruct> a = std::vector<atomStruct>(),
                    bool usingVdwRad = false);
 
-  /* Set the atoms in this crystal with a new vector of atoms.
+  /* Set the atoms in this crystal with a new vector of atoms. This clears
+   * the asymmetric unit.
    *
    * @param a The new vector of atoms.
    */
-  void setAtoms(std::vector<atomStruct> a) {m_atoms = a;};
+  void setAtoms(std::vector<atomStruct> a)
+  {
+    m_atoms = a;
+    clearAsymmetricUnit();
+  };
 
   /* Get a vector of the atom structs in this crystal.
    *
-   * @return The atoms in this crystal.
+   * @return The atoms in this crystal. The reference is good until the
+   *         atoms are changed.
    */
-  std::vector<atomStruct> getAtoms() const {return m_atoms;};
+  const std::vector<atomStruct>& getAtoms() const {return m_atoms;};
 
   /* Get a vector of atomic numbers: one atomic number for each atom.
    *
@@ -127,11 +137,79 @@ class Crystal {
    */
   bool usingVdwRadii() {return m_usingVdwRadii;};
 
-  /* Adds an atom to this crystal.
+  /* Set the context that the radii and minIADs are taken from. If there is
+   * no context (the default), they are taken from the ElemInfo class.
+   *
+   * @param context The context. The crystal keeps a reference to it.
+   */
+  void setContext(const std::shared_ptr<const RandSpgContext>& context)
+  {
+    m_context = context;
+  };
+
+  std::shared_ptr<const RandSpgContext> getContext() const {return m_context;};
+
+  /* Record an atom of the asymmetric unit: an atom from which the symmetry
+   * operations of spacegroup 'spg' make some of the atoms of this crystal.
+   * RandSpg::addWyckoffAtomRandomly() records the atom it picks for each
+   * Wyckoff position, so a generated crystal knows its asymmetric unit.
+   * Adding, removing, or moving atoms afterwards clears it again, so that
+   * it is never out of date with the atoms.
+   *
+   * @param atom The atom. It should be one of the atoms of this crystal.
+   * @param spg The spacegroup. Every atom must use the same one.
+   */
+  void addAsymmetricUnitAtom(const atomStruct& atom, uint spg)
+  {
+    m_asymmetricUnit.push_back(atom);
+    m_spg = spg;
+  };
+
+  /* Get the atoms of the asymmetric unit (see addAsymmetricUnitAtom()).
+   *
+   * @return The atoms. This is empty if they are not known.
+   */
+  const std::vector<atomStruct>& getAsymmetricUnit() const
+  {
+    return m_asymmetricUnit;
+  };
+
+  /* Replace the asymmetric unit (see addAsymmetricUnitAtom()). This is for
+   * putting back a unit that was cleared while the atoms were changed,
+   * when they are the same as they were again.
+   *
+   * @param atoms The atoms of the asymmetric unit.
+   * @param spg The spacegroup, or 0 if the unit is not known.
+   */
+  void setAsymmetricUnit(const std::vector<atomStruct>& atoms, uint spg)
+  {
+    m_asymmetricUnit = atoms;
+    m_spg = spg;
+  };
+
+  /* Forget the asymmetric unit.
+   */
+  void clearAsymmetricUnit()
+  {
+    m_asymmetricUnit.clear();
+    m_spg = 0;
+  };
+
+  /* Get the spacegroup of the asymmetric unit.
+   *
+   * @return The spacegroup, or 0 if it is not known.
+   */
+  uint getSpacegroup() const {return m_spg;};
+
+  /* Adds an atom to this crystal. This clears the asymmetric unit.
    *
    * @param atom The atom to be added.
    */
-  void addAtom(atomStruct atom) {m_atoms.push_back(atom);};
+  void addAtom(atomStruct atom)
+  {
+    m_atoms.push_back(atom);
+    clearAsymmetricUnit();
+  };
 
   /* Checks to see if an atom is already at the position given by 'as'. Adds an
    * atom if one is not.
@@ -151,13 +229,14 @@ class Crystal {
    */
   void removeAllNewAtomsSince(const atomStruct& as);
 
-  /* Removes an atom, as, that is currently a member of the cell.
+  /* Removes an atom, as, that is currently a member of the cell. This
+   * clears the asymmetric unit.
    *
    * @param as The atom to be removed.
    */
   void removeAtom(const atomStruct& as);
 
-  /* Removes an atom at index i.
+  /* Removes an atom at index i. This clears the asymmetric unit.
    *
    * @param i The index of the atom to be removed.
    */
@@ -165,7 +244,7 @@ class Crystal {
 
   /* Removes atoms that lie in the same position. This is convenient for
    * spg filling functions because there is a chance we will place an atom
-   * on top of another.
+   * on top of another. If any are removed, the asymmetric unit is cleared.
    */
   void removeAtomsWithSameCoordinates();
 
@@ -173,6 +252,7 @@ class Crystal {
    * Since we are using fractional coordinates, this is particularly easy and
    * is done by adding and subtracting 1.
    * (-0.5, 0, 0.5), for example, becomes (0.5, 0, 0.5)
+   * The atoms of the asymmetric unit are wrapped too.
    */
   void wrapAtomsToCell();
 
@@ -231,6 +311,11 @@ class Crystal {
    */
   std::vector<std::vector<double>> getLatticeVecs() const;
 
+  /* Same as above, but the vectors are written to 'vecs' (one vector in
+   * each row) so that nothing is allocated.
+   */
+  void getLatticeVecs(double vecs[3][3]) const;
+
   /* Returns the distance in Angstroms between two atoms. Does not take into
    * account periodicity effects (so please center one of the atoms in the
    * unit cell before calling this function).
@@ -259,21 +344,24 @@ class Crystal {
                                             atomStruct& neighbor) const;
 
   /* Shift the cell and wrap the atoms so that an atom is at
-   * the center (i. e. position (0.5, 0.5, 0.5)).
+   * the center (i. e. position (0.5, 0.5, 0.5)). This clears the
+   * asymmetric unit.
    *
    * @param as The atom to be centered. Needs to be an atom present in the cell.
    */
   void centerCellAroundAtom(const atomStruct& as);
 
   /* Shift the cell and wrap the atoms so that an atom at index ind is at
-   * the center (i. e. position (0.5, 0.5, 0.5)).
+   * the center (i. e. position (0.5, 0.5, 0.5)). This clears the
+   * asymmetric unit.
    *
    * @param ind The index of the atom to be centered.
    */
   void centerCellAroundAtom(size_t ind);
 
   /* Finds the minimum interatomic distance between two atoms based upon
-   * their atomic number and radii information in the ElemInfo class. Any
+   * their atomic number and radii information in the crystal's context, or
+   * in the ElemInfo class if it has no context. If ElemInfo is used, any
    * modifications to the radii (scaling or setting) should have been made
    * before this function is called.
    *
@@ -326,6 +414,30 @@ class Crystal {
   void writePOSCAR(const std::string& filename,
                    const std::string& title = " ") const;
 
+  /* Writes the crystal to a CIF that has filename of 'filename'. If the
+   * crystal was made by RandSpg, only its asymmetric unit and the symmetry
+   * operations of its spacegroup are written. See
+   * StructureWriter::formatCIF().
+   *
+   * @param filename The name of the CIF file to be written. You may include
+   *                 the path if needed.
+   * @param title The name of the data block of the CIF
+   *
+   */
+  void writeCIF(const std::string& filename,
+                const std::string& title = "randSpg") const;
+
+  /* Returns the crystal info as a string in the extended XYZ format: the
+   * number of atoms, a comment line with the lattice vectors and the title,
+   * and a line of Cartesian coordinates for each atom
+   *
+   * @param title The title that goes on the comment line. Double quotes in
+   *              it are replaced by single quotes.
+   *
+   * @return The string containing the extended XYZ text
+   */
+  std::string getExtendedXYZString(const std::string& title = " ") const;
+
   /* Get a printable string that contains the atom info
    *
    * @param as The atom for which to obtain coords.
@@ -390,6 +502,11 @@ class Crystal {
   latticeStruct m_lattice;
   std::vector<atomStruct> m_atoms;
 
+  // The atoms that the symmetry operations of m_spg make the rest from. It
+  // is empty (and m_spg is 0) if they are not known.
+  std::vector<atomStruct> m_asymmetricUnit;
+  uint m_spg;
+
   // A few cached values to reduce computation time
   // Unit volume
   mutable double m_unitVolume;
@@ -399,6 +516,9 @@ class Crystal {
   // Are we using vdw or covalent radii? We will use covalent by default
   bool m_usingVdwRadii;
 
+  // Where the radii and minIADs come from. ElemInfo is used if it is null.
+  std::shared_ptr<const RandSpgContext> m_context;
+
   // More cached values
   // Matrix for conversion to cartesian coordinates
   // Since we have an upper triangle matrix, we don't need [1][0], [1][1], and [2][0]
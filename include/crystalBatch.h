@@ -0,0 +1,57 @@
+/**********************************************************************
+  crystalBatch.h - Many crystals stored together in flat arrays.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef CRYSTAL_BATCH_H
+#define CRYSTAL_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "crystal.h"
+
+// A batch of crystals as a structure of arrays. Every array is contiguous,
+// so the batch can be handed to NumPy or written to a file as it is, and
+// adding a crystal allocates nothing once the arrays are reserved.
+//
+// The atoms of crystal i are atoms atomOffsets[i] to atomOffsets[i + 1] - 1.
+struct crystalBatch {
+  // The lattice vectors of each crystal, one vector in each row: 9 doubles
+  // for each crystal
+  std::vector<double> lattices;
+  // numCrystals() + 1 offsets into the atom arrays. The first is 0.
+  std::vector<uint64_t> atomOffsets;
+  // The atomic number of each atom
+  std::vector<uint32_t> atomicNums;
+  // The fractional coordinates of each atom: 3 doubles for each atom
+  std::vector<double> fracCoords;
+
+  crystalBatch() : atomOffsets(1, 0) {}
+
+  size_t numCrystals() const { return atomOffsets.size() - 1; };
+  size_t numAtoms() const { return atomicNums.size(); };
+
+  // Make room for this many crystals with this many atoms in total
+  void reserve(size_t numCrystals, size_t numAtoms);
+
+  // Add a copy of a crystal to the end of the batch
+  void append(const Crystal& crystal);
+
+  // Make crystal i back into a Crystal. It throws std::out_of_range if i is
+  // not less than numCrystals() (an IndexError in Python).
+  Crystal getCrystal(size_t i) const;
+};
+
+#endif
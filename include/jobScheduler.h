@@ -0,0 +1,136 @@
+/**********************************************************************
+  jobScheduler.h - Runs the (spg, index) generation jobs of the CLI on
+                   several threads with the most expensive jobs first.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+/* A few high-symmetry spacegroups can take far longer than the rest (they
+   fail many attempts before they give up). If they are started last, every
+   other thread sits idle while they finish.
+
+   The cost of a job is estimated from the average time that the jobs of
+   its spacegroup took in earlier runs (the cost history file). Spacegroups
+   that have no history are calibrated from the number of Wyckoff position
+   combinations they have for the composition, which takes a few
+   milliseconds to count for every spacegroup: the more combinations, the
+   longer the search for them and the more of them fail. The calibration is
+   1 + ln(number of combinations), scaled so that its average over the
+   spacegroups that have a history is the average of their history.
+   Spacegroups that cannot hold the composition cost nothing since they
+   fail right away.
+
+   The jobs are handed out to one queue for each thread. Each job goes to
+   the queue with the smallest total cost so far, from the most expensive
+   job to the cheapest. A thread runs the most expensive job of its own
+   queue first. When its queue is empty, it steals the most expensive job
+   of the queue that has the most cost left, so the estimates only have to
+   be roughly right.
+
+   The history file is a text file with one line for each key and
+   spacegroup:
+     <key> <spg> <average seconds> <number of jobs>
+   The key is the rest of the line before the last three fields, so it may
+   contain spaces.
+*/
+
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// For uint on windows
+#include "crystal.h"
+#include "randSpgCombinatorics.h"
+
+class JobScheduler {
+ public:
+  /* Estimate the cost of a job for each spacegroup.
+   *
+   * @param spacegroups The spacegroups.
+   * @param atoms A vector of atomic numbers (one for each atom).
+   * @param history The average job time of each spacegroup that has one.
+   * @param constraints The constraints the combinations are counted with.
+   *
+   * @return The estimated cost of each spacegroup in the same order.
+   */
+  static std::vector<double> estimateCosts(
+                      const std::vector<uint>& spacegroups,
+                      const std::vector<uint>& atoms,
+                      const std::map<uint, double>& history,
+                      const wyckConstraints& constraints = wyckConstraints());
+
+  /* The calibrated cost of a spacegroup that has no history, in arbitrary
+   * units (see the top of this file).
+   *
+   * @return 0 if the spacegroup cannot hold the composition.
+   */
+  static double getCalibratedCost(uint spg, const std::vector<uint>& atoms,
+                                  const wyckConstraints& constraints);
+
+  /* Run jobs on several threads. The jobs are handed out as described at
+   * the top of this file. If numThreads is 1, the jobs are run in order on
+   * the calling thread.
+   *
+   * @param costs The estimated cost of each job.
+   * @param numThreads The number of threads to use.
+   * @param job The function that runs a job. It is called with the index of
+   *            the job.
+   */
+  static void run(const std::vector<double>& costs, size_t numThreads,
+                  const std::function<void(size_t)>& job);
+
+  /* Find how long the jobs would take if each one were started on the
+   * first thread that is free, in the order given.
+   *
+   * @param times The time each job took.
+   * @param order The order in which the jobs are started.
+   * @param numThreads The number of threads.
+   *
+   * @return The time at which the last job ends.
+   */
+  static double getMakespan(const std::vector<double>& times,
+                            const std::vector<size_t>& order,
+                            size_t numThreads);
+
+  // The job indices from the most expensive to the cheapest. Jobs with the
+  // same cost keep their order.
+  static std::vector<size_t> getCostOrder(const std::vector<double>& costs);
+
+  /* Read the average job times for a key from a cost history file.
+   *
+   * @param fileName The cost history file. Nothing is read if it is empty
+   *                 or if the file does not exist.
+   * @param key The key, such as the composition.
+   *
+   * @return The average job time of each spacegroup in the file.
+   */
+  static std::map<uint, double> readCostHistory(const std::string& fileName,
+                                                const std::string& key);
+
+  /* Add the job times of this run to a cost history file. The averages in
+   * the file are updated, and the file is created if it does not exist.
+   *
+   * @param fileName The cost history file. Nothing is done if it is empty.
+   * @param key The key, such as the composition.
+   * @param jobTimes The time of every job of this run for each spacegroup.
+   */
+  static void updateCostHistory(
+                  const std::string& fileName, const std::string& key,
+                  const std::map<uint, std::vector<double>>& jobTimes);
+};
+
+#endif
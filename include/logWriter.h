@@ -0,0 +1,154 @@
+/**********************************************************************
+  logWriter.h - Buffers the text for a log file and writes it on a
+                background thread.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// The log used to be written by opening the file, appending, and closing it
+// again for every message, which is several times per attempt. A LogWriter
+// instead appends to a buffer in memory. A background thread writes the
+// buffer to the file (which it keeps open) once the buffer holds
+// getFlushSize() bytes, or once the oldest text in it is
+// getFlushInterval() seconds old. Text is always written in the order it
+// was appended.
+//
+// There is one writer for each file name. Every function may be called from
+// any thread. Every writer is flushed when the program exits normally, and
+// installCrashHandlers() flushes them when it crashes as well.
+//
+// The file stays open, with a thread to write it, until the writer is
+// closed. A writer from forFile() is only closed by close(), and one from
+// open() is also closed when the last pointer that open() returned for it
+// is gone (a RandSpgContext that logs to a file holds one, for example).
+// A closed writer opens the file and starts its thread again the next time
+// text is appended to it. If the file is moved or removed while it is open
+// (by log rotation, for example), it is opened again by its name before the
+// next text is written, except on Windows, where an open file cannot be
+// moved.
+//
+// The file is opened when the writer is made and written with write(2) (or
+// _write() on Windows), so that the crash handler only needs functions that
+// are safe in a signal handler: it takes no locks, allocates nothing, and
+// writes the buffer as it is. It skips a writer whose buffer or file was
+// being changed when the signal came, and it cannot see text that the
+// background thread took from the buffer but had not written yet, so a
+// little of the end of the log may still be lost. Only the first
+// getMaxCrashFlushWriters() writers are flushed after a crash.
+class LogWriter {
+ public:
+  // The writer for a file. It is made the first time it is asked for, and
+  // the reference is good until the program exits, even after close().
+  static LogWriter& forFile(const std::string& fileName);
+
+  // The writer for a file, which is closed once every pointer that open()
+  // returned for it is gone
+  static std::shared_ptr<LogWriter> open(const std::string& fileName);
+
+  // Write everything that was appended to the file, close it, and stop the
+  // thread. Nothing happens if there is no writer for the file.
+  static void close(const std::string& fileName);
+
+  // Add text to the end of the file
+  void append(const std::string& text);
+
+  // Write everything that has been appended so far, and wait until it is
+  // written
+  void flush();
+
+  // Flush every writer
+  static void flushAll();
+
+  // Flush every writer when the program is stopped by a signal (a crash,
+  // an abort, or Ctrl+C), and then let the signal do what it would have
+  // done. This is for executables: a library should not take over the
+  // signals of the program that uses it.
+  static void installCrashHandlers();
+
+  // The number of writers that the crash handlers flush
+  static size_t getMaxCrashFlushWriters();
+
+  // The buffer is written once it holds this many bytes. Default is 64 KiB.
+  static void setFlushSize(size_t bytes);
+  static size_t getFlushSize();
+
+  // Text is written at most this many seconds after it is appended.
+  // Default is 0.2.
+  static void setFlushInterval(double seconds);
+  static double getFlushInterval();
+
+ private:
+  explicit LogWriter(const std::string& fileName);
+  LogWriter(const LogWriter&) = delete;
+  LogWriter& operator=(const LogWriter&) = delete;
+
+  // Find or make the writer. The registry must be locked.
+  static LogWriter& getWriter(const std::string& fileName);
+
+  // Open the file and start the thread. m_bufferMutex must be locked.
+  void start();
+  void run();
+  // Write the text. m_fileMutex must be locked.
+  void write(const std::string& text);
+  // Stop the thread after writing everything
+  void stop();
+  // Stop the thread after writing everything, and close the file
+  void release();
+  // Write what is in the buffer without waiting for any lock or allocating
+  // any memory. Only for a signal handler.
+  void flushFromSignal();
+
+  friend struct logWriterRegistry;
+
+  std::string m_fileName;
+
+  // The text that has not been written yet, and whether it has to be
+  // written now
+  std::mutex m_bufferMutex;
+  std::condition_variable m_wakeUp;
+  std::condition_variable m_written;
+  std::string m_buffer;
+  // Set while m_buffer is being changed, for the signal handler
+  std::atomic<bool> m_bufferBusy;
+  bool m_flushRequested;
+  bool m_stop;
+  // The file is closed and the thread is stopped until more text comes
+  bool m_closed;
+  // The number of bytes appended and written so far, for flush()
+  unsigned long long m_numAppended;
+  unsigned long long m_numWritten;
+
+  std::mutex m_fileMutex;
+  // -1 if the file could not be opened
+  int m_fd;
+  // Set while the file is being written, for the signal handler
+  std::atomic<bool> m_fileBusy;
+
+  std::thread m_thread;
+
+  // Held while the writer is closed
+  std::mutex m_closeMutex;
+  // The pointers from open() that are left. The registry guards it.
+  size_t m_numUsers;
+};
+
+#endif
@@ -0,0 +1,116 @@
+/**********************************************************************
+  possibilitiesCache.h - Thread-safe cache of the system possibilities
+                         that are found for a given spacegroup,
+                         composition, and set of Wyckoff constraints.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef POSSIBILITIES_CACHE_H
+#define POSSIBILITIES_CACHE_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "randSpg.h"
+#include "randSpgCombinatorics.h"
+#include "wyckAssignmentSampler.h"
+
+// Explains why a set of cached possibilities is empty (if it is)
+enum possibilitiesStatus {
+  // There is at least one possibility
+  possibilitiesFound,
+  // The composition cannot be made with the spacegroup at all
+  noPossibilitiesForComposition,
+  // The composition can only be made without the most general position
+  noPossibilitiesWithGeneralWyckPos,
+  // The forced Wyckoff assignments removed every possibility
+  noPossibilitiesWithForcedWyckPos
+};
+
+// The filtered possibilities for one set of inputs
+struct cachedPossibilities {
+  possibilitiesStatus status;
+  systemPossibilities possibilities;
+  // The forced Wyckoff assignments that the possibilities were found with
+  std::vector<std::pair<uint, char>> forcedWyckAssignments;
+  cachedPossibilities() : status(possibilitiesFound) {}
+
+  // Get a sampler for the possibilities. It is built the first time it is
+  // requested with a set of options and kept with the possibilities.
+  std::shared_ptr<const WyckAssignmentSampler> getSampler(
+    const wyckSamplingOptions& options) const;
+
+ private:
+  mutable std::mutex m_samplerMutex;
+  mutable std::map<std::string, std::shared_ptr<const WyckAssignmentSampler>>
+    m_samplers;
+};
+
+// Finding all system possibilities is the most expensive part of the setup
+// for RandSpg::randSpgCrystal(), and it is identical for every call with the
+// same spacegroup, composition, and Wyckoff constraints. This static class
+// stores the results so that they are only found once per process. It is
+// shared by every caller of the library (the executable, the CGI handler,
+// and the Python bindings).
+class PossibilitiesCache {
+ public:
+  /* Get the possibilities for a spacegroup and composition after the
+   * most-general-position and forced Wyckoff position filters have been
+   * applied. They are found and stored if they are not already cached.
+   * The order of 'atoms' and 'forcedWyckAssignments' does not matter.
+   *
+   * @param spg The spacegroup.
+   * @param atoms A vector of atomic numbers (one for each atom).
+   * @param forceMostGeneralWyckPos Whether the most general Wyckoff position
+   *                                must be used at least once.
+   * @param forcedWyckAssignments Pairs of atomic numbers and Wyckoff letters
+   *                              that must be used.
+   * @param deadline If it expires while the possibilities are being found,
+   *                 the search stops and nothing is cached. A caller that
+   *                 is waiting for another caller's search stops waiting
+   *                 when its own deadline expires, and the search goes on.
+   *
+   * @return A shared pointer to the cached possibilities. It is never null.
+   *
+   * @throw RandSpgExpiredError If the deadline expired first.
+   */
+  static std::shared_ptr<const cachedPossibilities> getPossibilities(
+    uint spg, const std::vector<uint>& atoms, bool forceMostGeneralWyckPos,
+    const std::vector<std::pair<uint, char>>& forcedWyckAssignments,
+    const RandSpgDeadline& deadline = RandSpgDeadline());
+
+  /* Get the string that identifies a set of inputs in the cache. Inputs
+   * that differ only in the order of the atoms or forced assignments
+   * produce the same key.
+   */
+  static std::string getKey(
+    uint spg, const std::vector<uint>& atoms, bool forceMostGeneralWyckPos,
+    const std::vector<std::pair<uint, char>>& forcedWyckAssignments);
+
+  // Remove everything from the cache
+  static void clear();
+
+  // The number of entries currently in the cache
+  static size_t size();
+
+  // The max number of entries to keep. The oldest entries are removed
+  // first when the limit is exceeded. Default is 1024. Zero disables caching.
+  static void setMaxSize(size_t maxSize);
+  static size_t maxSize();
+};
+
+#endif
@@ -16,12 +16,16 @@
 #ifndef RAND_SPG_H
 #define RAND_SPG_H
 
+#include <memory>
 #include <vector>
 #include <tuple>
 #include <utility>
 
 #include "crystal.h"
+#include "crystalBatch.h"
+#include "randSpgCancel.h"
 #include "randSpgOptions.h"
+#include "wyckSampling.h"
 
 // output file name
 extern std::string e_logfilename;
@@ -101,6 +105,11 @@ struct randSpgInput {
   // (prints nothing other than what the options were set to). Default is 'n'
   char verbosity;
 
+  // The most system possibilities that are printed with verbosity 'v'. A
+  // large composition may have millions of them. 0 prints them all. Default
+  // is 100.
+  size_t maxVerbosePossibilities;
+
   // Max number of attempts to satisfy the minIAD requirements when placing
   // atoms in the Wyckoff positions. If it fails this many times, it will abort
   // the operation. Default is 100.
@@ -113,6 +122,34 @@ struct randSpgInput {
   // the correct space group. Default is true.
   bool forceMostGeneralWyckPos;
 
+  // How the Wyckoff positions are picked for each attempt. See
+  // wyckSampling.h. The default is that every combination of Wyckoff
+  // positions found is equally likely.
+  wyckSamplingOptions wyckSampling;
+
+  // The number of attempts that are run at the same time. Values above 1
+  // run the attempts on the global thread pool, and the first attempt that
+  // succeeds stops the rest. Default is 1.
+  uint numParallelAttempts;
+
+  // Stop the attempts early once the estimated chance that any of the
+  // remaining attempts succeeds is below this value. The estimate uses how
+  // many Wyckoff positions each failed attempt filled, and at least 10
+  // attempts are always made. Default is 0 (never stop early).
+  double earlyAbortThreshold;
+
+  // The most wall time, in seconds, that the attempts of one call of
+  // randSpgCrystal() may take. It is checked before every attempt and
+  // between the trials of every Wyckoff position. Finding the possible
+  // Wyckoff combinations, which is only done once for each set of inputs,
+  // has a limit of its own of the same length, so a call that finds them
+  // may take up to twice as long. Default is 0 (no limit).
+  double timeLimit;
+
+  // If this is set, the call stops soon after the token is cancelled or its
+  // deadline passes. See randSpgCancel.h. Default is null (no token).
+  std::shared_ptr<const RandSpgCancelToken> cancelToken;
+
   // Most basic constructor
   randSpgInput(uint _spg, const std::vector<uint>& _atoms,
                const latticeStruct& _lmins,
@@ -128,8 +165,13 @@ struct randSpgInput {
                    maxVolume(-1.0),
                    forcedWyckAssignments(std::vector<std::pair<uint, char>>()),
                    verbosity('n'),
+                   maxVerbosePossibilities(100),
                    maxAttempts(100),
-                   forceMostGeneralWyckPos(true) {}
+                   forceMostGeneralWyckPos(true),
+                   numParallelAttempts(1),
+                   earlyAbortThreshold(0.0),
+                   timeLimit(0.0),
+                   cancelToken(nullptr) {}
   // Defining-everything constructor
   randSpgInput(uint _spg, const std::vector<uint>& _atoms,
                const latticeStruct& _lmins,
@@ -150,10 +192,52 @@ struct randSpgInput {
                    maxVolume(_maxVolume),
                    forcedWyckAssignments(_fwa),
                    verbosity(_v),
+                   maxVerbosePossibilities(100),
                    maxAttempts(_maxAttempts),
-                   forceMostGeneralWyckPos(_fmgwp) {}
+                   forceMostGeneralWyckPos(_fmgwp),
+                   numParallelAttempts(1),
+                   earlyAbortThreshold(0.0),
+                   timeLimit(0.0),
+                   cancelToken(nullptr) {}
+};
+
+// Why RandSpg::randSpgCrystal() returned what it did
+enum randSpgStatus {
+  // A crystal was generated
+  randSpgSucceeded,
+  // The spacegroup cannot hold the atoms with the given constraints
+  randSpgNoPossibilities,
+  // All of the attempts failed
+  randSpgMaxAttemptsReached,
+  // The attempts were stopped by randSpgInput::earlyAbortThreshold
+  randSpgAbortedEarly,
+  // randSpgInput::timeLimit or the deadline of the cancel token passed
+  randSpgTimedOut,
+  // The cancel token was cancelled
+  randSpgCancelled
 };
 
+static inline std::string getRandSpgStatusName(randSpgStatus status)
+{
+  switch (status) {
+    case randSpgSucceeded:
+      return "succeeded";
+    case randSpgNoPossibilities:
+      return "noPossibilities";
+    case randSpgMaxAttemptsReached:
+      return "maxAttemptsReached";
+    case randSpgAbortedEarly:
+      return "abortedEarly";
+    case randSpgTimedOut:
+      return "timedOut";
+    case randSpgCancelled:
+      return "cancelled";
+  }
+  return "unknown";
+}
+
+class RandSpgContext;
+
 class RandSpg {
  public:
 
@@ -232,12 +316,16 @@ class RandSpg {
    * @param spg The spacegroup which we are creating.
    * @param maxAttempts The number of attempts to make to add the atom randomly
    *                    before the function returns false. Default is 1000.
+   * @param deadline If it expires, no more trials are made and the function
+   *                 returns false. Default is no deadline.
    *
    * @return True if it succeeded, and false if it failed.
    */
   static bool addWyckoffAtomRandomly(Crystal& crystal, const wyckPos& position,
                                      uint atomicNum, uint spg,
-                                     int maxAttempts = 1000);
+                                     int maxAttempts = 1000,
+                                     const RandSpgDeadline& deadline =
+                                       RandSpgDeadline());
 
   /*
    * Initialze and return a Crystal object with a given spacegroup!
@@ -270,6 +358,38 @@ class RandSpg {
    */
   static Crystal randSpgCrystal(const randSpgInput& input);
 
+  /* Same as above, but the radii, minIADs, and log text come from
+   * 'context' instead of from a context that is built from the input.
+   * Nothing global is changed, so this may be called from several threads
+   * at once. The returned crystal keeps a reference to the context.
+   */
+  static Crystal randSpgCrystal(
+    const randSpgInput& input,
+    const std::shared_ptr<const RandSpgContext>& context);
+
+  /* Same as above, and 'status' is set to the reason the call ended.
+   * The reason is also written to the log when the verbosity is not 'n'.
+   */
+  static Crystal randSpgCrystal(
+    const randSpgInput& input,
+    const std::shared_ptr<const RandSpgContext>& context,
+    randSpgStatus& status);
+
+  /* Generate up to 'n' crystals with the same input into one batch of flat
+   * arrays (see crystalBatch.h). The setup is only done once, as with a
+   * RandSpgGenerator. It stops early at the first crystal that could not
+   * be generated.
+   *
+   * @param input The input for every crystal.
+   * @param n The number of crystals to generate.
+   * @param status Set to the status of the last crystal.
+   *
+   * @return The crystals that were generated, in order.
+   */
+  static crystalBatch generateBatch(const randSpgInput& input, size_t n,
+                                    randSpgStatus& status);
+  static crystalBatch generateBatch(const randSpgInput& input, size_t n);
+
   static std::vector<numAndType> getNumOfEachType(
                                    const std::vector<uint>& atoms);
 
@@ -0,0 +1,153 @@
+/**********************************************************************
+  randSpgCancel.h - A token to stop RandSpg::randSpgCrystal() from another
+                    thread, and the deadline that the attempts check.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef RAND_SPG_CANCEL_H
+#define RAND_SPG_CANCEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// The time point this many seconds from now. A time that is too far away for
+// the clock to hold (or not a number) is clamped to time_point::max(), which
+// never passes, and a negative time is now.
+static inline std::chrono::steady_clock::time_point
+getRandSpgTimePoint(double seconds)
+{
+  typedef std::chrono::steady_clock clock;
+  clock::time_point now = clock::now();
+  // Half of the clock's range is still centuries, and it leaves room for the
+  // time since the clock's epoch
+  const double maxSeconds =
+    std::chrono::duration<double>(clock::duration::max()).count() / 2;
+  if (!(seconds < maxSeconds)) return clock::time_point::max();
+  return now + std::chrono::duration_cast<clock::duration>(
+                 std::chrono::duration<double>(std::max(seconds, 0.0)));
+}
+
+// A token that is shared between the caller and any number of calls of
+// RandSpg::randSpgCrystal(). The calls stop soon after cancel() is called,
+// or after the deadline of the token passes. So one token with a deadline
+// can bound the time of several calls together (a whole CGI request, for
+// example). Every function may be called from any thread.
+class RandSpgCancelToken {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  RandSpgCancelToken() : m_cancelled(false),
+                         m_deadline(clock::time_point::max()
+                                      .time_since_epoch().count()) {}
+
+  void cancel() { m_cancelled = true; }
+
+  bool isCancelled() const { return m_cancelled; }
+
+  void setDeadline(const clock::time_point& deadline)
+  {
+    m_deadline = deadline.time_since_epoch().count();
+  }
+
+  // The deadline is this many seconds from now. A huge limit is no limit.
+  void setTimeLimit(double seconds)
+  {
+    setDeadline(getRandSpgTimePoint(seconds));
+  }
+
+  clock::time_point getDeadline() const
+  {
+    return clock::time_point(clock::duration(m_deadline));
+  }
+
+ private:
+  std::atomic<bool> m_cancelled;
+  std::atomic<clock::rep> m_deadline;
+};
+
+// What one call of RandSpg::randSpgCrystal() checks between attempts, and
+// between the trials of each Wyckoff position. It is the earlier of the
+// time limit of the call and the deadline of the token, plus the token's
+// cancel flag. A default RandSpgDeadline never expires.
+class RandSpgDeadline {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  enum reason {
+    notExpired,
+    timedOut,
+    cancelled,
+    // The stop flag was set
+    stopped
+  };
+
+  RandSpgDeadline() : m_hasTimeLimit(false), m_stopFlag(nullptr) {}
+
+  // A time limit of 0 or less means no time limit. It starts now.
+  RandSpgDeadline(double timeLimit,
+                  const std::shared_ptr<const RandSpgCancelToken>& token) :
+    m_hasTimeLimit(timeLimit > 0), m_token(token), m_stopFlag(nullptr)
+  {
+    if (m_hasTimeLimit) m_end = getRandSpgTimePoint(timeLimit);
+  }
+
+  // The deadline also expires once this flag is set. The parallel attempts
+  // use it to stop an attempt that is no longer needed. The flag must
+  // outlive every use of the deadline.
+  void setStopFlag(const std::atomic<bool>* flag) { m_stopFlag = flag; }
+
+  reason check() const
+  {
+    if (m_stopFlag && *m_stopFlag) return stopped;
+    if (!m_hasTimeLimit && !m_token) return notExpired;
+    if (m_token && m_token->isCancelled()) return cancelled;
+
+    clock::time_point now = clock::now();
+    if (m_hasTimeLimit && now >= m_end) return timedOut;
+    if (m_token && now >= m_token->getDeadline()) return timedOut;
+    return notExpired;
+  }
+
+  bool hasExpired() const { return check() != notExpired; }
+
+ private:
+  bool m_hasTimeLimit;
+  clock::time_point m_end;
+  std::shared_ptr<const RandSpgCancelToken> m_token;
+  const std::atomic<bool>* m_stopFlag;
+};
+
+// Thrown by a search that checks a RandSpgDeadline (finding the Wyckoff
+// position possibilities, see RandSpgCombinatorics) when the deadline
+// expires. Nothing that the search found is kept.
+class RandSpgExpiredError : public std::runtime_error {
+ public:
+  explicit RandSpgExpiredError(RandSpgDeadline::reason reason) :
+    std::runtime_error(reason == RandSpgDeadline::cancelled ?
+                         std::string("the search was cancelled") :
+                       reason == RandSpgDeadline::stopped ?
+                         std::string("the search was stopped") :
+                         std::string("the search ran out of time")),
+    m_reason(reason) {}
+
+  RandSpgDeadline::reason getReason() const { return m_reason; }
+
+ private:
+  RandSpgDeadline::reason m_reason;
+};
+
+#endif
@@ -43,46 +43,124 @@ combinations to put atoms in a given spacegroup.
 #ifndef RAND_SPG_COMBINATORICS_H
 #define RAND_SPG_COMBINATORICS_H
 
-// This is a vector of assignments
-// in which to place atoms of a pre-known atomic number may be placed
-// It doesn't mean "single" atom as in one atom, but one type of atom
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "randSpg.h"
 
-// This is a vector of similar Wyckoff positions
 // Wyckoff positions are considered similar if they share the same multiplicity
-// and uniqueness
-typedef std::vector<wyckPos> similarWyckPositions;
+// and uniqueness. The combinatorics only need to know how many positions of
+// each group of similar positions are used, so everything below refers to
+// the groups by a small index into the spacegroup's group table.
+struct wyckGroupTable {
+  uint spg;
+  // The multiplicity and uniqueness of each group
+  std::vector<uint16_t> multiplicities;
+  std::vector<bool> unique;
+  // The positions in group 'g' are
+  // positionIndices[groupOffsets[g]] to positionIndices[groupOffsets[g + 1] - 1]
+  // They are indices into RandSpg::getWyckoffPositions(spg)
+  std::vector<uint8_t> groupOffsets;
+  std::vector<uint8_t> positionIndices;
+  // The group of each Wyckoff position (indexed like getWyckoffPositions())
+  std::vector<uint8_t> groupOfPosition;
+
+  // The number of times each unique group is used is packed into a
+  // uint64_t. Each unique group gets a field starting at uniqueShifts[g]
+  // that is just wide enough to hold the number of positions in the group,
+  // plus one guard bit above it. Adding 'uniqueBias' to a sum of usages
+  // sets a guard bit if any group is used more times than it has positions.
+  std::vector<uint8_t> uniqueShifts;
+  uint64_t uniqueBias;
+  uint64_t uniqueGuardMask;
+
+  size_t numGroups() const { return multiplicities.size(); };
+  uint numPositionsInGroup(size_t g) const
+    { return groupOffsets[g + 1] - groupOffsets[g]; };
+  const wyckPos& getWyckPos(size_t g, size_t i) const
+    { return RandSpg::getWyckoffPositions(spg)[positionIndices[groupOffsets[g] + i]]; };
+  // Returns -1 if the spacegroup does not have this Wyckoff letter
+  int getPositionIndex(char wyckLet) const;
+
+  // The packed usage for using group 'g' 'numTimes' times. Zero if
+  // the group is not unique.
+  uint64_t uniqueUsage(size_t g, uint numTimes) const
+    { return unique[g] ? static_cast<uint64_t>(numTimes) << uniqueShifts[g] : 0; };
+  // Can both usages be used in the same system?
+  bool uniqueUsagesFit(uint64_t usage1, uint64_t usage2) const
+    { return ((usage1 + usage2 + uniqueBias) & uniqueGuardMask) == 0; };
+};
 
-// This provides a set of choosable positions and how many we are supposed to
-// choose
+// This provides a group of similar positions and how many we are supposed to
+// choose from it
 struct similarWyckPosAndNumToChoose {
-  uint numToChoose;
-  similarWyckPositions choosablePositions;
+  uint16_t numToChoose;
+  uint8_t group;
 };
 
-typedef std::vector<similarWyckPosAndNumToChoose> assignments;
-
-// We have here an atomic number and the assignments to produce a single
-// possibility for a given atomic number
-struct singleAtomPossibility {
-  uint atomicNum;
-  assignments assigns;
+// This represents all possible systems from which a composition can be
+// correctly reconstructed using Wyckoff positions.
+// Every possibility contains the same atom types in the same order. The
+// assignments of all possibilities are stored in one contiguous array:
+// the assignments for type 't' of possibility 'i' are
+// assigns[offsets[i * numTypes() + t]] to assigns[offsets[i * numTypes() + t + 1] - 1]
+struct systemPossibilities {
+  uint spg;
+  std::vector<uint> atomicNums;
+  std::vector<similarWyckPosAndNumToChoose> assigns;
+  std::vector<uint32_t> offsets;
+  // The packed number of times each unique group is used by each
+  // possibility. See wyckGroupTable.
+  std::vector<uint64_t> uniqueUsages;
+
+  systemPossibilities(uint s = 0) : spg(s), offsets(1, 0) {}
+
+  size_t numTypes() const { return atomicNums.size(); };
+  size_t size() const
+    { return atomicNums.empty() ? 0 : (offsets.size() - 1) / atomicNums.size(); };
+  bool empty() const { return size() == 0; };
+
+  const similarWyckPosAndNumToChoose* assignsBegin(size_t i, size_t t) const
+    { return assigns.data() + offsets[i * numTypes() + t]; };
+  const similarWyckPosAndNumToChoose* assignsEnd(size_t i, size_t t) const
+    { return assigns.data() + offsets[i * numTypes() + t + 1]; };
+
+  // Append a copy of possibility 'i' of 'other', which must have the same
+  // types
+  void appendPossibility(const systemPossibilities& other, size_t i);
+  // Finish the assignments for the next type. Call after pushing the
+  // type's assignments onto 'assigns'.
+  void endType() { offsets.push_back(assigns.size()); };
+  // Finish a possibility. Call after its last type has been ended.
+  void endPossibility(uint64_t uniqueUsage)
+    { uniqueUsages.push_back(uniqueUsage); };
 };
 
-// This represents all possible solutions of the system (for individual
-// atomic numbers. Not all of them together). We assume
-// everything in this vector has the same atomic number.
-typedef std::vector<singleAtomPossibility> singleAtomPossibilities;
-
-// This should be a vector of different atom combinations that give the final
-// desired composition. We assume possibilities in this vector may
-// have different atomic numbers
-typedef std::vector<singleAtomPossibility> systemPossibility;
-// This represents all possible systems from which a composition can be
-// correctly reconstructed using Wyckoff positions
-typedef std::vector<systemPossibility> systemPossibilities;
+// The possibilities for a single atom type use the same layout with only
+// one type
+typedef systemPossibilities singleAtomPossibilities;
+
+// Constraints that are applied during the search so that possibilities
+// that break them are never built
+struct wyckConstraints {
+  // Only find possibilities that use the most general Wyckoff position at
+  // least once
+  bool forceMostGeneralWyckPos;
+  // Each pair is an atomic number and a Wyckoff letter that the atomic
+  // number must use. Repeat a pair to require it to be used more times.
+  std::vector<std::pair<uint, char>> forcedWyckAssignments;
+  wyckConstraints() : forceMostGeneralWyckPos(false) {}
+};
 
 class RandSpgCombinatorics {
  public:
+  // Get the table of similar Wyckoff position groups for a spacegroup.
+  // It is built the first time it is requested.
+  static const wyckGroupTable& getWyckGroupTable(uint spg);
+
   // Returns all system possibilities that satisfy the constraints given
   // by the spacegroup and input atoms
   static systemPossibilities getSystemPossibilities(
@@ -91,6 +169,27 @@ class RandSpgCombinatorics {
                                              bool findOnlyOne = false,
                                              bool onlyNonUnique = false);
 
+  // Same as above, but only possibilities that satisfy the constraints are
+  // found. The constraints are used to prune the search, so this is much
+  // faster than finding everything and removing possibilities afterwards.
+  // The search throws a RandSpgExpiredError if 'deadline' expires first.
+  static systemPossibilities getSystemPossibilities(
+                              uint spg,
+                              const std::vector<uint>& atoms,
+                              const wyckConstraints& constraints,
+                              bool findOnlyOne = false,
+                              bool onlyNonUnique = false,
+                              const RandSpgDeadline& deadline =
+                                RandSpgDeadline());
+
+  // Count the system possibilities that getSystemPossibilities() would
+  // return without finding them. The count saturates: UINT64_MAX means
+  // that there are at least that many.
+  static uint64_t countSystemPossibilities(
+                        uint spg,
+                        const std::vector<uint>& atoms,
+                        const wyckConstraints& constraints = wyckConstraints());
+
   // This removes all possibilities for which the wyckLet is NOT in the possible
   // setup. This does not guarantee, however, that the wyckoff position will be
   // used. You must force it to be selected with a special function that
@@ -114,8 +213,8 @@ class RandSpgCombinatorics {
                                            uint spg,
                                            uint minNumUses = 1);
 
-  // Pick a random system possibility from the system possibilities
-  static systemPossibility getRandomSystemPossibility(const systemPossibilities& sysPoss);
+  // Pick the index of a random system possibility
+  static size_t getRandomSystemPossibility(const systemPossibilities& sysPoss);
 
   // Get a random set of atom assignments from all the system possibilities
   static atomAssignments getRandomAtomAssignments(const systemPossibilities& sysPoss);
@@ -124,23 +223,34 @@ class RandSpgCombinatorics {
              const systemPossibilities& sysPoss,
              const std::vector<std::pair<uint, wyckPos>>& forcedWyckPositions);
 
-  static std::string getSimilarWyckPosAndNumToChooseString(const similarWyckPosAndNumToChoose& simPos);
+  // The string functions below are only used for logging and debugging
+
+  static std::string getSimilarWyckPosAndNumToChooseString(uint spg, const similarWyckPosAndNumToChoose& simPos);
 
-  static void printSimilarWyckPosAndNumToChoose(const similarWyckPosAndNumToChoose& simPos);
+  static void printSimilarWyckPosAndNumToChoose(uint spg, const similarWyckPosAndNumToChoose& simPos);
 
-  static std::string getSingleAtomPossibilityString(const singleAtomPossibility& pos);
+  // Type 't' of possibility 'i'
+  static std::string getSingleAtomPossibilityString(const systemPossibilities& pos, size_t i, size_t t);
 
-  static void printSingleAtomPossibility(const singleAtomPossibility& pos);
+  static void printSingleAtomPossibility(const systemPossibilities& pos, size_t i, size_t t);
 
-  static std::string getSystemPossibilityString(const systemPossibility& pos);
+  static std::string getSystemPossibilityString(const systemPossibilities& pos, size_t i);
 
-  static void printSystemPossibility(const systemPossibility& pos);
+  static void printSystemPossibility(const systemPossibilities& pos, size_t i);
 
   static std::string getSystemPossibilitiesString(const systemPossibilities& pos);
 
   // To be added to the log file when the user specifies 'verbose' output
   static std::string getVerbosePossibilitiesString(const systemPossibilities& pos);
 
+  // The same text as getVerbosePossibilitiesString(), but it is sent to
+  // 'out' one possibility at a time, so the whole text is never in memory.
+  // If 'maxPossibilities' is not 0, only that many are written, and a line
+  // says how many were left out.
+  static void writeVerbosePossibilities(const systemPossibilities& pos,
+                                        const std::function<void(const std::string&)>& out,
+                                        size_t maxPossibilities = 0);
+
   static void printSystemPossibilities(const systemPossibilities& pos);
 };
 
@@ -0,0 +1,88 @@
+/**********************************************************************
+  randSpgContext.h - The radii, minimum interatomic distances, and log
+                     destination used by one call to RandSpg.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef RAND_SPG_CONTEXT_H
+#define RAND_SPG_CONTEXT_H
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "randSpg.h"
+
+// RandSpg::randSpgCrystal() used to apply the scaling factor, min radius,
+// explicit radii, and custom minIADs of its input to the static ElemInfo
+// class, so two calls with different settings could not run at the same
+// time. A context holds its own copy of them instead. It is built from an
+// input and never changed afterwards, so any number of threads may share
+// one. Crystals keep a pointer to the context they were made with.
+class RandSpgContext {
+ public:
+  // Receives the text that would have been appended to the log file
+  typedef std::function<void(const std::string&)> logSink;
+
+  // The database radii, no custom minIADs, and no log
+  RandSpgContext();
+
+  /* Build a context from the radius and minIAD settings of an input.
+   *
+   * @param input The input.
+   * @param sink Where the log text goes. If it is empty, the text is
+   *             appended to the file that e_logfilename names when the
+   *             context is built.
+   */
+  explicit RandSpgContext(const randSpgInput& input,
+                          const logSink& sink = logSink());
+
+  double getRadius(uint atomicNum, bool usingVdwRadius) const;
+
+  // Find the minimum interatomic distance for a pair of atoms. This is the
+  // custom minIAD if there is one. Otherwise, it is the sum of the radii.
+  double getMinIAD(uint atomicNum1, uint atomicNum2,
+                   bool usingVdwRadii) const;
+
+  // Send text to the log sink (if there is one)
+  void log(const std::string& text) const;
+
+  // Whether log() goes anywhere. If it does not, the log text does not
+  // need to be made.
+  bool hasLogSink() const { return static_cast<bool>(m_logSink); }
+
+  // A sink that appends to a file. The file is closed once no sink writes
+  // to it (see LogWriter::open()).
+  static logSink fileLogSink(const std::string& fileName);
+
+ private:
+  double computeMinIAD(uint atomicNum1, uint atomicNum2,
+                       bool usingVdwRadii) const;
+
+  std::vector<double> m_covalentRadii;
+  std::vector<double> m_vdwRadii;
+  std::vector<std::pair<std::pair<uint, uint>, double>> m_customMinIADs;
+
+  // The minIADs of every pair of atomic numbers in the input are looked up
+  // here. m_tableIndices has an entry for every atomic number, and it is
+  // -1 for those that are not in the table.
+  std::vector<int> m_tableIndices;
+  size_t m_tableSize;
+  std::vector<double> m_covalentMinIADs;
+  std::vector<double> m_vdwMinIADs;
+
+  logSink m_logSink;
+};
+
+#endif
@@ -0,0 +1,158 @@
+/**********************************************************************
+  randSpgGenerator.h - Generates any number of crystals with one set of
+                       inputs after doing the setup once.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef RAND_SPG_GENERATOR_H
+#define RAND_SPG_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+
+#include "randSpg.h"
+
+class RandSpgContext;
+class WyckAssignmentSampler;
+struct cachedPossibilities;
+
+// RandSpg::randSpgCrystal() builds the radii and minIADs, looks up the
+// Wyckoff position possibilities (finding them the first time), and looks
+// up the assignment sampler every time it is called. A RandSpgGenerator
+// does all of that once, when it is constructed, so that each crystal after
+// that only costs its attempts. A call of generate() gives the same crystal
+// as randSpgCrystal() does with the same input and random numbers.
+//
+// For example, to generate crystals one at a time:
+//   RandSpgGenerator generator(input);
+//   Crystal c = generator.generate();
+// or to loop over up to 10 of them:
+//   for (const Crystal& c : generator.crystals(10)) ...
+class RandSpgGenerator {
+ public:
+  // The radii and minIADs come from the input
+  explicit RandSpgGenerator(const randSpgInput& input);
+
+  // The radii, minIADs, and log text come from 'context'. Finding the
+  // possibilities stops if randSpgInput::timeLimit, which starts here,
+  // passes or the cancel token of the input expires first, and then
+  // generate() always fails with randSpgTimedOut or randSpgCancelled.
+  RandSpgGenerator(const randSpgInput& input,
+                   const std::shared_ptr<const RandSpgContext>& context);
+
+  /* Generate one crystal. Nothing in the generator is changed, so this may
+   * be called from several threads at once. randSpgInput::timeLimit starts
+   * when this is called.
+   *
+   * @param status Set to the reason it returned what it did.
+   *
+   * @return The crystal, or a crystal with zero volume if it failed.
+   */
+  Crystal generate(randSpgStatus& status) const;
+  Crystal generate() const;
+
+  /* Generate up to 'n' crystals into one batch. It stops early at the
+   * first crystal that could not be generated.
+   *
+   * @param status Set to the status of the last crystal.
+   */
+  crystalBatch generateBatch(size_t n, randSpgStatus& status) const;
+
+  const randSpgInput& getInput() const { return m_input; };
+  const std::shared_ptr<const RandSpgContext>& getContext() const
+  {
+    return m_context;
+  };
+
+  // False if the spacegroup cannot hold the atoms with these settings. Then
+  // generate() always fails with randSpgNoPossibilities.
+  bool isPossible() const;
+
+  class crystalRange;
+
+  // An input iterator over crystals that are generated as it is advanced.
+  // Only comparisons with the end of its range are meaningful.
+  class iterator {
+   public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef Crystal value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Crystal* pointer;
+    typedef const Crystal& reference;
+
+    // The end of any range
+    iterator() : m_range(nullptr), m_remaining(0) {}
+
+    reference operator*() const { return m_crystal; };
+    pointer operator->() const { return &m_crystal; };
+    iterator& operator++();
+    iterator operator++(int);
+    bool operator==(const iterator& other) const
+    {
+      return atEnd() == other.atEnd();
+    };
+    bool operator!=(const iterator& other) const { return !(*this == other); };
+
+   private:
+    friend class crystalRange;
+    iterator(crystalRange* range, size_t count);
+    void next();
+    bool atEnd() const { return m_range == nullptr; };
+
+    crystalRange* m_range;
+    size_t m_remaining;
+    Crystal m_crystal;
+  };
+
+  // Up to a number of crystals. The range ends early at the first crystal
+  // that could not be generated, and getStatus() says why. The generator
+  // must outlive the range, and the range must outlive its iterators.
+  class crystalRange {
+   public:
+    crystalRange(const RandSpgGenerator& generator, size_t count) :
+      m_generator(&generator), m_count(count), m_status(randSpgSucceeded) {}
+
+    iterator begin() { return iterator(this, m_count); };
+    iterator end() { return iterator(); };
+
+    // The status of the last crystal that was generated
+    randSpgStatus getStatus() const { return m_status; };
+
+   private:
+    friend class iterator;
+    const RandSpgGenerator* m_generator;
+    size_t m_count;
+    randSpgStatus m_status;
+  };
+
+  // The crystals are generated as the range is iterated. With no count,
+  // there is no limit other than the first failure.
+  crystalRange crystals(size_t count = SIZE_MAX) const
+  {
+    return crystalRange(*this, count);
+  };
+
+ private:
+  randSpgInput m_input;
+  std::shared_ptr<const RandSpgContext> m_context;
+  // Why finding the possibilities stopped, if it did. It is set before
+  // m_cached is.
+  RandSpgDeadline::reason m_setupExpired;
+  std::shared_ptr<const cachedPossibilities> m_cached;
+  // Null if there are no possibilities
+  std::shared_ptr<const WyckAssignmentSampler> m_sampler;
+};
+
+#endif
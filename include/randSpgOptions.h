@@ -21,6 +21,7 @@
 
 // This is for 'latticeStruct'
 #include "crystal.h"
+#include "wyckSampling.h"
 
 class RandSpgOptions {
  public:
@@ -87,7 +88,20 @@ class RandSpgOptions {
   double getMaxVolume() const {return m_maxVolume;};
   int getMaxAttempts() const {return m_maxAttempts;};
   std::string getOutputDir() const {return m_outputDir;};
+  std::string getOutputFormat() const {return m_outputFormat;};
+  bool removeDuplicates() const {return m_removeDuplicates;};
+  uint getDuplicateRetries() const {return m_duplicateRetries;};
   char getVerbosity() const {return m_verbosity;};
+  size_t getMaxVerbosePossibilities() const {return m_maxVerbosePossibilities;};
+  std::string getCombinatoricsCacheFile() const {return m_combinatoricsCacheFile;};
+  wyckSamplingOptions getWyckSampling() const {return m_wyckSampling;};
+  uint getNumThreads() const {return m_numThreads;};
+  uint getNumParallelAttempts() const {return m_numParallelAttempts;};
+  double getEarlyAbortThreshold() const {return m_earlyAbortThreshold;};
+  double getTimeLimit() const {return m_timeLimit;};
+  double getSpgTimeBudget() const {return m_spgTimeBudget;};
+  int getSeed() const {return m_seed;};
+  std::string getJobCostHistoryFile() const {return m_jobCostHistoryFile;};
   // This will return false if the options are invalid
   bool optionsAreValid() const {return m_optionsAreValid;};
 
@@ -108,7 +122,20 @@ class RandSpgOptions {
   void setMaxVolume(double d) {m_maxVolume = d;};
   void setMaxAttempts(int i) {m_maxAttempts = i;};
   void setOutputDir(const std::string& s) {m_outputDir = s;};
+  void setOutputFormat(const std::string& s) {m_outputFormat = s;};
+  void setRemoveDuplicates(bool b) {m_removeDuplicates = b;};
+  void setDuplicateRetries(uint u) {m_duplicateRetries = u;};
   void setVerbosity(char c) {m_verbosity = c;};
+  void setMaxVerbosePossibilities(size_t u) {m_maxVerbosePossibilities = u;};
+  void setCombinatoricsCacheFile(const std::string& s) {m_combinatoricsCacheFile = s;};
+  void setWyckSampling(const wyckSamplingOptions& o) {m_wyckSampling = o;};
+  void setNumThreads(uint u) {m_numThreads = u;};
+  void setNumParallelAttempts(uint u) {m_numParallelAttempts = u;};
+  void setEarlyAbortThreshold(double d) {m_earlyAbortThreshold = d;};
+  void setTimeLimit(double d) {m_timeLimit = d;};
+  void setSpgTimeBudget(double d) {m_spgTimeBudget = d;};
+  void setSeed(int i) {m_seed = i;};
+  void setJobCostHistoryFile(const std::string& s) {m_jobCostHistoryFile = s;};
 
  private:
   // m_filename: string for the filename that the options were read from
@@ -165,10 +192,68 @@ class RandSpgOptions {
   // m_outputDir: the name of the output directory
   std::string m_outputDir;
 
+  // m_outputFormat: how the structures are written to the output directory.
+  // "poscar" is one POSCAR file for each structure. "cif" is one CIF file
+  // for each structure, with only its asymmetric unit. "poscarContainer" and
+  // "xyzContainer" are one structure container for the run (see
+  // structureContainer.h). "binary" and "binary32" are one binary structure
+  // file with float64 or float32 coordinates (see structureBinaryFile.h).
+  std::string m_outputFormat;
+
+  // m_removeDuplicates: if true, a structure is not written if it has the
+  // same fingerprint (see structureFingerprint.h) as an earlier one
+  bool m_removeDuplicates;
+
+  // m_duplicateRetries: the most times a duplicate structure is made again
+  // before it is removed
+  uint m_duplicateRetries;
+
   // m_verbosity: the verbosity of the log file: 'n' for none, 'r' for regular,
   // and 'v' for verbose.
   char m_verbosity;
 
+  // m_maxVerbosePossibilities: the most system possibilities that are
+  // printed with verbosity 'v'. 0 means all of them.
+  size_t m_maxVerbosePossibilities;
+
+  // m_combinatoricsCacheFile: a file for storing the Wyckoff position
+  // combinations between runs. Empty means no file is used.
+  std::string m_combinatoricsCacheFile;
+
+  // m_wyckSampling: how the Wyckoff positions are picked for each attempt
+  wyckSamplingOptions m_wyckSampling;
+
+  // m_numThreads: the number of crystals generated at the same time. 0 means
+  // one for each hardware thread.
+  uint m_numThreads;
+
+  // m_numParallelAttempts: the number of attempts of each crystal that are
+  // run at the same time
+  uint m_numParallelAttempts;
+
+  // m_earlyAbortThreshold: the attempts of a crystal stop once the
+  // estimated chance that any of the rest succeeds is below this. 0 means
+  // they never stop early.
+  double m_earlyAbortThreshold;
+
+  // m_timeLimit: the most wall time in seconds that one crystal may take. 0
+  // means no limit.
+  double m_timeLimit;
+
+  // m_spgTimeBudget: the wall time in seconds that the crystals of one
+  // spacegroup may take together, from when the first one starts. The rest
+  // are skipped once it is used. 0 means no budget.
+  double m_spgTimeBudget;
+
+  // m_seed: the seed the random numbers of every crystal are derived from.
+  // -1 means a random seed is picked.
+  int m_seed;
+
+  // m_jobCostHistoryFile: a file of the average job time of each
+  // spacegroup. It is used to start the slow spacegroups first. Empty means
+  // no file is used.
+  std::string m_jobCostHistoryFile;
+
   // This will be false if the options are not valid
   bool m_optionsAreValid;
 };
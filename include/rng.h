@@ -19,6 +19,27 @@
 
 #include <random>
 
+#ifndef __MINGW32__
+// Every thread has its own generator. It is seeded once, the first time the
+// thread uses it, because seeding takes far longer than drawing a number.
+inline std::mt19937& getRandEngine()
+{
+  static thread_local std::mt19937 engine(std::random_device{}());
+  return engine;
+}
+#endif
+
+// Seed the generator of this thread. The numbers drawn on this thread after
+// this are the same every time the same seed is used.
+static inline void seedRandEngine(unsigned int seed)
+{
+#ifdef __MINGW32__
+  srand(seed);
+#else
+  getRandEngine().seed(seed);
+#endif
+}
+
 // C++11 way of generating random numbers in a thread-safe manner...
 // Creating a new distribution each time is supposedly very fast...
 static inline double getRandDouble(double min, double max)
@@ -31,9 +52,8 @@ static inline double getRandDouble(double min, double max)
          (max - min) + min;
 #else
   // These random number generators are probably better.
-  std::mt19937 generator(std::random_device{}());
   std::uniform_real_distribution<double> distribution(min, max);
-  return distribution(generator);
+  return distribution(getRandEngine());
 #endif
 }
 
@@ -46,9 +66,8 @@ static inline int getRandInt(int min, int max)
   return rand() % (max + 1 - min) + min;
 #else
   // These random number generators are probably better.
-  std::mt19937 generator(std::random_device{}());
   std::uniform_int_distribution<int> distribution(min, max);
-  return distribution(generator);
+  return distribution(getRandEngine());
 #endif
 }
 
@@ -0,0 +1,170 @@
+/**********************************************************************
+  shardResults.h - The results of one shard of a randSpg run, and how to
+                   merge the shards of a run back together.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+/* With '--shard i/N', the randSpg executable only runs the jobs whose index
+   is i modulo N (the jobs are numbered by spacegroup, then by index within
+   the spacegroup). Every job is seeded from the seed option, its
+   spacegroup, and its index, so the shards of a run make the same crystals
+   as a run without shards.
+
+   Each shard writes a results file next to its log file. It is a text file
+   that starts with these lines:
+     randSpg shard results <version>
+     shard <i> <N>
+     seed <seed>
+     numJobs <number of jobs in the whole run>
+     setupTime <seconds>
+     loopTime <seconds>
+     rules <earlyAbort> <timeLimit> <spgTimeBudget> <removeDuplicates>
+     options <number of bytes>
+     <the options text>
+   followed by one record for each job of the shard:
+     job <index> <spg> <index in spg> <status> <duplicate retries> <seconds>
+         <number of bytes>
+     <the log text of the job>
+   The rules are 1 if they were used and 0 if not, and the status is one of
+   the names of getJobStatusName().
+*/
+
+#ifndef SHARD_RESULTS_H
+#define SHARD_RESULTS_H
+
+#include <string>
+#include <vector>
+
+// For uint on windows
+#include "crystal.h"
+
+// How a job ended. Only one applies to each job.
+enum jobStatus {
+  jobSucceeded,
+  jobFailed,
+  // The attempts were stopped by the early abort rule
+  jobAbortedEarly,
+  // The job ran out of time
+  jobTimedOut,
+  // The job was not run since its spacegroup's time budget was used
+  jobSkipped,
+  // The crystal was removed since it was the same as an earlier one
+  jobDuplicate
+};
+
+static inline std::string getJobStatusName(jobStatus status)
+{
+  switch (status) {
+    case jobSucceeded:
+      return "succeeded";
+    case jobFailed:
+      return "failed";
+    case jobAbortedEarly:
+      return "abortedEarly";
+    case jobTimedOut:
+      return "timedOut";
+    case jobSkipped:
+      return "skipped";
+    case jobDuplicate:
+      return "duplicate";
+  }
+  return "unknown";
+}
+
+struct jobRecord {
+  // The index of the job in the whole run
+  size_t index;
+  uint spg;
+  // The index of the job within its spacegroup (starting at 0)
+  size_t spgIndex;
+  jobStatus status;
+  // The number of times the crystal was made again as a duplicate
+  uint duplicateRetries;
+  // The wall time of the job in seconds
+  double time;
+  // The text the job wrote to the log file
+  std::string log;
+};
+
+struct shardResults {
+  size_t shardIndex;
+  size_t numShards;
+  uint seed;
+  // The number of jobs in the whole run (in every shard)
+  size_t numJobs;
+  double setupTime;
+  double loopTime;
+  // Whether the early abort rule, a time limit, a spacegroup time budget,
+  // and duplicate removal were used. The summary of the run only has the
+  // counts of the rules that were used.
+  bool earlyAbort;
+  bool timeLimit;
+  bool spgTimeBudget;
+  bool removeDuplicates;
+  // The options text at the top of the log file
+  std::string optionsString;
+  // The jobs of this shard, ordered by index
+  std::vector<jobRecord> jobs;
+
+  shardResults() : shardIndex(0), numShards(1), seed(0), numJobs(0),
+                   setupTime(0), loopTime(0), earlyAbort(false),
+                   timeLimit(false), spgTimeBudget(false),
+                   removeDuplicates(false) {}
+};
+
+class ShardResults {
+ public:
+  /* Read a '--shard' argument of the form "i/N".
+   *
+   * @param s The argument.
+   * @param shardIndex Set to i.
+   * @param numShards Set to N.
+   *
+   * @return True if the argument is valid (N > 0 and 0 <= i < N).
+   */
+  static bool parseShardArgument(const std::string& s, size_t& shardIndex,
+                                 size_t& numShards);
+
+  // The results file of a shard. For example, "randSpg.log" becomes
+  // "randSpg.shard-2-of-8.results".
+  static std::string getResultsFileName(const std::string& logFileName,
+                                        size_t shardIndex, size_t numShards);
+
+  // The log file of a shard. For example, "randSpg.log" becomes
+  // "randSpg.shard-2-of-8.log".
+  static std::string getLogFileName(const std::string& logFileName,
+                                    size_t shardIndex, size_t numShards);
+
+  static bool write(const std::string& fileName, const shardResults& results);
+
+  static bool read(const std::string& fileName, shardResults& results);
+
+  /* Merge the results of every shard of a run.
+   *
+   * @param shards The results of the shards. Each shard must be given
+   *               exactly once, and they must all come from the same
+   *               input and seed.
+   * @param merged Set to the results of the whole run. The shard index is
+   *               0, the number of shards is the number that was merged,
+   *               and the loop time is that of the slowest shard.
+   * @param error Set to the reason if the shards cannot be merged. A shard
+   *              whose index is not less than its number of shards is one
+   *              such reason.
+   *
+   * @return True on success.
+   */
+  static bool merge(const std::vector<shardResults>& shards,
+                    shardResults& merged, std::string& error);
+};
+
+#endif
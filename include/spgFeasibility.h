@@ -0,0 +1,82 @@
+/**********************************************************************
+  spgFeasibility.h - Fast checks for whether a composition may be
+                     generated with a spacegroup. Used by
+                     RandSpg::isSpgPossible().
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+/* A composition is possible for a spacegroup if the atoms of every type can
+   be written as a sum of Wyckoff multiplicities, where each unique
+   position is used by at most one atom in the whole crystal.
+
+   For each spacegroup, we precompute:
+     - a bitset of every number of atoms that can be made with the
+       non-unique positions alone (an unbounded subset-sum), and
+     - the multiplicities of the unique positions, grouped by multiplicity.
+
+   There are at most a few dozen ways to use the unique positions of a
+   spacegroup, so a composition is checked with a small dynamic program over
+   the unique positions that have been used so far. Each step asks the bitset
+   whether the rest of the atoms of a type fit in the non-unique positions.
+*/
+
+#ifndef SPG_FEASIBILITY_H
+#define SPG_FEASIBILITY_H
+
+#include <bitset>
+#include <vector>
+
+// For uint on windows
+#include "crystal.h"
+
+// Bit 'spg - 1' is set if the spacegroup 'spg' is possible
+typedef std::bitset<230> spgMask;
+
+class SpgFeasibility {
+ public:
+  /* Check whether a spacegroup is possible for a composition.
+   *
+   * @param spg The spacegroup to check.
+   * @param atoms A vector of atomic numbers (one for each atom).
+   *
+   * @return True if the atoms can be placed in the spacegroup's Wyckoff
+   *         positions. False if they cannot or if the spg is invalid.
+   */
+  static bool isSpgPossible(uint spg, const std::vector<uint>& atoms);
+
+  /* Same as above, but the composition is given as the number of atoms of
+   * each type. The order does not matter.
+   */
+  static bool isSpgPossibleForCounts(uint spg,
+                                     const std::vector<uint>& numOfEachType);
+
+  /* Check all 230 spacegroups for a composition at once.
+   *
+   * @param atoms A vector of atomic numbers (one for each atom).
+   *
+   * @return A mask where bit 'spg - 1' is set if 'spg' is possible.
+   */
+  static spgMask getPossibleSpgMask(const std::vector<uint>& atoms);
+
+  /* Check all 230 spacegroups for many compositions.
+   *
+   * @param compositions A vector of compositions. Each composition is a
+   *                     vector of atomic numbers (one for each atom).
+   *
+   * @return One mask for each composition, in the same order.
+   */
+  static std::vector<spgMask> getPossibleSpgMasks(
+                         const std::vector<std::vector<uint>>& compositions);
+};
+
+#endif
@@ -0,0 +1,171 @@
+/**********************************************************************
+  structureBinaryFile.h - Many structures in a binary file that can be
+                          memory-mapped and read without parsing.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+/* A binary structure file holds the structures of a run as flat arrays, so
+   that a program (NumPy, for example) can map the file into memory and use
+   the arrays as they are. Every number is little-endian, and every section
+   starts at a multiple of 8 bytes. The file is:
+
+     The header, 64 bytes:
+       char[8]   magic: "RSPGBIN" and a zero byte
+       uint32    version
+       uint32    the size of a coordinate: 4 (float32) or 8 (float64)
+       uint64    numStructures
+       uint64    numAtoms: the number of atoms in every structure together
+       uint64    the offset of the coordinates
+       uint64    the offset of the species
+       uint64    the offset of the lattices
+       uint64    the offset of the structure table
+     The coordinates: numAtoms x 3 fractional coordinates
+     The species: numAtoms uint8 atomic numbers
+     The lattices: numStructures x 3 x 3 float64. The rows are the lattice
+       vectors in Angstroms.
+     The structure table: numStructures records of 32 bytes:
+       uint64    the index of the first atom of the structure
+       uint32    the number of atoms
+       uint16    spg
+       uint16    (zero)
+       uint32    the index of the structure within its spacegroup
+       uint32    the seed its random numbers were drawn from
+       float64   the wall time it took to generate, in seconds
+
+   With NumPy, for a file 'f' with float64 coordinates:
+     header = np.fromfile(f, dtype='<u8', count=8)
+     n, numAtoms, coordsAt, speciesAt, latticesAt, tableAt = header[2:]
+     coords = np.memmap(f, '<f8', 'r', coordsAt, (numAtoms, 3))
+     species = np.memmap(f, 'u1', 'r', speciesAt, (numAtoms,))
+     lattices = np.memmap(f, '<f8', 'r', latticesAt, (n, 3, 3))
+     table = np.memmap(f, np.dtype([('first', '<u8'), ('numAtoms', '<u4'),
+                                    ('spg', '<u2'), ('pad', '<u2'),
+                                    ('index', '<u4'), ('seed', '<u4'),
+                                    ('time', '<f8')]), 'r', tableAt, (n,))
+*/
+
+#ifndef STRUCTURE_BINARY_FILE_H
+#define STRUCTURE_BINARY_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "crystal.h"
+#include "structureContainer.h"
+
+struct structureBinaryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t coordSize;
+  uint64_t numStructures;
+  uint64_t numAtoms;
+  uint64_t coordsOffset;
+  uint64_t speciesOffset;
+  uint64_t latticesOffset;
+  uint64_t tableOffset;
+};
+
+struct structureBinaryRecord {
+  uint64_t firstAtom;
+  uint32_t numAtoms;
+  uint16_t spg;
+  uint16_t padding;
+  uint32_t spgIndex;
+  uint32_t seed;
+  double time;
+};
+
+class StructureBinaryWriter {
+ public:
+  StructureBinaryWriter();
+  // Closes the file if it is open
+  ~StructureBinaryWriter();
+
+  /* Start a new file. An existing file with the name is replaced.
+   *
+   * @param fileName The name of the file.
+   * @param coordSize 4 to store the coordinates as float32, or 8 for
+   *                  float64.
+   */
+  bool open(const std::string& fileName, uint32_t coordSize = 8);
+
+  /* Add a structure to the end of the file. This is not thread-safe. The
+   * coordinates are written right away. The species, lattice, and record
+   * (about 100 bytes and one byte for each atom) are kept until close().
+   *
+   * @param crystal The structure.
+   * @param record The spg, index, seed, and time of the structure. The
+   *               offset, size, and name are not used.
+   *
+   * @return False if it could not be written.
+   */
+  bool append(const Crystal& crystal, const structureRecord& record);
+
+  // Write the species, lattices, table, and header, and close the file
+  bool close();
+
+ private:
+  std::string m_fileName;
+  uint32_t m_coordSize;
+  std::ofstream m_file;
+  std::vector<uint8_t> m_species;
+  std::vector<double> m_lattices;
+  std::vector<structureBinaryRecord> m_records;
+  // The coordinates of one structure, before they are written
+  std::vector<char> m_coordBuffer;
+};
+
+// Maps a binary structure file into memory (or reads it, where mapping is
+// not available) and gives pointers to its arrays.
+class StructureBinaryReader {
+ public:
+  StructureBinaryReader();
+  ~StructureBinaryReader();
+
+  // Open a file. It prints an error and returns false if it is not a
+  // binary structure file.
+  bool open(const std::string& fileName);
+  void close();
+
+  size_t numStructures() const { return m_header.numStructures; };
+  size_t numAtoms() const { return m_header.numAtoms; };
+  uint32_t getCoordSize() const { return m_header.coordSize; };
+
+  // The table record of structure 'i'
+  const structureBinaryRecord& getRecord(size_t i) const;
+
+  // The 9 lattice vector components of structure 'i'
+  const double* getLattice(size_t i) const;
+
+  // The atomic numbers of every atom
+  const uint8_t* getSpecies() const;
+
+  // The coordinates of every atom: 3 floats for each atom if
+  // getCoordSize() is 4, or 3 doubles if it is 8
+  const void* getCoords() const;
+
+  // Make structure 'i' back into a Crystal
+  Crystal getCrystal(size_t i) const;
+
+ private:
+  const char* m_data;
+  size_t m_size;
+  // Set if the file was read instead of mapped
+  std::vector<char> m_readData;
+  structureBinaryHeader m_header;
+};
+
+#endif
@@ -0,0 +1,137 @@
+/**********************************************************************
+  structureContainer.h - Many structures written to one file, with an
+                         index for finding any one of them.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+/* Writing one small file for every structure is slow on file systems that
+   keep their metadata on a server. A container holds every structure of a
+   run in one file instead. The structures are written one after another,
+   each as the text of a POSCAR or an extended XYZ file, so the container
+   can also be read as a plain concatenation of them. After the last
+   structure comes the index:
+     randSpg structure index <version>
+     format <poscar or xyz>
+     structures <number of structures>
+   followed by one line for each structure:
+     <offset> <size> <spg> <index in spg> <seed> <seconds> <name>
+   where the offset and size are in bytes. The last line of the file is
+     randSpg index at <offset of the index, 20 digits>
+   It always has the same length, so a reader can find the index by reading
+   the end of the file. The index is written when the container is closed.
+*/
+
+#ifndef STRUCTURE_CONTAINER_H
+#define STRUCTURE_CONTAINER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "crystal.h"
+#include "structureWriter.h"
+
+enum structureContainerFormat {
+  // Each structure is the text of a POSCAR
+  poscarContainer,
+  // Each structure is the text of an extended XYZ file
+  xyzContainer
+};
+
+struct structureRecord {
+  // Where the text of the structure is in the file, in bytes
+  uint64_t offset;
+  uint64_t size;
+  uint spg;
+  // The index of the structure within its spacegroup (starting at 1)
+  size_t spgIndex;
+  // The seed that its random numbers were drawn from
+  uint seed;
+  // The wall time it took to generate, in seconds
+  double time;
+  // A name without spaces, such as <composition>_<spg>-<index>
+  std::string name;
+
+  structureRecord() : offset(0), size(0), spg(0), spgIndex(0), seed(0),
+                      time(0) {}
+};
+
+class StructureContainerWriter {
+ public:
+  StructureContainerWriter();
+  // Closes the container if it is open
+  ~StructureContainerWriter();
+
+  // Start a new container. An existing file with the name is replaced.
+  bool open(const std::string& fileName, structureContainerFormat format);
+
+  /* Add a structure to the end of the container. This is not thread-safe.
+   *
+   * @param crystal The structure.
+   * @param title The title in the text of the structure.
+   * @param record The spg, index, seed, time, and name of the structure.
+   *               The offset and size are set here.
+   *
+   * @return False if it could not be written.
+   */
+  bool append(const Crystal& crystal, const std::string& title,
+              const structureRecord& record);
+
+  // Write the index and close the file
+  bool close();
+
+  size_t numStructures() const { return m_records.size(); };
+
+ private:
+  std::string m_fileName;
+  structureContainerFormat m_format;
+  std::ofstream m_file;
+  StructureWriter m_writer;
+  uint64_t m_size;
+  std::vector<structureRecord> m_records;
+};
+
+class StructureContainerReader {
+ public:
+  // Read the index of a container. It prints an error and returns false if
+  // the file cannot be read or has no index.
+  bool open(const std::string& fileName);
+
+  structureContainerFormat getFormat() const { return m_format; };
+
+  size_t numStructures() const { return m_records.size(); };
+
+  const structureRecord& getRecord(size_t i) const { return m_records[i]; };
+
+  // The position of the structure with this spg and index in the
+  // container, or -1 if there is none
+  long find(uint spg, size_t spgIndex) const;
+
+  // Read the text of structure 'i' from the file
+  bool readStructure(size_t i, std::string& text);
+
+ private:
+  std::string m_fileName;
+  structureContainerFormat m_format;
+  std::ifstream m_file;
+  std::vector<structureRecord> m_records;
+};
+
+class StructureContainer {
+ public:
+  // "poscar" or "xyz": the name of the format in the index
+  static std::string getFormatName(structureContainerFormat format);
+};
+
+#endif
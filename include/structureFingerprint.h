@@ -0,0 +1,110 @@
+/**********************************************************************
+  structureFingerprint.h - A fingerprint of a structure that is the same
+                           for structures that are the same.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+/* Random crystals in the same spacegroup are often the same structure,
+   especially when only special Wyckoff positions (which have no free
+   coordinates) are used. The fingerprint of a crystal is, for each pair of
+   atomic numbers, the sorted list of the distances between the atoms of
+   those types (with periodic images) out to a cutoff.
+
+   The distances are divided by the cube root of the volume per atom first,
+   so two crystals that only differ in size have the same fingerprint. The
+   fingerprint does not change if the atoms are reordered, moved by a
+   lattice vector, or moved together, or if the cell is rotated.
+
+   Two fingerprints are the same if they have the same composition and
+   their distances below the cutoff match within a tolerance. They are not
+   put in bins and compared exactly: the distances of special positions
+   often fall right on the edge of a bin (the nearest neighbors of rock
+   salt are exactly 1 apart), and rounding at two volumes would put the
+   same structure in two bins.
+
+   Two different structures can share a fingerprint, but for the crystals
+   that RandSpg makes that is very unlikely.
+*/
+
+#ifndef STRUCTURE_FINGERPRINT_H
+#define STRUCTURE_FINGERPRINT_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "crystal.h"
+
+struct structureFingerprint {
+  // The atomic numbers, from the smallest to the largest, and the number of
+  // atoms of each
+  std::vector<uint> types;
+  std::vector<uint> typeCounts;
+  // For each pair of types t1 <= t2, in the order (0, 0), (0, 1), ...,
+  // (1, 1), ..., the sorted distances between their atoms out to the cutoff
+  // plus the tolerance
+  std::vector<std::vector<float>> distances;
+
+  bool empty() const { return types.empty(); };
+};
+
+class StructureFingerprint {
+ public:
+  /* Get the fingerprint of a crystal.
+   *
+   * @param crystal The crystal.
+   *
+   * @return The fingerprint. It is empty if the crystal has no atoms or no
+   *         volume.
+   */
+  static structureFingerprint getFingerprint(const Crystal& crystal);
+
+  // Whether two fingerprints are of the same structure
+  static bool areSame(const structureFingerprint& f1,
+                      const structureFingerprint& f2);
+
+  // The cutoff of the distances, in units of the cube root of the volume
+  // per atom
+  static const double cutoff;
+
+  // How far apart two distances may be and still match, in the same units
+  static const double tolerance;
+};
+
+// The fingerprints of the structures that have been seen. They are kept in
+// buckets by their composition and their shortest distance, so that only a
+// few of them are compared with each new one. This is not thread-safe.
+class StructureFingerprintSet {
+ public:
+  // Add a fingerprint. It returns false if the set already has the same one.
+  bool insert(const structureFingerprint& fingerprint);
+
+  bool contains(const structureFingerprint& fingerprint) const;
+
+  size_t size() const {return m_fingerprints.size();};
+
+ private:
+  // The width of the buckets of the shortest distance. It is more than
+  // twice the tolerance, so a fingerprint that is the same as one in the
+  // set is in its bucket or one next to it.
+  static const double bucketWidth;
+
+  static std::string getBucketKey(const structureFingerprint& fingerprint,
+                                  long long bucket);
+  static long long getBucket(const structureFingerprint& fingerprint);
+
+  std::vector<structureFingerprint> m_fingerprints;
+  std::unordered_map<std::string, std::vector<size_t>> m_buckets;
+};
+
+#endif
@@ -0,0 +1,106 @@
+/**********************************************************************
+  structureWriter.h - Formats structures as POSCAR or CIF text in a buffer
+                      that is reused, and writes them to files.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef STRUCTURE_WRITER_H
+#define STRUCTURE_WRITER_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "crystal.h"
+
+// Crystal::getPOSCARString() used a stringstream, made the lattice vectors
+// as vectors of vectors, and counted the atoms of each type with a loop
+// over every pair of atoms. For a run of many small crystals, that was a
+// good part of the time of each one. A writer formats the text into a
+// buffer that keeps its memory from one crystal to the next, counts the
+// atoms in one pass, and writes the buffer to the file in one call, so
+// nothing is allocated once it has written a crystal or two.
+//
+// The text is the same as it was from getPOSCARString(). A writer is not
+// thread-safe, so each thread needs its own.
+class StructureWriter {
+ public:
+  /* Format a crystal as the text of a POSCAR.
+   *
+   * @param crystal The crystal.
+   * @param title The title that will go on the first line of the POSCAR.
+   *
+   * @return The text. It is good until this writer formats another crystal.
+   */
+  const std::string& formatPOSCAR(const Crystal& crystal,
+                                  const std::string& title);
+
+  /* Write a crystal to a POSCAR file.
+   *
+   * @param fileName The name of the file. It is replaced if it exists.
+   * @param crystal The crystal.
+   * @param title The title that will go on the first line of the POSCAR.
+   *
+   * @return False if the file could not be written. An error is printed.
+   */
+  bool writePOSCAR(const std::string& fileName, const Crystal& crystal,
+                   const std::string& title);
+
+  /* Format a crystal as the text of a CIF. If the crystal knows its
+   * asymmetric unit (see Crystal::getAsymmetricUnit()), only those atoms
+   * are written, along with the symmetry operations of its spacegroup.
+   * Otherwise, every atom is written with spacegroup 1.
+   *
+   * @param crystal The crystal.
+   * @param title The name of the data block. Characters that may not be in
+   *              a data block name are replaced with '_'.
+   *
+   * @return The text. It is good until this writer formats another crystal.
+   */
+  const std::string& formatCIF(const Crystal& crystal,
+                               const std::string& title);
+
+  // Write a crystal to a CIF file. See formatCIF().
+  bool writeCIF(const std::string& fileName, const Crystal& crystal,
+                const std::string& title);
+
+  /* The symmetry operations of a spacegroup as CIF writes them, such as
+   * "-x+1/2,y,-z+3/4": the most general Wyckoff position of the
+   * spacegroup plus each of its centering translations.
+   *
+   * @param spg The spacegroup.
+   *
+   * @return The operations. The first is always "x,y,z".
+   */
+  static std::vector<std::string> getSymmetryOperations(uint spg);
+
+  // Write text to a file in one call, without a stream. The file is
+  // replaced if it exists. It returns false and prints an error if the
+  // file could not be written.
+  static bool writeFile(const std::string& fileName, const std::string& text);
+
+ private:
+  // Append a number with 15 digits after the decimal point, right-aligned
+  // in 'width' characters, as 'fixed << setprecision(15) << setw(width)'
+  // does
+  void appendDouble(double d, int width = 0);
+
+  std::string m_buffer;
+  // The number of atoms of each atomic number, largest number first
+  std::vector<std::pair<uint, uint>> m_counts;
+  // The symmetry operations of the last spacegroup written to a CIF
+  uint m_symmetryOperationsSpg = 0;
+  std::vector<std::string> m_symmetryOperations;
+};
+
+#endif
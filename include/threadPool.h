@@ -0,0 +1,131 @@
+/**********************************************************************
+  threadPool.h - A small work-stealing thread pool used to run independent
+                 parts of the setup at the same time.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Every worker has its own queue. A worker runs the newest task in its own
+// queue first, and steals the oldest task from another queue when its own
+// is empty. Tasks that are submitted from a worker go to that worker's
+// queue, so a search that splits itself into pieces keeps its pieces
+// together unless another worker is idle.
+//
+// A caller (or a task) may wait on the tasks it submits with wait(). While
+// it waits, the thread runs the tasks that the caller submitted and that
+// no worker has started, so nested tasks cannot deadlock the pool. It never
+// runs the tasks of another caller: they could change the state of the
+// thread, such as the seed of its random numbers (see rng.h). When none of
+// its tasks are left to run, it sleeps until one finishes.
+class ThreadPool {
+ public:
+  // If numThreads is 0, the number of hardware threads is used
+  explicit ThreadPool(size_t numThreads = 0);
+  ~ThreadPool();
+
+  size_t numThreads() const { return m_threads.size(); };
+
+  // Run 'f' on the pool. The future holds the result or the exception.
+  template <typename F>
+  std::future<typename std::result_of<F()>::type> submit(F f)
+  {
+    typedef typename std::result_of<F()>::type resultType;
+    std::shared_ptr<std::packaged_task<resultType()>> task =
+      std::make_shared<std::packaged_task<resultType()>>(f);
+    std::future<resultType> ret = task->get_future();
+    push([task]() { (*task)(); });
+    return ret;
+  }
+
+  // Wait for a future that was returned by submit(). The tasks that were
+  // submitted by this caller are run while we wait.
+  template <typename T>
+  T wait(std::future<T>& f)
+  {
+    waitUntil([&f]() {
+      return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    });
+    return f.get();
+  }
+
+  // The pool shared by the library. It is created the first time it is
+  // used. Keep the pointer while the pool is used.
+  static std::shared_ptr<ThreadPool> global();
+
+  /* Set the number of threads of the global pool. If the global pool has
+   * already been created, it is destroyed, and a new one is made the next
+   * time global() is called.
+   *
+   * @param numThreads The number of threads. 0 means one for each hardware
+   *                   thread.
+   *
+   * @return False if the global pool is in use (someone has a pointer to
+   *         it from global()). Nothing is changed in that case.
+   */
+  static bool setGlobalNumThreads(size_t numThreads);
+
+ private:
+  struct poolTask {
+    std::function<void()> f;
+    // The task that was running (or the thread, if no task was) when this
+    // one was submitted
+    uint64_t owner;
+    // The owner of the tasks that this one submits
+    uint64_t id;
+  };
+
+  struct workQueue {
+    std::mutex mutex;
+    std::deque<poolTask> tasks;
+  };
+
+  void push(std::function<void()> f);
+  // Take a task from our own queue or steal one from another queue. If
+  // 'owner' is not 0, only a task of that owner is taken. Returns false if
+  // there were no tasks.
+  bool popTask(poolTask& task, uint64_t owner);
+  void runTask(poolTask& task);
+  // Run our own tasks, or sleep, until 'isDone' returns true
+  void waitUntil(const std::function<bool()>& isDone);
+  void workerLoop(size_t index);
+
+  std::vector<std::unique_ptr<workQueue>> m_queues;
+  std::vector<std::thread> m_threads;
+  std::mutex m_sleepMutex;
+  // Workers sleep on this until there are tasks
+  std::condition_variable m_sleepCondition;
+  // wait() sleeps on this until a task is pushed or finishes
+  std::condition_variable m_waitCondition;
+  // This changes every time a task is pushed or finishes
+  uint64_t m_epoch;
+  size_t m_numWaiting;
+  std::atomic<size_t> m_numPending;
+  std::atomic<size_t> m_nextQueue;
+  bool m_done;
+};
+
+#endif
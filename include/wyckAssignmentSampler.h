@@ -0,0 +1,134 @@
+/**********************************************************************
+  wyckAssignmentSampler.h - Draws random atom assignments from a set of
+                            system possibilities using precomputed tables.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+/* There are two levels of choices. First a system possibility is picked,
+   which says how many sets of atoms of each type go in each group of
+   similar Wyckoff positions. Then the positions within each group are
+   picked.
+
+   For uniformPossibilities, the first level is a uniform random index and
+   the second level picks one position at a time, which is what RandSpg has
+   always done.
+
+   For the other policies, every final assignment has a weight that is the
+   product of the weights of the letters it uses. The first level is an
+   alias table whose weights are the total weight of the assignments each
+   possibility can make. The second level draws from those assignments in
+   proportion to their weights using tables of partial sums that are built
+   with the sampler. Either way, the cost of a draw does not depend on the
+   number of possibilities.
+*/
+
+#ifndef WYCK_ASSIGNMENT_SAMPLER_H
+#define WYCK_ASSIGNMENT_SAMPLER_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "randSpg.h"
+#include "randSpgCombinatorics.h"
+#include "wyckSampling.h"
+
+// Walker's alias method: after the table is built, each draw takes one
+// random index and one random double.
+class AliasTable {
+ public:
+  AliasTable() {}
+
+  // The weights must not be negative. If they are all zero, the table
+  // is empty.
+  explicit AliasTable(const std::vector<double>& weights);
+
+  size_t size() const { return m_probs.size(); };
+  bool empty() const { return m_probs.empty(); };
+
+  // Draw an index in proportion to its weight. The table must not be empty.
+  size_t sample() const;
+
+ private:
+  std::vector<double> m_probs;
+  std::vector<uint32_t> m_aliases;
+};
+
+class WyckAssignmentSampler {
+ public:
+  /* Build the tables for drawing assignments.
+   *
+   * @param possibilities The system possibilities. They must outlive the
+   *                      sampler.
+   * @param forcedWyckPositions The forced positions. They are always
+   *                            included in the assignments, and they must
+   *                            be the ones that the possibilities were
+   *                            found with.
+   * @param options How the assignments are weighted.
+   */
+  WyckAssignmentSampler(
+    const systemPossibilities& possibilities,
+    const std::vector<std::pair<uint, wyckPos>>& forcedWyckPositions,
+    const wyckSamplingOptions& options = wyckSamplingOptions());
+
+  // Pick the index of a system possibility
+  size_t samplePossibility() const;
+
+  // Get a random set of atom assignments. Empty if there are no
+  // possibilities (or if every one of them has a weight of zero).
+  atomAssignments sample() const;
+
+  // A string that is the same for options that make the same sampler
+  static std::string getKey(const wyckSamplingOptions& options);
+
+ private:
+  // Fill 'counts' (indexed by type * numGroups + group) with the number of
+  // sets of atoms that possibility 'i' puts in each group after the forced
+  // positions have been placed
+  void getCounts(size_t i, std::vector<uint16_t>& counts) const;
+
+  // Draw the positions for 'count' sets of atoms in group 'g' and append
+  // their position indices to 'ret'. Only used for the weighted policies.
+  void sampleNonUniqueGroup(uint8_t g, uint count,
+                            std::vector<uint8_t>& ret) const;
+  void sampleUniqueGroup(uint8_t g, uint count,
+                         std::vector<uint8_t>& ret) const;
+
+  const systemPossibilities& m_possibilities;
+  const wyckGroupTable& m_table;
+  std::vector<std::pair<uint, wyckPos>> m_forced;
+  // The group and type of each forced position (the type is -1 if the
+  // atomic number is not in the system)
+  std::vector<int> m_forcedGroups;
+  std::vector<int> m_forcedTypes;
+
+  bool m_weighted;
+  // Empty for uniformPossibilities
+  AliasTable m_possibilityTable;
+
+  // The positions that may be picked in each group. Forced unique positions
+  // are left out.
+  std::vector<std::vector<uint8_t>> m_available;
+
+  // For the weighted policies. The letter weights of m_available[g],
+  // divided by the largest of them so the sums below stay small.
+  std::vector<std::vector<double>> m_weights;
+  // m_sums[g][j][k] is the total weight of the ways to put k sets of atoms
+  // on positions j and later of m_available[g]. For non-unique groups a
+  // position may be used any number of times, and for unique groups it may
+  // be used once.
+  std::vector<std::vector<std::vector<double>>> m_sums;
+};
+
+#endif
@@ -20,48 +20,40 @@
 #ifndef WYCKPOS_TRACKING_INFO_H
 #define WYCKPOS_TRACKING_INFO_H
 
-#include <cassert>
-
-#include "randSpg.h"
-
-// In here, we keep Wyckoff positions that have the same uniqueness and
-// multiplicity. For now, they can only be non-unique
-// The 'wyckPos' is the wyckoff position
-// The first 'bool' is whether to keep using this position or not
-// The second 'bool' is whether it is unique or not
-// The uint is the number of times it's been used
+#include "randSpgCombinatorics.h"
+
+// In here, we keep track of a group of Wyckoff positions that have the same
+// uniqueness and multiplicity.
+// 'group' is the index of the group in the spacegroup's wyckGroupTable
+// 'keepUsing' is whether to keep using this group or not
+// 'unique' is whether it is unique or not
+// 'numTimesUsed' is the number of times it's been used
+// 'minNumUses' is the number of times it must be used (from the constraints)
 class WyckPosTrackingInfo {
  public:
-  WyckPosTrackingInfo(std::vector<wyckPos> pos) :
+  WyckPosTrackingInfo(const wyckGroupTable& table, uint g) :
   keepUsing(true),
-  unique(RandSpg::containsUniquePosition(pos[0])),
+  unique(table.unique[g]),
+  group(g),
   numTimesUsed(0),
-  multiplicity(RandSpg::getMultiplicity(pos[0])),
-  positions(pos)
+  minNumUses(0),
+  multiplicity(table.multiplicities[g]),
+  numPositions(table.numPositionsInGroup(g))
 {
-  // We must have a size greater than 0
-  assert(positions.size() > 0);
 };
 
   // This is to see if we should keep checking this one during the recursive
   // function
   bool keepUsing;
   bool unique;
+  uint8_t group;
   uint numTimesUsed;
+  uint minNumUses;
   uint multiplicity;
+  // This is more than one if there are identical positions
+  uint numPositions;
 
-  wyckPos getRandomWyckPos() const
-  {
-    return positions[rand() % positions.size()];
-  };
-
-  std::vector<wyckPos> getPositions() const {return positions;};
-
-  const wyckPos& getWyckPosAt(uint i) const {return positions[i];};
-  size_t getNumPositions() const {return positions.size();};
- private:
-  // This has more than one if there are identical positions
-  std::vector<wyckPos> positions;
+  size_t getNumPositions() const {return numPositions;};
 };
 
 #endif
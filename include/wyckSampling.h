@@ -0,0 +1,62 @@
+/**********************************************************************
+  wyckSampling.h - Options for how random Wyckoff position assignments
+                   are drawn from the system possibilities.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef WYCK_SAMPLING_H
+#define WYCK_SAMPLING_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+enum wyckSamplingPolicy {
+  // Every system possibility is equally likely. The positions within each
+  // group of similar positions are then picked one set of atoms at a time.
+  // This is the default.
+  uniformPossibilities,
+  // Every final assignment of atoms to Wyckoff positions is equally likely
+  uniformAssignments,
+  // Like uniformAssignments, but every set of atoms on the most general
+  // position multiplies the weight of an assignment by
+  // 'generalWyckPosWeight'
+  favorGeneralWyckPos,
+  // Like uniformAssignments, but every set of atoms on a position
+  // multiplies the weight of an assignment by the weight of its letter
+  wyckLetterWeights
+};
+
+struct wyckSamplingOptions {
+  wyckSamplingPolicy policy;
+
+  // Used by favorGeneralWyckPos. Default is 4.0.
+  double generalWyckPosWeight;
+
+  // Used by wyckLetterWeights. Pairs of Wyckoff letters and weights.
+  // Letters that are not listed have a weight of 1.0. A weight of zero
+  // means the letter is only used if it is forced.
+  std::vector<std::pair<char, double>> letterWeights;
+
+  wyckSamplingOptions() :
+    policy(uniformPossibilities),
+    generalWyckPosWeight(4.0) {}
+};
+
+// Convert between the policies and their names in the input file.
+// getWyckSamplingPolicy() returns false if the name is unknown.
+std::string getWyckSamplingPolicyName(wyckSamplingPolicy policy);
+bool getWyckSamplingPolicy(const std::string& name,
+                           wyckSamplingPolicy& policy);
+
+#endif
@@ -1,10 +1,17 @@
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <string>
 #include <iostream>
 
+#include "combinatoricsCacheFile.h"
 #include "crystal.h"
+#include "logWriter.h"
+#include "possibilitiesCache.h"
 #include "randSpg.h"
+#include "randSpgCombinatorics.h"
+#include "randSpgContext.h"
+#include "randSpgGenerator.h"
 
 namespace py = pybind11;
 
@@ -78,6 +85,10 @@ PYBIND11_MODULE(pyrandspg, m) {
       .def("writePOSCAR", &Crystal::writePOSCAR,
            py::arg("filename") = "POSCAR",
            py::arg("title") = " ", "Write a POSCAR to a specified file.")
+      .def("writeCIF", &Crystal::writeCIF,
+           py::arg("filename") = "randSpg.cif",
+           py::arg("title") = "randSpg", "Write the asymmetric unit and "
+           "symmetry operations to a CIF file.")
       .def("printAtomInfo",
            (void (Crystal::*)(void) const) &Crystal::printAtomInfo,
            "Prints to the console the atom info in the crystal")
@@ -91,6 +102,98 @@ PYBIND11_MODULE(pyrandspg, m) {
       .def("printIADs", &Crystal::printIADs,
            "Prints to the console the interatomic distances");
 
+  // The arrays of a batch are NumPy views of its memory, so they are not
+  // copied. Each view keeps the batch alive.
+  py::class_<crystalBatch>(m, "CrystalBatch", "Many crystals stored "
+                           "together in flat arrays.")
+      .def(py::init())
+      .def("numCrystals", &crystalBatch::numCrystals)
+      .def("numAtoms", &crystalBatch::numAtoms)
+      .def("getCrystal", &crystalBatch::getCrystal,
+           "Make crystal i back into a Crystal. Raises IndexError if i is "
+           "not less than numCrystals().")
+      .def_property_readonly("lattices",
+           [](py::object self)
+           {
+             crystalBatch& b = self.cast<crystalBatch&>();
+             return py::array_t<double>(
+               std::vector<size_t>{b.numCrystals(), 3, 3}, b.lattices.data(),
+               self);
+           },
+           "The lattice vectors of each crystal, one vector in each row. "
+           "The shape is (numCrystals, 3, 3).")
+      .def_property_readonly("atomOffsets",
+           [](py::object self)
+           {
+             crystalBatch& b = self.cast<crystalBatch&>();
+             return py::array_t<uint64_t>(
+               std::vector<size_t>{b.atomOffsets.size()},
+               b.atomOffsets.data(), self);
+           },
+           "The atoms of crystal i are atomOffsets[i] to "
+           "atomOffsets[i + 1] - 1. The shape is (numCrystals + 1,).")
+      .def_property_readonly("atomicNums",
+           [](py::object self)
+           {
+             crystalBatch& b = self.cast<crystalBatch&>();
+             return py::array_t<uint32_t>(
+               std::vector<size_t>{b.numAtoms()}, b.atomicNums.data(), self);
+           },
+           "The atomic number of each atom. The shape is (numAtoms,).")
+      .def_property_readonly("fracCoords",
+           [](py::object self)
+           {
+             crystalBatch& b = self.cast<crystalBatch&>();
+             return py::array_t<double>(
+               std::vector<size_t>{b.numAtoms(), 3}, b.fracCoords.data(),
+               self);
+           },
+           "The fractional coordinates of each atom. The shape is "
+           "(numAtoms, 3).");
+
+  py::enum_<wyckSamplingPolicy>(m, "WyckSamplingPolicy",
+                                "How the Wyckoff positions are picked for "
+                                "each attempt.")
+      .value("uniformPossibilities", uniformPossibilities)
+      .value("uniformAssignments", uniformAssignments)
+      .value("favorGeneralWyckPos", favorGeneralWyckPos)
+      .value("wyckLetterWeights", wyckLetterWeights);
+
+  py::enum_<randSpgStatus>(m, "RandSpgStatus",
+                           "Why randSpgCrystal returned what it did.")
+      .value("succeeded", randSpgSucceeded)
+      .value("noPossibilities", randSpgNoPossibilities)
+      .value("maxAttemptsReached", randSpgMaxAttemptsReached)
+      .value("abortedEarly", randSpgAbortedEarly)
+      .value("timedOut", randSpgTimedOut)
+      .value("cancelled", randSpgCancelled);
+
+  py::class_<RandSpgCancelToken, std::shared_ptr<RandSpgCancelToken>>(
+      m, "RandSpgCancelToken", "Stops the randSpgCrystal calls that use it "
+      "when it is cancelled (from any thread) or when its time limit runs "
+      "out.")
+      .def(py::init<>())
+      .def("cancel", &RandSpgCancelToken::cancel)
+      .def("isCancelled", &RandSpgCancelToken::isCancelled)
+      .def("setTimeLimit", &RandSpgCancelToken::setTimeLimit,
+           "The calls stop this many seconds from now");
+
+  py::class_<wyckSamplingOptions>(m, "WyckSamplingOptions",
+                                  "Options for how the Wyckoff positions are "
+                                  "picked for each attempt.")
+      .def(py::init())
+      .def_readwrite("policy", &wyckSamplingOptions::policy,
+                     "The WyckSamplingPolicy. Default is "
+                     "uniformPossibilities.")
+      .def_readwrite("generalWyckPosWeight",
+                     &wyckSamplingOptions::generalWyckPosWeight,
+                     "The weight of the most general Wyckoff position for "
+                     "favorGeneralWyckPos. Default is 4.0.")
+      .def_readwrite("letterWeights", &wyckSamplingOptions::letterWeights,
+                     "A list of pairs of a Wyckoff letter and a weight for "
+                     "wyckLetterWeights. Letters that are not listed have a "
+                     "weight of 1.0.");
+
   // The input for RandSpg
   py::class_<randSpgInput>(m, "RandSpgInput",
                            "Input struct for RandSpg. Required parameters are "
@@ -146,6 +249,11 @@ PYBIND11_MODULE(pyrandspg, m) {
                      "(prints Wyckoff assignments), or 'n' for none (prints "
                      "nothing other than what the options were set to). "
                      "Default is 'n'")
+      .def_readwrite("maxVerbosePossibilities",
+                     &randSpgInput::maxVerbosePossibilities,
+                     "The most system possibilities that are printed with "
+                     "verbosity 'v'. A large composition may have millions "
+                     "of them. 0 prints them all. Default is 100.")
       .def_readwrite("maxAttempts", &randSpgInput::maxAttempts,
                      "Max number of attempts to satisfy the minIAD "
                      "requirements when placing atoms in the Wyckoff "
@@ -159,11 +267,166 @@ PYBIND11_MODULE(pyrandspg, m) {
                      "to true, then more compositions are possible for some "
                      "space groups, but the final space group will not be "
                      "guaranteed to be the correct space group. "
-                     "Default is true.");
+                     "Default is true.")
+      .def_readwrite("wyckSampling", &randSpgInput::wyckSampling,
+                     "A WyckSamplingOptions for how the Wyckoff positions "
+                     "are picked for each attempt.")
+      .def_readwrite("numParallelAttempts",
+                     &randSpgInput::numParallelAttempts,
+                     "The number of attempts that are run at the same time. "
+                     "The first attempt that succeeds stops the rest. "
+                     "Default is 1.")
+      .def_readwrite("earlyAbortThreshold",
+                     &randSpgInput::earlyAbortThreshold,
+                     "Stop the attempts early once the estimated chance "
+                     "that any of the remaining attempts succeeds is below "
+                     "this value. Default is 0 (never stop early).")
+      .def_readwrite("timeLimit", &randSpgInput::timeLimit,
+                     "The most wall time in seconds that one call of "
+                     "randSpgCrystal may take. Default is 0 (no limit).")
+      .def_property("cancelToken",
+                    [](const randSpgInput& input)
+                    {
+                      return std::const_pointer_cast<RandSpgCancelToken>(
+                        input.cancelToken);
+                    },
+                    [](randSpgInput& input,
+                       const std::shared_ptr<RandSpgCancelToken>& token)
+                    { input.cancelToken = token; },
+                    "A RandSpgCancelToken that stops the call. Default is "
+                    "None.");
 
   py::class_<RandSpg>(m, "RandSpg", "Static method class for performing "
                       "primary RandSpg procedures.")
-      .def("randSpgCrystal", &RandSpg::randSpgCrystal, "Generate a random "
+      .def("randSpgCrystal",
+           (Crystal (*)(const randSpgInput&)) &RandSpg::randSpgCrystal,
+           py::call_guard<py::gil_scoped_release>(),
+           "Generate a random "
            "crystal with a specific space group and all other constraints "
-           "given in the input struct");
+           "given in the input struct")
+      .def("randSpgCrystal",
+           [](const randSpgInput& input,
+              const std::shared_ptr<RandSpgContext>& context)
+           { return RandSpg::randSpgCrystal(input, context); },
+           py::call_guard<py::gil_scoped_release>(),
+           "Generate a random crystal using the radii and minIADs of a "
+           "RandSpgContext instead of the ones in the input")
+      .def("randSpgCrystalWithStatus",
+           [](const randSpgInput& input,
+              const std::shared_ptr<RandSpgContext>& context)
+           {
+             randSpgStatus status;
+             Crystal c = RandSpg::randSpgCrystal(input, context, status);
+             return std::make_pair(c, status);
+           },
+           py::call_guard<py::gil_scoped_release>(),
+           "Same as randSpgCrystal, but a tuple of the crystal and a "
+           "RandSpgStatus is returned")
+      .def("generateBatch",
+           (crystalBatch (*)(const randSpgInput&, size_t))
+             &RandSpg::generateBatch,
+           py::call_guard<py::gil_scoped_release>(),
+           "Generate up to n crystals into one CrystalBatch. It stops early "
+           "at the first crystal that could not be generated.");
+
+  py::class_<RandSpgGenerator>(m, "RandSpgGenerator", "Generates any number "
+                               "of crystals with one input. The setup is "
+                               "done once, when it is constructed.")
+      .def(py::init<const randSpgInput&>())
+      .def(py::init([](const randSpgInput& input,
+                       const std::shared_ptr<RandSpgContext>& context)
+                    { return new RandSpgGenerator(input, context); }),
+           "The radii and minIADs come from the RandSpgContext")
+      .def("generate",
+           (Crystal (RandSpgGenerator::*)() const) &RandSpgGenerator::generate,
+           py::call_guard<py::gil_scoped_release>(),
+           "Generate one crystal. A crystal with zero volume is returned if "
+           "it failed.")
+      .def("generateWithStatus",
+           [](const RandSpgGenerator& generator)
+           {
+             randSpgStatus status;
+             Crystal c = generator.generate(status);
+             return std::make_pair(c, status);
+           },
+           py::call_guard<py::gil_scoped_release>(),
+           "Same as generate, but a tuple of the crystal and a "
+           "RandSpgStatus is returned")
+      .def("generateBatch",
+           [](const RandSpgGenerator& generator, size_t n)
+           {
+             randSpgStatus status;
+             crystalBatch batch = generator.generateBatch(n, status);
+             return std::make_pair(std::move(batch), status);
+           },
+           py::call_guard<py::gil_scoped_release>(),
+           "Generate up to n crystals into one CrystalBatch. A tuple of the "
+           "batch and the RandSpgStatus of the last crystal is returned.")
+      .def("isPossible", &RandSpgGenerator::isPossible,
+           "False if the spacegroup cannot hold the atoms with this input");
+
+  py::class_<RandSpgContext, std::shared_ptr<RandSpgContext>>(
+      m, "RandSpgContext", "The radii, minimum interatomic distances, and "
+      "log destination used by one call to randSpgCrystal. It may be shared "
+      "by calls with the same radius and minIAD settings.")
+      .def(py::init<>())
+      .def(py::init<const randSpgInput&>())
+      .def("getRadius", &RandSpgContext::getRadius)
+      .def("getMinIAD", &RandSpgContext::getMinIAD);
+
+  py::class_<PossibilitiesCache>(m, "PossibilitiesCache", "Static method "
+                                 "class for the cache of Wyckoff position "
+                                 "possibilities that is shared by every "
+                                 "RandSpg call in this process.")
+      .def_static("clear", &PossibilitiesCache::clear,
+                  "Remove everything from the cache")
+      .def_static("size", &PossibilitiesCache::size,
+                  "Get the number of entries in the cache")
+      .def_static("setMaxSize", &PossibilitiesCache::setMaxSize,
+                  "Set the max number of entries to keep. Zero disables "
+                  "caching. Default is 1024.")
+      .def_static("maxSize", &PossibilitiesCache::maxSize,
+                  "Get the max number of entries to keep");
+
+  py::class_<CombinatoricsCacheFile>(m, "CombinatoricsCacheFile", "Static "
+                                     "method class for the optional file "
+                                     "that keeps Wyckoff position "
+                                     "combinations between runs.")
+      .def_static("setFileName", &CombinatoricsCacheFile::setFileName,
+                  "Set the cache file. It is created if it does not exist. "
+                  "An empty string (the default) turns it off.")
+      .def_static("fileName", &CombinatoricsCacheFile::fileName,
+                  "Get the cache file name. Empty if it is off.");
+
+  py::class_<LogWriter>(m, "LogWriter", "Static method class for the "
+                        "writers of the log files.")
+      .def_static("flushAll", &LogWriter::flushAll,
+                  py::call_guard<py::gil_scoped_release>(),
+                  "Write everything that was logged so far")
+      .def_static("close", &LogWriter::close,
+                  py::call_guard<py::gil_scoped_release>(),
+                  "Write everything that was logged to a file and close it. "
+                  "It is opened again if more is logged to it.");
+
+  py::class_<RandSpgCombinatorics>(m, "RandSpgCombinatorics", "Static "
+                                   "method class for the Wyckoff position "
+                                   "combinatorics.")
+      .def_static("countSystemPossibilities",
+                  [](uint spg, const std::vector<uint>& atoms,
+                     bool forceMostGeneralWyckPos,
+                     const std::vector<std::pair<uint, char>>& forced) {
+                    wyckConstraints constraints;
+                    constraints.forceMostGeneralWyckPos =
+                      forceMostGeneralWyckPos;
+                    constraints.forcedWyckAssignments = forced;
+                    return RandSpgCombinatorics::countSystemPossibilities(
+                      spg, atoms, constraints);
+                  },
+                  py::arg("spg"), py::arg("atoms"),
+                  py::arg("forceMostGeneralWyckPos") = false,
+                  py::arg("forcedWyckAssignments") =
+                    std::vector<std::pair<uint, char>>(),
+                  "Count the ways that the atoms may be placed on the "
+                  "Wyckoff positions of the space group without finding "
+                  "them. The count stops at 2^64 - 1.");
 }
@@ -0,0 +1,565 @@
+/**********************************************************************
+  combinatoricsCacheFile.cpp - Optional file that stores system
+                               possibilities between runs so that they do
+                               not need to be found again.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "combinatoricsCacheFile.h"
+#include "randSpg.h"
+
+using namespace std;
+
+static const char cacheFileMagic[8] = {'R', 'S', 'P', 'G', 'C', 'O', 'M', 'B'};
+// Increment this if the record layout or the combinatorics change
+static const uint32_t cacheFileVersion = 1;
+// magic, version, file id, database hash
+static const size_t cacheFileHeaderSize = 8 + 4 + 4 + 8;
+static const size_t cacheFileIdOffset = 8 + 4;
+
+// All of the file state. It is guarded by cacheFileMutex.
+static mutex cacheFileMutex;
+static string cacheFileName;
+static bool cacheFileOpen = false;
+// The start of each record's data, by key
+static map<string, size_t> cacheFileIndex;
+// Records before this offset have been added to the index
+static size_t cacheFileScanned = 0;
+// The id in the header when the index was built. A new id is picked every
+// time the file is started over, so a process can tell that its index is
+// no longer good.
+static uint32_t cacheFileId = 0;
+
+#ifdef _WIN32
+static vector<char> cacheFileData;
+#else
+static int cacheFileDescriptor = -1;
+static const char* cacheFileData = nullptr;
+static size_t cacheFileMappedSize = 0;
+#endif
+
+// Little helpers for reading and writing the raw bytes of numbers
+template <typename T>
+static inline void appendBytes(string& s, const T& value)
+{
+  s.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static inline bool readBytes(const char* data, size_t size, size_t& pos,
+                             T& value)
+{
+  if (pos + sizeof(T) > size) return false;
+  memcpy(&value, data + pos, sizeof(T));
+  pos += sizeof(T);
+  return true;
+}
+
+static string getHeader(uint32_t fileId)
+{
+  string s(cacheFileMagic, sizeof(cacheFileMagic));
+  appendBytes(s, cacheFileVersion);
+  appendBytes(s, fileId);
+  appendBytes(s, CombinatoricsCacheFile::getDatabaseHash());
+  return s;
+}
+
+static uint32_t getNewFileId()
+{
+  return random_device{}();
+}
+
+uint64_t CombinatoricsCacheFile::getDatabaseHash()
+{
+  static uint64_t hash = 0;
+  static once_flag flag;
+  call_once(flag, []() {
+    // 64-bit FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    auto add = [&h](const void* data, size_t size) {
+      const unsigned char* bytes = static_cast<const unsigned char*>(data);
+      for (size_t i = 0; i < size; i++) {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+      }
+    };
+    for (uint spg = 1; spg <= 230; spg++) {
+      const wyckoffPositions& wyckVec = RandSpg::getWyckoffPositions(spg);
+      for (size_t i = 0; i < wyckVec.size(); i++) {
+        char wyckLet = RandSpg::getWyckLet(wyckVec[i]);
+        uint32_t mult = RandSpg::getMultiplicity(wyckVec[i]);
+        const string& coords = RandSpg::getWyckCoords(wyckVec[i]);
+        char unique = RandSpg::containsUniquePosition(wyckVec[i]) ? 1 : 0;
+        add(&wyckLet, 1);
+        add(&mult, sizeof(mult));
+        add(coords.data(), coords.size());
+        add(&unique, 1);
+      }
+    }
+    hash = h;
+  });
+  return hash;
+}
+
+#ifdef _WIN32
+
+static size_t getFileSize()
+{
+  return cacheFileData.size();
+}
+
+// Read everything into memory
+static bool mapFile()
+{
+  ifstream f(cacheFileName, ios::binary);
+  if (!f.is_open()) return false;
+  cacheFileData.assign(istreambuf_iterator<char>(f),
+                       istreambuf_iterator<char>());
+  return true;
+}
+
+static bool appendToFile(const string& bytes)
+{
+  ofstream f(cacheFileName, ios::binary | ios::app);
+  if (!f.is_open()) return false;
+  f.write(bytes.data(), bytes.size());
+  return f.good();
+}
+
+// Files are not locked on Windows
+static void lockFile(bool /*exclusive*/)
+{
+}
+
+static void unlockFile()
+{
+}
+
+static bool startFileOver()
+{
+  ofstream f(cacheFileName, ios::binary | ios::trunc);
+  if (!f.is_open()) return false;
+  string header = getHeader(getNewFileId());
+  f.write(header.data(), header.size());
+  f.close();
+  return mapFile();
+}
+
+static bool openFile()
+{
+  // Create it if it doesn't exist
+  { ofstream f(cacheFileName, ios::binary | ios::app); }
+  return mapFile();
+}
+
+static void closeFile()
+{
+  cacheFileData.clear();
+}
+
+static const char* fileData()
+{
+  return cacheFileData.data();
+}
+
+#else
+
+static size_t getFileSize()
+{
+  return cacheFileMappedSize;
+}
+
+// Map the whole file. It is re-mapped if another process has made it
+// bigger.
+static bool mapFile()
+{
+  struct stat st;
+  if (fstat(cacheFileDescriptor, &st) != 0) return false;
+  size_t size = st.st_size;
+  if (cacheFileData && size == cacheFileMappedSize) return true;
+
+  if (cacheFileData) {
+    munmap(const_cast<char*>(cacheFileData), cacheFileMappedSize);
+    cacheFileData = nullptr;
+    cacheFileMappedSize = 0;
+  }
+  if (size == 0) return true;
+
+  void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, cacheFileDescriptor,
+                 0);
+  if (p == MAP_FAILED) return false;
+  cacheFileData = static_cast<const char*>(p);
+  cacheFileMappedSize = size;
+  return true;
+}
+
+// Every process holds a shared lock on the file while it reads the mapping,
+// and an exclusive lock while it appends to the file or starts it over. So
+// the file never shrinks under a mapping that is being read, which would
+// raise SIGBUS.
+static void lockFile(bool exclusive)
+{
+  flock(cacheFileDescriptor, exclusive ? LOCK_EX : LOCK_SH);
+}
+
+static void unlockFile()
+{
+  flock(cacheFileDescriptor, LOCK_UN);
+}
+
+// The record is written with one call to write(). The exclusive lock must
+// be held so that records from different processes are not mixed.
+static bool appendToFile(const string& bytes)
+{
+  ssize_t written = write(cacheFileDescriptor, bytes.data(), bytes.size());
+  return written == static_cast<ssize_t>(bytes.size());
+}
+
+// The exclusive lock must be held
+static bool startFileOver()
+{
+  bool success = (ftruncate(cacheFileDescriptor, 0) == 0);
+  if (success) {
+    string header = getHeader(getNewFileId());
+    success = (write(cacheFileDescriptor, header.data(), header.size()) ==
+               static_cast<ssize_t>(header.size()));
+  }
+  return success && mapFile();
+}
+
+static bool openFile()
+{
+  cacheFileDescriptor = open(cacheFileName.c_str(),
+                             O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (cacheFileDescriptor < 0) return false;
+  return mapFile();
+}
+
+static void closeFile()
+{
+  if (cacheFileData)
+    munmap(const_cast<char*>(cacheFileData), cacheFileMappedSize);
+  cacheFileData = nullptr;
+  cacheFileMappedSize = 0;
+  if (cacheFileDescriptor >= 0) close(cacheFileDescriptor);
+  cacheFileDescriptor = -1;
+}
+
+static const char* fileData()
+{
+  return cacheFileData;
+}
+
+#endif
+
+// Add any records that we haven't seen yet to the index. A record is:
+// <uint32 size of the rest of the record> <uint32 key size> <key> <data>
+// A record that was only partly written is skipped until it is complete.
+static void scanNewRecords()
+{
+  const char* data = fileData();
+  size_t size = getFileSize();
+  size_t pos = cacheFileScanned;
+  while (true) {
+    size_t recordStart = pos;
+    uint32_t recordSize, keySize;
+    if (!readBytes(data, size, pos, recordSize)) break;
+    if (pos + recordSize > size || recordSize < sizeof(uint32_t)) break;
+    size_t recordEnd = pos + recordSize;
+    if (!readBytes(data, size, pos, keySize) || pos + keySize > recordEnd) {
+      // This should not happen. Ignore the rest of the file.
+      cerr << "Warning: the combinatorics cache file '" << cacheFileName
+           << "' has a bad record at offset " << recordStart << "\n";
+      cacheFileScanned = size;
+      return;
+    }
+    string key(data + pos, keySize);
+    cacheFileIndex[key] = pos + keySize;
+    pos = recordEnd;
+    cacheFileScanned = pos;
+  }
+}
+
+// Whether the file has a header of this version and database. The file id
+// is not compared.
+static bool hasValidHeader()
+{
+  string header = getHeader(0);
+  return getFileSize() >= cacheFileHeaderSize &&
+         memcmp(fileData(), header.data(), cacheFileIdOffset) == 0 &&
+         memcmp(fileData() + cacheFileIdOffset + sizeof(uint32_t),
+                header.data() + cacheFileIdOffset + sizeof(uint32_t),
+                cacheFileHeaderSize - cacheFileIdOffset -
+                sizeof(uint32_t)) == 0;
+}
+
+static uint32_t getFileId()
+{
+  uint32_t id = 0;
+  size_t pos = cacheFileIdOffset;
+  readBytes(fileData(), getFileSize(), pos, id);
+  return id;
+}
+
+// Build the index from the start of the file
+static void rebuildIndex()
+{
+  cacheFileId = getFileId();
+  cacheFileIndex.clear();
+  cacheFileScanned = cacheFileHeaderSize;
+  scanNewRecords();
+}
+
+// Map the file as it is now and bring the index up to date. If another
+// process started the file over, the index is built again. A lock on the
+// file must be held. Returns false if the file has another version or
+// database now, and is not usable.
+static bool refreshFile()
+{
+  if (!mapFile() || !hasValidHeader()) return false;
+  if (getFileId() != cacheFileId) rebuildIndex();
+  else scanNewRecords();
+  return true;
+}
+
+// Refresh the file, and start it over if it is new, or from a different
+// version or database. The exclusive lock must be held, so that no other
+// process can start the file over between the check and the truncation.
+static bool refreshOrStartFileOver()
+{
+  if (refreshFile()) return true;
+  if (!startFileOver()) return false;
+  rebuildIndex();
+  return true;
+}
+
+// Open the file if it is not open already. cacheFileMutex must be locked.
+static bool ensureFileIsOpen()
+{
+  if (cacheFileName.empty()) return false;
+  if (cacheFileOpen) return true;
+
+  if (!openFile()) {
+    cerr << "Warning: the combinatorics cache file '" << cacheFileName
+         << "' could not be opened. It will not be used.\n";
+    closeFile();
+    cacheFileName.clear();
+    return false;
+  }
+
+  lockFile(true);
+  bool success = refreshOrStartFileOver();
+  unlockFile();
+  if (!success) {
+    cerr << "Warning: the combinatorics cache file '" << cacheFileName
+         << "' could not be written. It will not be used.\n";
+    closeFile();
+    cacheFileName.clear();
+    return false;
+  }
+
+  cacheFileOpen = true;
+  return true;
+}
+
+// Read the possibilities of spacegroup 'expectedSpg' that start at 'pos'.
+// A record that does not hold valid possibilities of that spacegroup is
+// not read, so that they are found again.
+static bool readPossibilities(size_t pos, uint expectedSpg,
+                              systemPossibilities& poss)
+{
+  const char* data = fileData();
+  size_t size = getFileSize();
+  uint32_t spg, numTypes, numAssigns, numOffsets, numPossibilities;
+  if (!readBytes(data, size, pos, spg) ||
+      !readBytes(data, size, pos, numTypes) ||
+      !readBytes(data, size, pos, numAssigns) ||
+      !readBytes(data, size, pos, numOffsets) ||
+      !readBytes(data, size, pos, numPossibilities))
+    return false;
+
+  // There is an offset at the start and after every type of every
+  // possibility
+  if (spg != expectedSpg || spg < 1 || spg > 230 ||
+      static_cast<uint64_t>(numOffsets) !=
+        static_cast<uint64_t>(numPossibilities) * numTypes + 1)
+    return false;
+
+  size_t dataSize = numTypes * sizeof(uint32_t) +
+                    numAssigns * (sizeof(uint16_t) + sizeof(uint8_t)) +
+                    numOffsets * sizeof(uint32_t) +
+                    numPossibilities * sizeof(uint64_t);
+  if (pos + dataSize > size) return false;
+
+  poss = systemPossibilities(spg);
+  poss.atomicNums.resize(numTypes);
+  for (size_t i = 0; i < numTypes; i++) {
+    uint32_t atomicNum = 0;
+    if (!readBytes(data, size, pos, atomicNum)) return false;
+    poss.atomicNums[i] = atomicNum;
+  }
+  poss.assigns.resize(numAssigns);
+  for (size_t i = 0; i < numAssigns; i++) {
+    if (!readBytes(data, size, pos, poss.assigns[i].numToChoose) ||
+        !readBytes(data, size, pos, poss.assigns[i].group))
+      return false;
+  }
+  poss.offsets.resize(numOffsets);
+  for (size_t i = 0; i < numOffsets; i++) {
+    if (!readBytes(data, size, pos, poss.offsets[i])) return false;
+  }
+  poss.uniqueUsages.resize(numPossibilities);
+  for (size_t i = 0; i < numPossibilities; i++) {
+    if (!readBytes(data, size, pos, poss.uniqueUsages[i])) return false;
+  }
+
+  // The offsets must cover the assignments in order, and every group must
+  // be one of the spacegroup's
+  if (poss.offsets.front() != 0 || poss.offsets.back() != numAssigns)
+    return false;
+  for (size_t i = 1; i < numOffsets; i++) {
+    if (poss.offsets[i] < poss.offsets[i - 1]) return false;
+  }
+  size_t numGroups =
+    RandSpgCombinatorics::getWyckGroupTable(spg).numGroups();
+  for (size_t i = 0; i < numAssigns; i++) {
+    if (poss.assigns[i].group >= numGroups) return false;
+  }
+  return true;
+}
+
+// The spacegroup of a key from getKey(), which starts with "spg=<spg>;"
+static uint getKeySpg(const string& key)
+{
+  if (key.compare(0, 4, "spg=") != 0) return 0;
+  return strtoul(key.c_str() + 4, nullptr, 10);
+}
+
+void CombinatoricsCacheFile::setFileName(const string& fileName)
+{
+  lock_guard<mutex> lock(cacheFileMutex);
+  if (fileName == cacheFileName) return;
+  closeFile();
+  cacheFileOpen = false;
+  cacheFileIndex.clear();
+  cacheFileScanned = 0;
+  cacheFileId = 0;
+  cacheFileName = fileName;
+}
+
+string CombinatoricsCacheFile::fileName()
+{
+  lock_guard<mutex> lock(cacheFileMutex);
+  return cacheFileName;
+}
+
+string CombinatoricsCacheFile::getKey(uint spg, const vector<uint>& atoms,
+                                      const wyckConstraints& constraints,
+                                      bool findOnlyOne, bool onlyNonUnique)
+{
+  vector<numAndType> numOfEachType = RandSpg::getNumOfEachType(atoms);
+  stringstream s;
+  s << "spg=" << spg << ";types=";
+  for (size_t i = 0; i < numOfEachType.size(); i++)
+    s << numOfEachType[i].second << "x" << numOfEachType[i].first << ",";
+  // The forced assignments are sorted so their order doesn't matter
+  vector<pair<uint, char>> forced = constraints.forcedWyckAssignments;
+  sort(forced.begin(), forced.end());
+  s << ";general=" << (constraints.forceMostGeneralWyckPos ? 1 : 0)
+    << ";forced=";
+  for (size_t i = 0; i < forced.size(); i++)
+    s << forced[i].first << forced[i].second << ",";
+  s << ";findOnlyOne=" << (findOnlyOne ? 1 : 0)
+    << ";onlyNonUnique=" << (onlyNonUnique ? 1 : 0);
+  return s.str();
+}
+
+bool CombinatoricsCacheFile::load(const string& key,
+                                  systemPossibilities& possibilities)
+{
+  lock_guard<mutex> lock(cacheFileMutex);
+  if (!ensureFileIsOpen()) return false;
+
+  // The mapping is checked against the size of the file while no process
+  // can start it over. Another process may also have added the key.
+  lockFile(false);
+  bool found = false;
+  if (refreshFile()) {
+    map<string, size_t>::const_iterator it = cacheFileIndex.find(key);
+    found = (it != cacheFileIndex.end() &&
+             readPossibilities(it->second, getKeySpg(key), possibilities));
+  }
+  unlockFile();
+  return found;
+}
+
+void CombinatoricsCacheFile::store(const string& key,
+                                   const systemPossibilities& possibilities)
+{
+  lock_guard<mutex> lock(cacheFileMutex);
+  if (!ensureFileIsOpen()) return;
+
+  string data;
+  appendBytes(data, static_cast<uint32_t>(key.size()));
+  data += key;
+  appendBytes(data, static_cast<uint32_t>(possibilities.spg));
+  appendBytes(data, static_cast<uint32_t>(possibilities.atomicNums.size()));
+  appendBytes(data, static_cast<uint32_t>(possibilities.assigns.size()));
+  appendBytes(data, static_cast<uint32_t>(possibilities.offsets.size()));
+  appendBytes(data, static_cast<uint32_t>(possibilities.uniqueUsages.size()));
+  for (size_t i = 0; i < possibilities.atomicNums.size(); i++)
+    appendBytes(data, static_cast<uint32_t>(possibilities.atomicNums[i]));
+  for (size_t i = 0; i < possibilities.assigns.size(); i++) {
+    appendBytes(data, possibilities.assigns[i].numToChoose);
+    appendBytes(data, possibilities.assigns[i].group);
+  }
+  for (size_t i = 0; i < possibilities.offsets.size(); i++)
+    appendBytes(data, possibilities.offsets[i]);
+  for (size_t i = 0; i < possibilities.uniqueUsages.size(); i++)
+    appendBytes(data, possibilities.uniqueUsages[i]);
+
+  string record;
+  appendBytes(record, static_cast<uint32_t>(data.size()));
+  record += data;
+
+  // The file may have been started over by another process (with another
+  // version, even), or the key may have been added by one
+  lockFile(true);
+  bool success = refreshOrStartFileOver();
+  if (success && cacheFileIndex.find(key) == cacheFileIndex.end())
+    success = appendToFile(record);
+  unlockFile();
+  if (!success) {
+    cerr << "Warning: failed to write to the combinatorics cache file '"
+         << cacheFileName << "'\n";
+  }
+}
@@ -19,11 +19,13 @@
 #include <iomanip>
 // for sqrt(), sin(), cos(), etc.
 #include <cmath>
-// for writing to POSCAR
-#include <fstream>
+// For stringstream
+#include <sstream>
 
 #include "crystal.h"
 #include "randSpg.h"
+#include "randSpgContext.h"
+#include "structureWriter.h"
 #include "utilityFunctions.h"
 
 // For atomic radii and symbols
@@ -39,6 +41,7 @@ using namespace std;
 Crystal::Crystal(latticeStruct l, vector<atomStruct> a, bool usingVdwRad) :
   m_lattice(l),
   m_atoms(a),
+  m_spg(0),
   m_unitVolume(-1.0), // These will be cached when the getter is called
   m_volume(-1.0), // These will be cached when the getter is called
   m_usingVdwRadii(usingVdwRad),
@@ -53,7 +56,10 @@ void Crystal::removeAtomAt(size_t i)
   if (i >= m_atoms.size())
     std::cout << "Error: tried to remove an atom at index " << i << " and the "
               << "size is only " << m_atoms.size() << "!\n";
-  else m_atoms.erase(m_atoms.begin() + i);
+  else {
+    m_atoms.erase(m_atoms.begin() + i);
+    clearAsymmetricUnit();
+  }
 }
 
 void Crystal::removeAtom(const atomStruct& as)
@@ -110,6 +116,10 @@ static inline void wrapAtomToCell(atomStruct& as)
 void Crystal::wrapAtomsToCell()
 {
   for (size_t i = 0; i < m_atoms.size(); i++) wrapAtomToCell(m_atoms[i]);
+  // The atoms of the asymmetric unit are wrapped the same way, so that they
+  // are still atoms of the crystal
+  for (size_t i = 0; i < m_asymmetricUnit.size(); i++)
+    wrapAtomToCell(m_asymmetricUnit[i]);
 }
 
 void Crystal::removeAtomsWithSameCoordinates()
@@ -191,6 +201,18 @@ double Crystal::getUnitVolume() const
 }
 
 vector<vector<double>> Crystal::getLatticeVecs() const
+{
+  double vecs[3][3];
+  getLatticeVecs(vecs);
+
+  vector<vector<double>> ret;
+  for (size_t i = 0; i < 3; i++)
+    ret.push_back(vector<double>(vecs[i], vecs[i] + 3));
+
+  return ret;
+}
+
+void Crystal::getLatticeVecs(double vecs[3][3]) const
 {
   // To do this, we are going to use a little "hack" using code
   // I've already written
@@ -207,9 +229,6 @@ vector<vector<double>> Crystal::getLatticeVecs() const
   atomB = getAtomInCartCoords(atomB);
   atomC = getAtomInCartCoords(atomC);
 
-  vector<vector<double>> ret;
-
-  double vecs[3][3];
   vecs[0][0] = atomA.x; vecs[0][1] = atomA.y; vecs[0][2] = atomA.z;
   vecs[1][0] = atomB.x; vecs[1][1] = atomB.y; vecs[1][2] = atomB.z;
   vecs[2][0] = atomC.x; vecs[2][1] = atomC.y; vecs[2][2] = atomC.z;
@@ -221,11 +240,6 @@ vector<vector<double>> Crystal::getLatticeVecs() const
       if (fabs(vecs[i][j]) < 1e-7) vecs[i][j] = 0;
     }
   }
-
-  for (size_t i = 0; i < 3; i++)
-    ret.push_back(vector<double>(vecs[i], vecs[i] + 3));
-
-  return ret;
 }
 
 double Crystal::getVolume() const
@@ -354,6 +368,9 @@ void Crystal::centerCellAroundAtom(const atomStruct& as)
 
 void Crystal::centerCellAroundAtom(size_t ind)
 {
+  // The origin moves, so the asymmetric unit no longer fits the atoms
+  clearAsymmetricUnit();
+
   atomStruct& as = m_atoms[ind];
 
 #ifdef CENTER_CELL_DEBUG
@@ -457,9 +474,13 @@ bool Crystal::fillUnitCell(uint spg)
   return true;
 }
 
-// Radii should have already been scaled and set before calling this
+// Without a context, radii should have already been scaled and set before
+// calling this
 double Crystal::getMinIAD(const atomStruct& as1, const atomStruct& as2) const
 {
+  if (m_context)
+    return m_context->getMinIAD(as1.atomicNum, as2.atomicNum, m_usingVdwRadii);
+
   // Check to see if we have a custom IAD and return it if we do
   if (ElemInfo::customMinIAD(as1.atomicNum, as2.atomicNum) != -1.0)
     return ElemInfo::customMinIAD(as1.atomicNum, as2.atomicNum);
@@ -509,79 +530,62 @@ bool Crystal::areIADsOkay(const atomStruct& as) const
   return true;
 }
 
-/* POSCAR format goes as such:
+// The text is formatted by a StructureWriter. Each thread has its own, so
+// its buffer is reused from one crystal to the next.
+static thread_local StructureWriter t_writer;
+
+string Crystal::getPOSCARString(const string& title) const
+{
+  return t_writer.formatPOSCAR(*this, title);
+}
+
+void Crystal::writePOSCAR(const string& filename, const string& title) const
+{
+  t_writer.writePOSCAR(filename, *this, title);
+}
+
+void Crystal::writeCIF(const string& filename, const string& title) const
+{
+  t_writer.writeCIF(filename, *this, title);
+}
+
+/* Extended XYZ format goes as such:
  *
- * Title
- * Scaling factor
- * Lattice vector for a
- * Lattice vector for b
- * Lattice vector for c
- * Element Symbols
- * Number of each element
- * Cartesian or Direct
- * Atom coordinates
+ * Number of atoms
+ * Lattice="ax ay az bx by bz cx cy cz" Properties=species:S:1:pos:R:3 ...
+ * Symbol x y z (Cartesian coordinates, one line for each atom)
  */
-string Crystal::getPOSCARString(const string& title) const
+string Crystal::getExtendedXYZString(const string& title) const
 {
   stringstream ss;
-
-  // Set up the needed info
   ss << fixed << setprecision(15);
-  vector<vector<double>> latticeVecs = getLatticeVecs();
-  vector<numAndType> atomCounts =
-                            RandSpg::getNumOfEachType(getVectorOfAtomicNums());
-  vector<string> symbols;
-  for (size_t i = 0; i < atomCounts.size(); i++) {
-    symbols.push_back(ElemInfo::getAtomicSymbol(atomCounts[i].second));
-  }
 
-  // Write to the POSCAR!
-  ss << title << "\n"; // Title
-  ss << "1.00000\n"; // Scaling factor
+  double vecs[3][3];
+  getLatticeVecs(vecs);
+
+  string comment = title;
+  replace(comment, '"', '\'');
 
-  for (size_t i = 0; i < 3; i++) {  // Lattice vectors
+  ss << m_atoms.size() << "\n";
+  ss << "Lattice=\"";
+  for (size_t i = 0; i < 3; i++) {
     for (size_t j = 0; j < 3; j++) {
-      ss << " " << setw(20) << latticeVecs[i][j];
+      if (i != 0 || j != 0) ss << " ";
+      ss << vecs[i][j];
     }
-    ss << "\n";
-  }
-
-  for (size_t i = 0; i < symbols.size(); i++) { // Symbols
-    ss << "  " << setw(3) << symbols[i];
-  }
-  ss << "\n";
-
-  for (size_t i = 0; i < atomCounts.size(); i++) { // Atom counts
-    ss << "  " << setw(3) << atomCounts[i].first;
   }
-  ss << "\n";
-
-  ss << "Direct\n"; // We're just going to use fractional coordinates
+  ss << "\" Properties=species:S:1:pos:R:3 pbc=\"T T T\" title=\""
+     << comment << "\"\n";
 
-  for (size_t i = 0; i < m_atoms.size(); i++) { // Atom coords
-    ss << "  " << m_atoms[i].x << "  " << m_atoms[i].y << "  "
-      << m_atoms[i].z << "\n";
+  for (size_t i = 0; i < m_atoms.size(); i++) {
+    atomStruct cart = getAtomInCartCoords(m_atoms[i]);
+    ss << ElemInfo::getAtomicSymbol(cart.atomicNum) << "  " << cart.x << "  "
+       << cart.y << "  " << cart.z << "\n";
   }
 
-  // We're done!
   return ss.str();
 }
 
-void Crystal::writePOSCAR(const string& filename, const string& title) const
-{
-  ofstream f;
-  f.open(filename);
-  if (!f.is_open()) {
-    cout << "Error in " << __FUNCTION__ << ": failed to open '"
-         << filename << "' for writing!\n";
-    return;
-  }
-
-  f << getPOSCARString(title);
-
-  f.close();
-}
-
 string Crystal::getAtomInfoString(const atomStruct& as)
 {
   stringstream s;
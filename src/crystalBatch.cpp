@@ -0,0 +1,78 @@
+/**********************************************************************
+  crystalBatch.cpp - Many crystals stored together in flat arrays.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "crystalBatch.h"
+#include "utilityFunctions.h"
+
+using namespace std;
+
+void crystalBatch::reserve(size_t numCrystals, size_t numAtoms)
+{
+  lattices.reserve(lattices.size() + 9 * numCrystals);
+  atomOffsets.reserve(atomOffsets.size() + numCrystals);
+  atomicNums.reserve(atomicNums.size() + numAtoms);
+  fracCoords.reserve(fracCoords.size() + 3 * numAtoms);
+}
+
+void crystalBatch::append(const Crystal& crystal)
+{
+  double vecs[3][3];
+  crystal.getLatticeVecs(vecs);
+  lattices.insert(lattices.end(), &vecs[0][0], &vecs[0][0] + 9);
+
+  const vector<atomStruct>& atoms = crystal.getAtoms();
+  for (size_t i = 0; i < atoms.size(); i++) {
+    atomicNums.push_back(atoms[i].atomicNum);
+    fracCoords.push_back(atoms[i].x);
+    fracCoords.push_back(atoms[i].y);
+    fracCoords.push_back(atoms[i].z);
+  }
+  atomOffsets.push_back(atomicNums.size());
+}
+
+static double getAngle(const double* u, const double* v)
+{
+  double dot = u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+  double uLen = sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+  double vLen = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  return rad2deg(acos(dot / (uLen * vLen)));
+}
+
+Crystal crystalBatch::getCrystal(size_t i) const
+{
+  if (i >= numCrystals()) {
+    throw out_of_range("crystal " + to_string(i) + " of a batch of " +
+                       to_string(numCrystals()) + " does not exist");
+  }
+
+  const double* a = &lattices[9 * i];
+  const double* b = a + 3;
+  const double* c = a + 6;
+  latticeStruct lattice(sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]),
+                        sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]),
+                        sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]),
+                        getAngle(b, c), getAngle(a, c), getAngle(a, b));
+
+  vector<atomStruct> atoms;
+  for (size_t j = atomOffsets[i]; j < atomOffsets[i + 1]; j++) {
+    atoms.push_back(atomStruct(atomicNums[j], fracCoords[3 * j],
+                               fracCoords[3 * j + 1], fracCoords[3 * j + 2]));
+  }
+  return Crystal(lattice, atoms);
+}
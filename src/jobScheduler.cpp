@@ -0,0 +1,266 @@
+/**********************************************************************
+  jobScheduler.cpp - Runs the (spg, index) generation jobs of the CLI on
+                     several threads with the most expensive jobs first.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <thread>
+
+#include "jobScheduler.h"
+#include "spgFeasibility.h"
+
+using namespace std;
+
+double JobScheduler::getCalibratedCost(uint spg, const vector<uint>& atoms,
+                                       const wyckConstraints& constraints)
+{
+  if (!SpgFeasibility::isSpgPossible(spg, atoms)) return 0.0;
+  uint64_t count = RandSpgCombinatorics::countSystemPossibilities(spg, atoms,
+                                                                  constraints);
+  if (count == 0) return 0.0;
+  return 1.0 + log(static_cast<double>(count));
+}
+
+vector<double> JobScheduler::estimateCosts(const vector<uint>& spacegroups,
+                                           const vector<uint>& atoms,
+                                           const map<uint, double>& history,
+                                           const wyckConstraints& constraints)
+{
+  vector<double> calibrated(spacegroups.size());
+  for (size_t i = 0; i < spacegroups.size(); i++) {
+    if (history.find(spacegroups[i]) == history.end())
+      calibrated[i] = getCalibratedCost(spacegroups[i], atoms, constraints);
+  }
+
+  // The calibration is put in seconds with the spacegroups that have a
+  // history: their calibrated costs average to their average time
+  double scale = 1.0;
+  if (!history.empty()) {
+    double historySum = 0, calibratedSum = 0;
+    for (const auto& entry: history) {
+      historySum += entry.second;
+      calibratedSum += getCalibratedCost(entry.first, atoms, constraints);
+    }
+    if (calibratedSum > 0) scale = historySum / calibratedSum;
+  }
+
+  vector<double> ret;
+  for (size_t i = 0; i < spacegroups.size(); i++) {
+    auto it = history.find(spacegroups[i]);
+    if (it != history.end()) ret.push_back(it->second);
+    else ret.push_back(calibrated[i] * scale);
+  }
+  return ret;
+}
+
+vector<size_t> JobScheduler::getCostOrder(const vector<double>& costs)
+{
+  vector<size_t> order(costs.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  stable_sort(order.begin(), order.end(),
+              [&costs](size_t a, size_t b) { return costs[a] > costs[b]; });
+  return order;
+}
+
+namespace {
+  // The queue of one thread. The jobs are kept from the most expensive to
+  // the cheapest.
+  struct jobQueue {
+    mutex m;
+    deque<size_t> jobs;
+    double remainingCost = 0;
+  };
+}
+
+void JobScheduler::run(const vector<double>& costs, size_t numThreads,
+                       const function<void(size_t)>& job)
+{
+  if (numThreads <= 1) {
+    for (size_t i = 0; i < costs.size(); i++) job(i);
+    return;
+  }
+
+  // Hand out the jobs from the most expensive to the cheapest, each to the
+  // queue with the smallest total so far
+  vector<unique_ptr<jobQueue>> queues;
+  for (size_t i = 0; i < numThreads; i++)
+    queues.push_back(unique_ptr<jobQueue>(new jobQueue));
+
+  vector<size_t> order = getCostOrder(costs);
+  for (size_t i = 0; i < order.size(); i++) {
+    size_t smallest = 0;
+    for (size_t q = 1; q < numThreads; q++) {
+      if (queues[q]->remainingCost < queues[smallest]->remainingCost)
+        smallest = q;
+    }
+    // Even free jobs are spread out so the threads start at the same time
+    if (costs[order[i]] == 0) smallest = i % numThreads;
+    queues[smallest]->jobs.push_back(order[i]);
+    queues[smallest]->remainingCost += costs[order[i]];
+  }
+
+  // Take the most expensive job of a queue. Returns false if it is empty.
+  auto takeJob = [&queues, &costs](size_t q, size_t& jobIndex)
+  {
+    lock_guard<mutex> lock(queues[q]->m);
+    if (queues[q]->jobs.empty()) return false;
+    jobIndex = queues[q]->jobs.front();
+    queues[q]->jobs.pop_front();
+    queues[q]->remainingCost -= costs[jobIndex];
+    return true;
+  };
+
+  auto worker = [&](size_t self)
+  {
+    while (true) {
+      size_t jobIndex;
+      if (takeJob(self, jobIndex)) {
+        job(jobIndex);
+        continue;
+      }
+
+      // Our queue is empty. Steal from the queue with the most cost left.
+      bool stole = false;
+      while (!stole) {
+        size_t victim = numThreads;
+        double mostCost = -1;
+        for (size_t q = 0; q < numThreads; q++) {
+          lock_guard<mutex> lock(queues[q]->m);
+          if (queues[q]->jobs.empty()) continue;
+          if (queues[q]->remainingCost > mostCost) {
+            mostCost = queues[q]->remainingCost;
+            victim = q;
+          }
+        }
+        // Every queue is empty. Nothing is ever added, so we are done.
+        if (victim == numThreads) return;
+        // Someone may have taken the last job before us. Look again.
+        stole = takeJob(victim, jobIndex);
+      }
+      job(jobIndex);
+    }
+  };
+
+  vector<thread> threads;
+  for (size_t i = 0; i < numThreads; i++) threads.push_back(thread(worker, i));
+  for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+}
+
+double JobScheduler::getMakespan(const vector<double>& times,
+                                 const vector<size_t>& order,
+                                 size_t numThreads)
+{
+  if (numThreads == 0) numThreads = 1;
+  // The times at which the threads become free, earliest on top
+  priority_queue<double, vector<double>, greater<double>> freeTimes;
+  for (size_t i = 0; i < numThreads; i++) freeTimes.push(0.0);
+
+  double makespan = 0;
+  for (size_t i = 0; i < order.size(); i++) {
+    double end = freeTimes.top() + times[order[i]];
+    freeTimes.pop();
+    freeTimes.push(end);
+    makespan = max(makespan, end);
+  }
+  return makespan;
+}
+
+// The entries of a history file. The value is the average and the number of
+// jobs.
+typedef map<pair<string, uint>, pair<double, size_t>> costHistory;
+
+static costHistory readWholeCostHistory(const string& fileName)
+{
+  costHistory ret;
+  ifstream f(fileName);
+  if (!f.is_open()) return ret;
+
+  string line;
+  while (getline(f, line)) {
+    size_t start = line.find_first_not_of(" \t\r");
+    if (start == string::npos || line[start] == '#') continue;
+    // The key is everything before the last three fields, so it may have
+    // spaces in it
+    size_t fieldsStart = line.find_last_not_of(" \t\r") + 1;
+    for (size_t i = 0; i < 3 && fieldsStart != 0; i++) {
+      size_t space = line.find_last_of(" \t", fieldsStart - 1);
+      if (space == string::npos) fieldsStart = 0;
+      else fieldsStart = line.find_last_not_of(" \t", space) + 1;
+    }
+    string key = line.substr(0, fieldsStart);
+    istringstream ss(line.substr(fieldsStart));
+    uint spg;
+    double average;
+    size_t numJobs;
+    if (key.empty() || !(ss >> spg >> average >> numJobs)) {
+      cout << "Warning: ignoring a line of the cost history file, "
+           << fileName << ", that could not be read: " << line << "\n";
+      continue;
+    }
+    ret[make_pair(key, spg)] = make_pair(average, numJobs);
+  }
+  return ret;
+}
+
+map<uint, double> JobScheduler::readCostHistory(const string& fileName,
+                                                const string& key)
+{
+  map<uint, double> ret;
+  if (fileName.empty()) return ret;
+
+  costHistory history = readWholeCostHistory(fileName);
+  for (const auto& entry: history) {
+    if (entry.first.first == key)
+      ret[entry.first.second] = entry.second.first;
+  }
+  return ret;
+}
+
+void JobScheduler::updateCostHistory(const string& fileName,
+                                     const string& key,
+                                     const map<uint, vector<double>>& jobTimes)
+{
+  if (fileName.empty()) return;
+
+  costHistory history = readWholeCostHistory(fileName);
+  for (const auto& entry: jobTimes) {
+    pair<double, size_t>& old = history[make_pair(key, entry.first)];
+    double sum = old.first * old.second;
+    for (size_t i = 0; i < entry.second.size(); i++) sum += entry.second[i];
+    old.second += entry.second.size();
+    if (old.second != 0) old.first = sum / old.second;
+  }
+
+  ofstream f(fileName);
+  if (!f.is_open()) {
+    cout << "Error opening the cost history file, " << fileName << ".\n"
+         << "The job times of this run will not be saved.\n";
+    return;
+  }
+  f << "# randSpg job cost history: <key> <spg> <average seconds> "
+    << "<number of jobs>\n";
+  for (const auto& entry: history) {
+    f << entry.first.first << " " << entry.first.second << " "
+      << entry.second.first << " " << entry.second.second << "\n";
+  }
+}
@@ -0,0 +1,445 @@
+/**********************************************************************
+  logWriter.cpp - Buffers the text for a log file and writes it on a
+                  background thread.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "logWriter.h"
+
+using namespace std;
+
+static atomic<size_t> s_flushSize(64 * 1024);
+static atomic<long long> s_flushIntervalMicroseconds(200000);
+// Set at exit, after which no thread is started
+static atomic<bool> s_exiting(false);
+
+// The writers that the crash handler flushes. It cannot lock the registry,
+// so they are also kept here, where adding one never moves the others.
+static const size_t maxCrashFlushWriters = 64;
+static atomic<LogWriter*> s_crashFlushWriters[maxCrashFlushWriters];
+static atomic<size_t> s_numCrashFlushWriters(0);
+
+#ifdef _WIN32
+static int openForAppending(const string& fileName)
+{
+  return _open(fileName.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_TEXT,
+               _S_IREAD | _S_IWRITE);
+}
+
+static long writeSome(int fd, const char* data, size_t size)
+{
+  return _write(fd, data, static_cast<unsigned int>(min<size_t>(size,
+                                                                INT_MAX)));
+}
+
+static void closeFile(int fd)
+{
+  _close(fd);
+}
+
+// The file cannot be moved or removed while it is open on Windows
+static bool isStillTheFile(int, const string&)
+{
+  return true;
+}
+#else
+static int openForAppending(const string& fileName)
+{
+  return open(fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+}
+
+static long writeSome(int fd, const char* data, size_t size)
+{
+  return ::write(fd, data, size);
+}
+
+static void closeFile(int fd)
+{
+  ::close(fd);
+}
+
+// Whether the file that is open is still the one with this name. It is not
+// if the file was moved or removed, as log rotation does.
+static bool isStillTheFile(int fd, const string& fileName)
+{
+  struct stat openStat, nameStat;
+  return fstat(fd, &openStat) != 0 ||
+         (stat(fileName.c_str(), &nameStat) == 0 &&
+          openStat.st_dev == nameStat.st_dev &&
+          openStat.st_ino == nameStat.st_ino);
+}
+#endif
+
+// Write all of the bytes. This is safe to call from a signal handler.
+static void writeAll(int fd, const char* data, size_t size)
+{
+  while (size != 0) {
+    long numWritten = writeSome(fd, data, size);
+    if (numWritten < 0 && errno == EINTR) continue;
+    if (numWritten <= 0) return;
+    data += numWritten;
+    size -= numWritten;
+  }
+}
+
+// Marks a buffer or file as busy for the signal handler while it is in
+// scope. The lock that guards it must be held, so the only other user of
+// the flag is the signal handler, which never waits for it.
+class busyFlag {
+ public:
+  explicit busyFlag(atomic<bool>& flag) : m_flag(flag)
+  {
+    while (m_flag.exchange(true)) this_thread::yield();
+  }
+  ~busyFlag() { m_flag = false; }
+
+ private:
+  atomic<bool>& m_flag;
+};
+
+// The writers are never deleted, so that a writer that was closed can be
+// used again, and so that they can still be used while the static objects
+// are destroyed at exit. Their threads are stopped at exit.
+struct logWriterRegistry {
+  mutex m;
+  map<string, LogWriter*> writers;
+
+  vector<LogWriter*> getWriters()
+  {
+    lock_guard<mutex> lock(m);
+    vector<LogWriter*> ret;
+    for (auto it = writers.begin(); it != writers.end(); ++it)
+      ret.push_back(it->second);
+    return ret;
+  }
+
+  static void stopAll()
+  {
+    s_exiting = true;
+    vector<LogWriter*> writers = get().getWriters();
+    for (size_t i = 0; i < writers.size(); i++) writers[i]->stop();
+  }
+
+  // The registry may be in the middle of a change, so the writers are
+  // found in s_crashFlushWriters instead
+  static void flushAllFromSignal()
+  {
+    size_t numWriters = min(s_numCrashFlushWriters.load(),
+                            maxCrashFlushWriters);
+    for (size_t i = 0; i < numWriters; i++) {
+      LogWriter* writer = s_crashFlushWriters[i];
+      if (writer) writer->flushFromSignal();
+    }
+  }
+
+  static logWriterRegistry& get()
+  {
+    static logWriterRegistry* registry = new logWriterRegistry;
+    return *registry;
+  }
+};
+
+LogWriter& LogWriter::forFile(const string& fileName)
+{
+  logWriterRegistry& registry = logWriterRegistry::get();
+  lock_guard<mutex> lock(registry.m);
+  return getWriter(fileName);
+}
+
+LogWriter& LogWriter::getWriter(const string& fileName)
+{
+  logWriterRegistry& registry = logWriterRegistry::get();
+  auto it = registry.writers.find(fileName);
+  if (it != registry.writers.end()) return *it->second;
+
+  if (registry.writers.empty()) atexit(logWriterRegistry::stopAll);
+  LogWriter* writer = new LogWriter(fileName);
+  registry.writers[fileName] = writer;
+  size_t numCrashFlushWriters = s_numCrashFlushWriters;
+  if (numCrashFlushWriters < maxCrashFlushWriters) {
+    s_crashFlushWriters[numCrashFlushWriters] = writer;
+    s_numCrashFlushWriters = numCrashFlushWriters + 1;
+  }
+  return *writer;
+}
+
+shared_ptr<LogWriter> LogWriter::open(const string& fileName)
+{
+  logWriterRegistry& registry = logWriterRegistry::get();
+  lock_guard<mutex> lock(registry.m);
+  LogWriter* writer = &getWriter(fileName);
+  writer->m_numUsers++;
+  return shared_ptr<LogWriter>(writer, [](LogWriter* w)
+  {
+    {
+      lock_guard<mutex> lock(logWriterRegistry::get().m);
+      if (--w->m_numUsers != 0) return;
+    }
+    // If it is opened again in the meantime, its next append opens the
+    // file again
+    w->release();
+  });
+}
+
+void LogWriter::close(const string& fileName)
+{
+  logWriterRegistry& registry = logWriterRegistry::get();
+  LogWriter* writer = nullptr;
+  {
+    lock_guard<mutex> lock(registry.m);
+    auto it = registry.writers.find(fileName);
+    if (it != registry.writers.end()) writer = it->second;
+  }
+  if (writer) writer->release();
+}
+
+LogWriter::LogWriter(const string& fileName) :
+  m_fileName(fileName),
+  m_bufferBusy(false),
+  m_flushRequested(false),
+  m_stop(false),
+  m_closed(false),
+  m_numAppended(0),
+  m_numWritten(0),
+  m_fd(-1),
+  m_fileBusy(false),
+  m_numUsers(0)
+{
+  lock_guard<mutex> lock(m_bufferMutex);
+  start();
+}
+
+void LogWriter::start()
+{
+  {
+    lock_guard<mutex> fileLock(m_fileMutex);
+    busyFlag busy(m_fileBusy);
+    m_fd = openForAppending(m_fileName);
+  }
+  if (m_fd < 0) {
+    cout << "Error opening log file, " << m_fileName << ".\n"
+         << "The program will keep running, but log info will not be "
+         << "written.\n";
+  }
+  m_closed = false;
+  // At exit, the text is written right away instead
+  m_stop = s_exiting;
+  if (!m_stop) m_thread = thread(&LogWriter::run, this);
+}
+
+void LogWriter::append(const string& text)
+{
+  if (text.empty()) return;
+
+  unique_lock<mutex> lock(m_bufferMutex);
+  if (m_closed) start();
+  // After the thread is stopped (at exit, or while it is being closed),
+  // write right away
+  if (m_stop) {
+    lock_guard<mutex> fileLock(m_fileMutex);
+    write(text);
+    return;
+  }
+
+  bool wasEmpty = m_buffer.empty();
+  {
+    busyFlag busy(m_bufferBusy);
+    m_buffer += text;
+  }
+  m_numAppended += text.size();
+  if (m_buffer.size() >= s_flushSize) {
+    m_flushRequested = true;
+    m_wakeUp.notify_one();
+  }
+  // The interval starts with the first text in the buffer
+  else if (wasEmpty) {
+    m_wakeUp.notify_one();
+  }
+}
+
+void LogWriter::flush()
+{
+  unique_lock<mutex> lock(m_bufferMutex);
+  if (m_stop) return;
+  unsigned long long target = m_numAppended;
+  if (m_numWritten >= target) return;
+  m_flushRequested = true;
+  m_wakeUp.notify_one();
+  m_written.wait(lock, [&]() { return m_numWritten >= target; });
+}
+
+void LogWriter::flushAll()
+{
+  vector<LogWriter*> writers = logWriterRegistry::get().getWriters();
+  for (size_t i = 0; i < writers.size(); i++) writers[i]->flush();
+}
+
+void LogWriter::run()
+{
+  unique_lock<mutex> lock(m_bufferMutex);
+  while (true) {
+    m_wakeUp.wait(lock, [&]() { return m_stop || !m_buffer.empty(); });
+    if (m_buffer.empty()) break;
+
+    auto deadline = chrono::steady_clock::now() +
+                    chrono::microseconds(s_flushIntervalMicroseconds.load());
+    m_wakeUp.wait_until(lock, deadline,
+                        [&]() { return m_stop || m_flushRequested; });
+
+    string text;
+    {
+      busyFlag busy(m_bufferBusy);
+      text.swap(m_buffer);
+    }
+    m_flushRequested = false;
+    unsigned long long numAppended = m_numAppended;
+
+    // The file is locked before the buffer is unlocked, so text that is
+    // appended now cannot be written before this text
+    unique_lock<mutex> fileLock(m_fileMutex);
+    lock.unlock();
+    write(text);
+    fileLock.unlock();
+    lock.lock();
+
+    m_numWritten = numAppended;
+    m_written.notify_all();
+  }
+}
+
+void LogWriter::write(const string& text)
+{
+  if (m_fd < 0) return;
+  busyFlag busy(m_fileBusy);
+  // Text that is written to a file that was moved or removed would never
+  // be seen, so the file is opened again by its name
+  if (!isStillTheFile(m_fd, m_fileName)) {
+    int fd = openForAppending(m_fileName);
+    if (fd >= 0) {
+      closeFile(m_fd);
+      m_fd = fd;
+    }
+  }
+  writeAll(m_fd, text.data(), text.size());
+}
+
+void LogWriter::stop()
+{
+  {
+    lock_guard<mutex> lock(m_bufferMutex);
+    if (m_stop) return;
+    m_stop = true;
+    m_wakeUp.notify_one();
+  }
+  if (m_thread.joinable()) m_thread.join();
+}
+
+void LogWriter::release()
+{
+  lock_guard<mutex> closeLock(m_closeMutex);
+  {
+    // A writer that is stopped but not closed was stopped at exit, and it
+    // is left open
+    lock_guard<mutex> lock(m_bufferMutex);
+    if (m_closed || m_stop) return;
+    m_stop = true;
+    m_wakeUp.notify_one();
+  }
+  // The thread writes everything before it stops
+  if (m_thread.joinable()) m_thread.join();
+
+  lock_guard<mutex> lock(m_bufferMutex);
+  lock_guard<mutex> fileLock(m_fileMutex);
+  busyFlag busy(m_fileBusy);
+  if (m_fd >= 0) closeFile(m_fd);
+  m_fd = -1;
+  m_closed = true;
+}
+
+void LogWriter::flushFromSignal()
+{
+  // The code that was interrupted may have been changing the buffer or
+  // writing the file, and it will never finish, so we only write if
+  // neither is busy
+  if (m_fileBusy.exchange(true)) return;
+  if (m_fd < 0) {
+    m_fileBusy = false;
+    return;
+  }
+  if (!m_bufferBusy.exchange(true)) {
+    writeAll(m_fd, m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
+    m_bufferBusy = false;
+  }
+  m_fileBusy = false;
+}
+
+static void crashHandler(int sig)
+{
+  int savedErrno = errno;
+  logWriterRegistry::flushAllFromSignal();
+  errno = savedErrno;
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+void LogWriter::installCrashHandlers()
+{
+  int signals[] = {SIGABRT, SIGFPE, SIGILL, SIGINT, SIGSEGV, SIGTERM};
+  for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+    signal(signals[i], crashHandler);
+}
+
+size_t LogWriter::getMaxCrashFlushWriters()
+{
+  return maxCrashFlushWriters;
+}
+
+void LogWriter::setFlushSize(size_t bytes)
+{
+  s_flushSize = bytes;
+}
+
+size_t LogWriter::getFlushSize()
+{
+  return s_flushSize;
+}
+
+void LogWriter::setFlushInterval(double seconds)
+{
+  s_flushIntervalMicroseconds = static_cast<long long>(seconds * 1e6);
+}
+
+double LogWriter::getFlushInterval()
+{
+  return s_flushIntervalMicroseconds * 1e-6;
+}
@@ -15,41 +15,120 @@
 
 // For timings
 #include <chrono>
+#include <climits>
 // To remove the log file
 #include <cstdio>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <sstream>
+#include <thread>
 
+#include "combinatoricsCacheFile.h"
 #include "elemInfo.h"
 #include "fileSystemUtils.h"
+#include "jobScheduler.h"
+#include "logWriter.h"
 #include "randSpg.h"
+#include "randSpgCombinatorics.h"
+#include "randSpgContext.h"
+#include "randSpgGenerator.h"
 #include "randSpgOptions.h"
+#include "shardResults.h"
+#include "structureBinaryFile.h"
+#include "structureContainer.h"
+#include "structureFingerprint.h"
+#include "rng.h"
 #include "utilityFunctions.h"
 
 using namespace std;
 
+// What one (spg, index) job did
+struct jobResult {
+  bool done = false;
+  bool succeeded = false;
+  bool abortedEarly = false;
+  bool timedOut = false;
+  // The time budget of its spacegroup was used before it started
+  bool skipped = false;
+  // Wall time of the job in seconds
+  double time = 0;
+  // The log text of the job until it is written to the log file
+  std::string log;
+  // The seed of the job's random numbers
+  uint seed = 0;
+  // With a container or binary file, or when duplicates are removed, the
+  // crystal until it is written
+  Crystal crystal;
+  // When duplicates are removed, the fingerprint of the crystal
+  structureFingerprint fingerprint;
+  // The number of times the crystal was made again as a duplicate
+  uint duplicateRetries = 0;
+  // The crystal was the same as an earlier one and was not written
+  bool duplicate = false;
+};
+
+// The log buffer of the job running on this thread
+static thread_local string* t_jobLog = nullptr;
+
 int main(int argc, char* argv[])
 {
-  if (argc != 2) {
-    cout << "Usage: ./randSpg <inputFileName>\n";
+  // With '--count', only the number of Wyckoff position possibilities for
+  // each spacegroup is printed. With '--shard i/N', only the jobs whose
+  // index is i modulo N are run (see shardResults.h).
+  bool countOnly = false;
+  bool sharded = false;
+  size_t shardIndex = 0, numShards = 1;
+  bool argsAreValid = (argc >= 2);
+  for (int i = 1; i < argc - 1 && argsAreValid; i++) {
+    string arg = argv[i];
+    if (arg == "--count") countOnly = true;
+    else if (arg == "--shard" && i + 1 < argc - 1) {
+      sharded = true;
+      if (!ShardResults::parseShardArgument(argv[++i], shardIndex,
+                                            numShards)) {
+        cout << "Error: the shard, '" << argv[i] << "', is invalid. It "
+             << "should be 'i/N' with 0 <= i < N.\n";
+        argsAreValid = false;
+      }
+    }
+    else argsAreValid = false;
+  }
+  if (!argsAreValid) {
+    cout << "Usage: ./randSpg [--count] [--shard i/N] <inputFileName>\n";
     return -1;
   }
+  char* inputFileName = argv[argc - 1];
+
+  // The log is buffered, so write what is left of it if we crash
+  LogWriter::installCrashHandlers();
 
   // Let's time it!
   auto setup_startTime = chrono::high_resolution_clock::now();
 
-  string logFileName = string(argv[1]);
+  string logFileName = string(inputFileName);
 
   // Remove ".in" ending if needed
   if (hasEnding(logFileName, ".in"))
     logFileName = logFileName.substr(0, logFileName.length() - 3);
 
   e_logfilename = logFileName + ".log";
+  string resultsFileName;
+  if (sharded) {
+    resultsFileName = ShardResults::getResultsFileName(e_logfilename,
+                                                       shardIndex, numShards);
+    e_logfilename = ShardResults::getLogFileName(e_logfilename, shardIndex,
+                                                 numShards);
+  }
 
-  // If there is an old log file here, remove it
-  remove(e_logfilename.c_str());
+  // If there is an old log file here, remove it. Counting does not write to
+  // the log file, so leave it alone in that case.
+  if (!countOnly) remove(e_logfilename.c_str());
 
-  RandSpgOptions options = RandSpgOptions::readOptions(argv[1]);
+  RandSpgOptions options = RandSpgOptions::readOptions(inputFileName);
 
   if (!options.optionsAreValid()) {
     cout << "Warning: the options that were received are invalid\n";
@@ -57,8 +136,15 @@ int main(int argc, char* argv[])
     exit(EXIT_FAILURE);
   }
 
+  // Every shard has to use the same seed, or the shards would not add up
+  // to one run
+  if (sharded && !countOnly && options.getSeed() == -1) {
+    cout << "Error: the 'seed' option must be set when '--shard' is used.\n";
+    return -1;
+  }
+
   // Write the options to the log file
-  RandSpg::appendToLogFile(options.getOptionsString());
+  if (!countOnly) RandSpg::appendToLogFile(options.getOptionsString());
 
   vector<uint> atoms;
 
@@ -71,6 +157,26 @@ int main(int argc, char* argv[])
 
   e_verbosity = options.getVerbosity();
 
+  // Use the combinatorics cache file if one was given
+  CombinatoricsCacheFile::setFileName(options.getCombinatoricsCacheFile());
+
+  if (countOnly) {
+    wyckConstraints constraints;
+    constraints.forceMostGeneralWyckPos = options.forceMostGeneralWyckPos();
+    constraints.forcedWyckAssignments = options.getForcedWyckAssignments();
+    vector<uint> spacegroups = options.getSpacegroups();
+    cout << "spg  number of possibilities\n";
+    for (size_t i = 0; i < spacegroups.size(); i++) {
+      uint64_t count =
+        RandSpgCombinatorics::countSystemPossibilities(spacegroups[i], atoms,
+                                                       constraints);
+      cout << setw(3) << spacegroups[i] << "  "
+           << (count == UINT64_MAX ? string(">= ") : string()) << count
+           << "\n";
+    }
+    return 0;
+  }
+
   // Set up lattice mins and maxes
   latticeStruct mins  = options.getLatticeMins();
   latticeStruct maxes = options.getLatticeMaxes();
@@ -87,8 +193,13 @@ int main(int argc, char* argv[])
   input.maxVolume = options.getMaxVolume();
   input.forcedWyckAssignments = options.getForcedWyckAssignments();
   input.verbosity = options.getVerbosity();
+  input.maxVerbosePossibilities = options.getMaxVerbosePossibilities();
   input.maxAttempts = options.getMaxAttempts();
   input.forceMostGeneralWyckPos = options.forceMostGeneralWyckPos();
+  input.wyckSampling = options.getWyckSampling();
+  input.numParallelAttempts = options.getNumParallelAttempts();
+  input.earlyAbortThreshold = options.getEarlyAbortThreshold();
+  input.timeLimit = options.getTimeLimit();
 
   // Set up various other options
   vector<uint> spacegroups = options.getSpacegroups();
@@ -104,51 +215,348 @@ int main(int argc, char* argv[])
   // Defined in fileSystemUtils.h
   mkDir(outDir);
 
-  size_t numAttempts = spacegroups.size() * numOfEach;
+  // A container or binary file gets the structures in job order, as the
+  // log does
+  string outputFormat = options.getOutputFormat();
+  bool useBinary = (outputFormat == "binary" || outputFormat == "binary32");
+  bool useCIF = (outputFormat == "cif");
+  bool useContainer = (outputFormat != "poscar" && !useCIF && !useBinary);
+  // When duplicates are removed, every format is written in job order, and
+  // a duplicate is made again only when it is written, so that it is
+  // compared with the structures of the jobs before it and no others.
+  // A shard does not see the structures of the other shards, so it does
+  // not make duplicates again.
+  bool removeDuplicates = options.removeDuplicates();
+  uint duplicateRetries = options.getDuplicateRetries();
+  if (sharded && removeDuplicates && duplicateRetries > 0) {
+    cout << "Warning: 'duplicateRetries' is not used when '--shard' is "
+         << "used.\n";
+    duplicateRetries = 0;
+  }
+  bool keepCrystals = (useContainer || useBinary || removeDuplicates);
+  StructureContainerWriter container;
+  StructureBinaryWriter binaryFile;
+  string outputBaseName = outDir + comp;
+  if (sharded) {
+    outputBaseName += ".shard-" + to_string(shardIndex) + "-of-" +
+                      to_string(numShards);
+  }
+  if (useContainer) {
+    structureContainerFormat format =
+      (outputFormat == "xyzContainer" ? xyzContainer : poscarContainer);
+    if (!container.open(outputBaseName + ".structures", format)) return -1;
+  }
+  if (useBinary) {
+    uint32_t coordSize = (outputFormat == "binary32" ? 4 : 8);
+    if (!binaryFile.open(outputBaseName + ".bin", coordSize)) return -1;
+  }
+
+  // The jobs of this shard. Every job is in the only shard by default.
+  size_t numJobs = spacegroups.size() * numOfEach;
+  vector<size_t> shardJobs;
+  for (size_t i = shardIndex; i < numJobs; i += numShards)
+    shardJobs.push_back(i);
+
+  size_t numAttempts = shardJobs.size();
   size_t numSucceeds = 0;
 
   double successTime = 0, failTime = 0;
 
+  // Every job draws its random numbers from a generator seeded with the
+  // base seed, its spacegroup, and its index, so a seed reproduces the
+  // same crystals no matter how the jobs are spread over the threads.
+  uint baseSeed = options.getSeed();
+  if (options.getSeed() == -1) baseSeed = random_device{}() & INT_MAX;
+  RandSpg::appendToLogFile("Seed used: " + to_string(baseSeed) + "\n");
+
+  uint numThreads = options.getNumThreads();
+  if (numThreads == 0) numThreads = thread::hardware_concurrency();
+  if (numThreads == 0) numThreads = 1;
+
+  // The log of each job is kept in its own buffer while the job runs, and
+  // the buffers are written in job order, so the log file looks the same
+  // as it does with one thread.
+  auto context = make_shared<const RandSpgContext>(input, [](const string& s)
+  {
+    if (t_jobLog) *t_jobLog += s;
+    else RandSpg::appendToLogFile(s);
+  });
+
+  // Start the jobs that are likely to take the longest first
+  string costHistoryFile = options.getJobCostHistoryFile();
+  wyckConstraints constraints;
+  constraints.forceMostGeneralWyckPos = options.forceMostGeneralWyckPos();
+  constraints.forcedWyckAssignments = options.getForcedWyckAssignments();
+  vector<double> spgCosts =
+    JobScheduler::estimateCosts(spacegroups, atoms,
+                                JobScheduler::readCostHistory(costHistoryFile,
+                                                              comp),
+                                constraints);
+  vector<double> jobCosts;
+  for (size_t i = 0; i < shardJobs.size(); i++)
+    jobCosts.push_back(spgCosts[shardJobs[i] / numOfEach]);
+
+  // The jobs of other shards count as done, so that the logs of this
+  // shard's jobs are not held back by them
+  vector<jobResult> results(numJobs);
+  for (size_t i = 0; i < numJobs; i++)
+    results[i].done = (i % numShards != shardIndex);
+  size_t numWritten = 0;
+  // A thread is writing the results, and the others leave them to it
+  bool writing = false;
+  mutex resultsMutex;
+
+  // With a time budget, every spacegroup has a token whose deadline is set
+  // when its first job starts. The jobs of the spacegroup that are running
+  // all stop at the deadline, and the ones after it are skipped.
+  double spgTimeBudget = options.getSpgTimeBudget();
+  vector<shared_ptr<RandSpgCancelToken>> spgTokens(spacegroups.size());
+
+  // The jobs of a spacegroup share one generator. It is made by the first
+  // job of the spacegroup that starts.
+  vector<unique_ptr<const RandSpgGenerator>> generators(spacegroups.size());
+  vector<once_flag> generatorFlags(spacegroups.size());
+
+  // The fingerprints of the jobs that are written
+  StructureFingerprintSet writtenFingerprints;
+
   auto setup_wallTime = chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - setup_startTime).count() * 0.000000001;
 
-  // Time the loop
-  auto start_loopTime = chrono::high_resolution_clock::now();
+  // Make a duplicate again, with a seed of its own for each retry
+  auto remakeJob = [&](size_t jobIndex)
+  {
+    uint spg = spacegroups[jobIndex / numOfEach];
+    size_t j = jobIndex % numOfEach;
+    jobResult& result = results[jobIndex];
+
+    auto start = chrono::high_resolution_clock::now();
+    result.duplicateRetries++;
+    t_jobLog = &result.log;
+    if (e_verbosity != 'n') {
+      context->log("The structure is the same as an earlier one. Making it "
+                   "again (retry " + to_string(result.duplicateRetries) +
+                   " of " + to_string(duplicateRetries) + ").\n");
+    }
+    seed_seq retrySeq{baseSeed, spg, static_cast<uint>(j),
+                      result.duplicateRetries};
+    uint jobSeed;
+    retrySeq.generate(&jobSeed, &jobSeed + 1);
+    seedRandEngine(jobSeed);
+    result.seed = jobSeed;
+    randSpgStatus status;
+    Crystal c = generators[jobIndex / numOfEach]->generate(status);
+    result.abortedEarly = (status == randSpgAbortedEarly);
+    result.timedOut = (status == randSpgTimedOut);
+    t_jobLog = nullptr;
+
+    result.succeeded = (c.getVolume() != 0);
+    result.crystal = c;
+    if (result.succeeded)
+      result.fingerprint = StructureFingerprint::getFingerprint(c);
+    result.time += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count() * 0.000000001;
+  };
+
+  auto runJob = [&](size_t jobIndex)
+  {
+    uint spg = spacegroups[jobIndex / numOfEach];
+    size_t j = jobIndex % numOfEach;
+    jobResult& result = results[jobIndex];
+
+    auto start = chrono::high_resolution_clock::now();
+    seed_seq seq{baseSeed, spg, static_cast<uint>(j)};
+    uint jobSeed;
+    seq.generate(&jobSeed, &jobSeed + 1);
+    seedRandEngine(jobSeed);
+    result.seed = jobSeed;
+
+    string filename = outDir + comp + "_" + to_string(spg) +
+                      "-" + to_string(j + 1);
+    t_jobLog = &result.log;
+    if (e_verbosity != 'n')
+      context->log(string("\n**** ") + filename + " ****\n");
 
-  for (size_t i = 0; i < spacegroups.size(); i++) {
-    uint spg = spacegroups[i];
     // Change the input spg to have the right spacegroup
-    input.spg = spg;
-    for (size_t j = 0; j < numOfEach; j++) {
-      auto start = chrono::high_resolution_clock::now();
-      string filename = outDir + comp + "_" + to_string(spg) +
-                        "-" + to_string(j + 1);
-      if (e_verbosity != 'n')
-        RandSpg::appendToLogFile(string("\n**** ") + filename + " ****\n");
-
-      Crystal c = RandSpg::randSpgCrystal(input);
-
-      string title = comp + " -- randSpg with spg of: " + to_string(spg);
-
-      // The volume is set to zero if the job failed.
-      if (c.getVolume() != 0) {
-        // Success!
-        c.writePOSCAR(filename, title);
-        successTime += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count() * 0.000000001;
-        numSucceeds++;
+    randSpgInput jobInput = input;
+    jobInput.spg = spg;
+    if (spgTimeBudget > 0) {
+      lock_guard<mutex> lock(resultsMutex);
+      shared_ptr<RandSpgCancelToken>& token =
+        spgTokens[jobIndex / numOfEach];
+      if (!token) {
+        token = make_shared<RandSpgCancelToken>();
+        token->setTimeLimit(spgTimeBudget);
+      }
+      jobInput.cancelToken = token;
+      result.skipped =
+        (RandSpgCancelToken::clock::now() >= token->getDeadline());
+    }
+
+    Crystal c;
+    if (result.skipped) {
+      if (e_verbosity != 'n') {
+        context->log("Skipped: the time budget of spg " + to_string(spg) +
+                     " was used.\n");
       }
+    }
+    else {
+      size_t spgIndex = jobIndex / numOfEach;
+      call_once(generatorFlags[spgIndex], [&]()
+      {
+        generators[spgIndex].reset(new RandSpgGenerator(jobInput, context));
+      });
+      randSpgStatus status;
+      c = generators[spgIndex]->generate(status);
+      result.abortedEarly = (status == randSpgAbortedEarly);
+      result.timedOut = (status == randSpgTimedOut);
+      if (removeDuplicates && c.getVolume() != 0)
+        result.fingerprint = StructureFingerprint::getFingerprint(c);
+    }
+    t_jobLog = nullptr;
+
+    string title = comp + " -- randSpg with spg of: " + to_string(spg);
 
-      // We failed! Add this to the fail time
-      else failTime += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count() * 0.000000001;
+    // The volume is set to zero if the job failed.
+    result.succeeded = (c.getVolume() != 0);
+    if (result.succeeded) {
+      if (keepCrystals) result.crystal = c;
+      else if (useCIF) c.writeCIF(filename + ".cif", title);
+      else c.writePOSCAR(filename, title);
     }
-  }
+    result.time = chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count() * 0.000000001;
+
+    // Write every finished job that no unfinished job comes before. If
+    // another thread is writing, it writes this job too.
+    unique_lock<mutex> lock(resultsMutex);
+    result.done = true;
+    if (writing) return;
+    writing = true;
+    string logText;
+    while (numWritten < numJobs && results[numWritten].done) {
+      jobResult& written = results[numWritten];
+      // Other threads only mark their jobs as done while this one is made
+      // again
+      while (removeDuplicates && written.succeeded &&
+             written.duplicateRetries < duplicateRetries &&
+             writtenFingerprints.contains(written.fingerprint)) {
+        lock.unlock();
+        remakeJob(numWritten);
+        lock.lock();
+      }
+      if (removeDuplicates && written.succeeded &&
+          !writtenFingerprints.insert(written.fingerprint)) {
+        written.duplicate = true;
+        written.crystal = Crystal();
+        if (e_verbosity != 'n') {
+          written.log += "Removed: the structure is the same as an earlier "
+                         "one.\n";
+        }
+      }
+      if (keepCrystals && written.succeeded && !written.duplicate) {
+        structureRecord record;
+        record.spg = spacegroups[numWritten / numOfEach];
+        record.spgIndex = numWritten % numOfEach + 1;
+        record.seed = written.seed;
+        record.time = written.time;
+        record.name = comp + "_" + to_string(record.spg) + "-" +
+                      to_string(record.spgIndex);
+        string writtenTitle = comp + " -- randSpg with spg of: " +
+                              to_string(record.spg);
+        if (useBinary) {
+          binaryFile.append(written.crystal, record);
+        }
+        else if (useContainer) {
+          container.append(written.crystal, writtenTitle, record);
+        }
+        else if (useCIF) {
+          written.crystal.writeCIF(outDir + record.name + ".cif",
+                                   writtenTitle);
+        }
+        else {
+          written.crystal.writePOSCAR(outDir + record.name, writtenTitle);
+        }
+        written.crystal = Crystal();
+      }
+      logText += results[numWritten].log;
+      // The logs of a shard are also kept for its results file
+      if (!sharded) string().swap(results[numWritten].log);
+      numWritten++;
+    }
+    writing = false;
+    lock.unlock();
+    if (!logText.empty()) RandSpg::appendToLogFile(logText);
+  };
+
+  // Time the loop
+  auto start_loopTime = chrono::high_resolution_clock::now();
+
+  // The jobs run on threads of their own rather than on the global pool.
+  // The combinatorics use the global pool, and a job must not be started on
+  // a thread that is waiting for a search in the middle of another job.
+  JobScheduler::run(jobCosts, numThreads,
+                    [&](size_t i) { runJob(shardJobs[i]); });
+  if (useContainer) container.close();
+  if (useBinary) binaryFile.close();
 
   auto loop_wallTime = chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start_loopTime).count() * 0.000000001;
 
+  // Sum in job order so the totals do not depend on which job finished
+  // first
+  size_t numAbortedEarly = 0, numTimedOut = 0, numSkipped = 0;
+  size_t numDuplicates = 0, numDuplicateRetries = 0;
+  vector<double> jobTimes;
+  map<uint, vector<double>> spgJobTimes;
+  for (size_t k = 0; k < shardJobs.size(); k++) {
+    const jobResult& result = results[shardJobs[k]];
+    // A duplicate was made, but it was removed, so it is neither a success
+    // nor a failure
+    if (result.duplicate) numDuplicates++;
+    else if (result.succeeded) {
+      successTime += result.time;
+      numSucceeds++;
+    }
+    // We failed! Add this to the fail time
+    else failTime += result.time;
+    if (result.abortedEarly) numAbortedEarly++;
+    if (result.timedOut) numTimedOut++;
+    if (result.skipped) numSkipped++;
+    numDuplicateRetries += result.duplicateRetries;
+    jobTimes.push_back(result.time);
+    // A skipped job says nothing about how long its spacegroup takes
+    if (!result.skipped)
+      spgJobTimes[spacegroups[shardJobs[k] / numOfEach]].push_back(result.time);
+  }
+
+  // Shards may run at the same time, so only a whole run updates the cost
+  // history file
+  if (!sharded)
+    JobScheduler::updateCostHistory(costHistoryFile, comp, spgJobTimes);
+
   if (e_verbosity != 'n') {
     stringstream ss;
     ss << "\n-------------------------------------------------------------\n"
        << "Number of structures attempted: " << numAttempts << "\n"
-       << "Number of structures succeeded: " << numSucceeds << "\n"
+       << "Number of structures succeeded: " << numSucceeds << "\n";
+    if (options.getEarlyAbortThreshold() > 0)
+      ss << "Number of structures stopped early: " << numAbortedEarly << "\n";
+    if (options.getTimeLimit() > 0 || spgTimeBudget > 0)
+      ss << "Number of structures that ran out of time: " << numTimedOut
+         << "\n";
+    if (spgTimeBudget > 0)
+      ss << "Number of structures skipped by the spacegroup time budget: "
+         << numSkipped << "\n";
+    if (removeDuplicates) {
+      // Every retry was made for a structure that was a duplicate
+      size_t numMade = numSucceeds + numDuplicates + numDuplicateRetries;
+      size_t numFound = numDuplicates + numDuplicateRetries;
+      ss << "Number of duplicate structures made again: "
+         << numDuplicateRetries << "\n"
+         << "Number of duplicate structures removed: " << numDuplicates
+         << "\n"
+         << "Duplicate rate: " << numFound << " of " << numMade
+         << " structures made ("
+         << (numMade != 0 ? 100.0 * numFound / numMade : 0) << "%)\n";
+    }
+    ss << "Number of threads: " << numThreads << "\n"
        << "Setup wall time (in seconds): " << setup_wallTime << "\n"
        << "Structure generation wall time (in seconds): "
        << loop_wallTime << "\n"
@@ -159,11 +567,64 @@ int main(int argc, char* argv[])
            successTime / ((double)numSucceeds) : 0)
        << "\n"
        << "Average failure wall time (in seconds): "
-       << ((numAttempts != numSucceeds) ?
-           failTime / ((double)(numAttempts - numSucceeds)) : 0)
+       << ((numAttempts != numSucceeds + numDuplicates) ?
+           failTime / ((double)(numAttempts - numSucceeds - numDuplicates))
+           : 0)
        << "\n"
        << "Total wall time (in seconds): " << setup_wallTime + loop_wallTime
-       << "\n------------------------------------------------------------ \n";
+       << "\n";
+    if (numThreads > 1) {
+      // How long the jobs would have taken (with the times they took this
+      // run) if they were started in spacegroup order or in the order of
+      // their estimated costs
+      vector<size_t> spgOrder(numAttempts);
+      for (size_t k = 0; k < numAttempts; k++) spgOrder[k] = k;
+      ss << "Simulated makespan in spacegroup order (in seconds): "
+         << JobScheduler::getMakespan(jobTimes, spgOrder, numThreads) << "\n"
+         << "Simulated makespan in estimated cost order (in seconds): "
+         << JobScheduler::getMakespan(jobTimes,
+                                      JobScheduler::getCostOrder(jobCosts),
+                                      numThreads)
+         << "\n";
+    }
+    ss << "------------------------------------------------------------ \n";
     RandSpg::appendToLogFile(ss.str());
   }
+
+  // The merge tool may be waiting for the results file, so the log has to
+  // be complete before the file is there
+  LogWriter::flushAll();
+
+  if (sharded) {
+    shardResults shard;
+    shard.shardIndex = shardIndex;
+    shard.numShards = numShards;
+    shard.seed = baseSeed;
+    shard.numJobs = numJobs;
+    shard.setupTime = setup_wallTime;
+    shard.loopTime = loop_wallTime;
+    shard.earlyAbort = (options.getEarlyAbortThreshold() > 0);
+    shard.timeLimit = (options.getTimeLimit() > 0 || spgTimeBudget > 0);
+    shard.spgTimeBudget = (spgTimeBudget > 0);
+    shard.removeDuplicates = removeDuplicates;
+    shard.optionsString = options.getOptionsString();
+    for (size_t k = 0; k < shardJobs.size(); k++) {
+      const jobResult& result = results[shardJobs[k]];
+      jobRecord job;
+      job.index = shardJobs[k];
+      job.spg = spacegroups[shardJobs[k] / numOfEach];
+      job.spgIndex = shardJobs[k] % numOfEach;
+      if (result.duplicate) job.status = jobDuplicate;
+      else if (result.succeeded) job.status = jobSucceeded;
+      else if (result.skipped) job.status = jobSkipped;
+      else if (result.timedOut) job.status = jobTimedOut;
+      else if (result.abortedEarly) job.status = jobAbortedEarly;
+      else job.status = jobFailed;
+      job.duplicateRetries = result.duplicateRetries;
+      job.time = result.time;
+      job.log = result.log;
+      shard.jobs.push_back(job);
+    }
+    if (!ShardResults::write(resultsFileName, shard)) return -1;
+  }
 }
@@ -0,0 +1,278 @@
+/**********************************************************************
+  possibilitiesCache.cpp - Thread-safe cache of the system possibilities
+                           that are found for a given spacegroup,
+                           composition, and set of Wyckoff constraints.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include "combinatoricsCacheFile.h"
+#include "possibilitiesCache.h"
+#include "spgFeasibility.h"
+
+using namespace std;
+
+typedef shared_ptr<const cachedPossibilities> cachedPtr;
+
+// An entry of the cache. The generation tells an entry apart from an
+// earlier one with the same key that was removed.
+struct cacheEntry {
+  shared_future<cachedPtr> future;
+  uint64_t generation;
+};
+
+// All of the cache state. The futures allow a second thread asking for the
+// same key to wait for the first one instead of repeating the search.
+static mutex cacheMutex;
+static map<string, cacheEntry> cacheEntries;
+// Keys and generations in the order they were inserted so the oldest can be
+// removed first. An entry whose generation is not the one in cacheEntries
+// was already removed, and it is skipped.
+static deque<pair<string, uint64_t>> cacheInsertionOrder;
+static uint64_t cacheGeneration = 0;
+static size_t cacheMaxSize = 1024;
+
+// Find the possibilities with the constraints or load them from the cache
+// file
+static systemPossibilities findOrLoadPossibilities(
+  uint spg, const vector<uint>& atoms, const wyckConstraints& constraints,
+  const RandSpgDeadline& deadline)
+{
+  systemPossibilities ret;
+  string fileKey = CombinatoricsCacheFile::getKey(spg, atoms, constraints,
+                                                  false, false);
+  if (!CombinatoricsCacheFile::load(fileKey, ret)) {
+    ret = RandSpgCombinatorics::getSystemPossibilities(spg, atoms,
+                                                       constraints, false,
+                                                       false, deadline);
+    CombinatoricsCacheFile::store(fileKey, ret);
+  }
+  return ret;
+}
+
+// Find the possibilities that satisfy the constraints. 'atoms' and
+// 'forcedWyckAssignments' should already be sorted.
+static cachedPtr findPossibilities(
+  uint spg, const vector<uint>& atoms, bool forceMostGeneralWyckPos,
+  const vector<pair<uint, char>>& forcedWyckAssignments,
+  const RandSpgDeadline& deadline)
+{
+  shared_ptr<cachedPossibilities> ret = make_shared<cachedPossibilities>();
+
+  // This check is very fast, and it tells us if the composition itself is
+  // the problem
+  if (!SpgFeasibility::isSpgPossible(spg, atoms)) {
+    ret->status = noPossibilitiesForComposition;
+    ret->possibilities = systemPossibilities(spg);
+    return ret;
+  }
+
+  // The constraints prune the search instead of filtering the results
+  wyckConstraints constraints;
+  constraints.forceMostGeneralWyckPos = forceMostGeneralWyckPos;
+  constraints.forcedWyckAssignments = forcedWyckAssignments;
+  ret->forcedWyckAssignments = forcedWyckAssignments;
+  ret->possibilities = findOrLoadPossibilities(spg, atoms, constraints,
+                                               deadline);
+  if (ret->possibilities.size() != 0) return ret;
+
+  // Find out which constraint was the problem
+  if (!forceMostGeneralWyckPos) {
+    ret->status = noPossibilitiesWithForcedWyckPos;
+  }
+  else if (forcedWyckAssignments.empty()) {
+    ret->status = noPossibilitiesWithGeneralWyckPos;
+  }
+  else {
+    wyckConstraints generalOnly;
+    generalOnly.forceMostGeneralWyckPos = true;
+    if (findOrLoadPossibilities(spg, atoms, generalOnly, deadline).size() == 0)
+      ret->status = noPossibilitiesWithGeneralWyckPos;
+    else
+      ret->status = noPossibilitiesWithForcedWyckPos;
+  }
+  return ret;
+}
+
+shared_ptr<const WyckAssignmentSampler> cachedPossibilities::getSampler(
+  const wyckSamplingOptions& options) const
+{
+  string key = WyckAssignmentSampler::getKey(options);
+  lock_guard<mutex> lock(m_samplerMutex);
+  shared_ptr<const WyckAssignmentSampler>& sampler = m_samplers[key];
+  if (!sampler) {
+    vector<pair<uint, wyckPos>> forcedWyckPositions;
+    for (size_t i = 0; i < forcedWyckAssignments.size(); i++) {
+      forcedWyckPositions.push_back(make_pair(
+        forcedWyckAssignments[i].first,
+        RandSpg::getWyckPosFromWyckLet(possibilities.spg,
+                                       forcedWyckAssignments[i].second)));
+    }
+    sampler = make_shared<const WyckAssignmentSampler>(
+      possibilities, forcedWyckPositions, options);
+  }
+  return sampler;
+}
+
+// Remove the oldest entries until we are within the max size.
+// cacheMutex must be locked.
+static void trimCache()
+{
+  while (cacheEntries.size() > cacheMaxSize && !cacheInsertionOrder.empty()) {
+    const pair<string, uint64_t>& oldest = cacheInsertionOrder.front();
+    map<string, cacheEntry>::iterator it = cacheEntries.find(oldest.first);
+    if (it != cacheEntries.end() && it->second.generation == oldest.second)
+      cacheEntries.erase(it);
+    cacheInsertionOrder.pop_front();
+  }
+}
+
+string PossibilitiesCache::getKey(
+  uint spg, const vector<uint>& atoms, bool forceMostGeneralWyckPos,
+  const vector<pair<uint, char>>& forcedWyckAssignments)
+{
+  vector<uint> sortedAtoms = atoms;
+  sort(sortedAtoms.begin(), sortedAtoms.end());
+  vector<pair<uint, char>> sortedForced = forcedWyckAssignments;
+  sort(sortedForced.begin(), sortedForced.end());
+
+  // The composition is written as <atomicNum>x<count> pairs
+  stringstream s;
+  s << "spg=" << spg << ";atoms=";
+  for (size_t i = 0; i < sortedAtoms.size(); i++) {
+    size_t j = i;
+    while (j + 1 < sortedAtoms.size() && sortedAtoms[j + 1] == sortedAtoms[i])
+      j++;
+    s << sortedAtoms[i] << "x" << j - i + 1 << ",";
+    i = j;
+  }
+  s << ";general=" << (forceMostGeneralWyckPos ? 1 : 0) << ";forced=";
+  for (size_t i = 0; i < sortedForced.size(); i++)
+    s << sortedForced[i].first << sortedForced[i].second << ",";
+  return s.str();
+}
+
+shared_ptr<const cachedPossibilities> PossibilitiesCache::getPossibilities(
+  uint spg, const vector<uint>& atoms, bool forceMostGeneralWyckPos,
+  const vector<pair<uint, char>>& forcedWyckAssignments,
+  const RandSpgDeadline& deadline)
+{
+  // Sort the inputs so that the possibilities are the same no matter which
+  // caller happened to find them first
+  vector<uint> sortedAtoms = atoms;
+  sort(sortedAtoms.begin(), sortedAtoms.end());
+  vector<pair<uint, char>> sortedForced = forcedWyckAssignments;
+  sort(sortedForced.begin(), sortedForced.end());
+
+  string key = getKey(spg, sortedAtoms, forceMostGeneralWyckPos, sortedForced);
+
+  promise<cachedPtr> newEntry;
+  uint64_t generation = 0;
+  while (true) {
+    unique_lock<mutex> lock(cacheMutex);
+    if (cacheMaxSize == 0) {
+      lock.unlock();
+      return findPossibilities(spg, sortedAtoms, forceMostGeneralWyckPos,
+                               sortedForced, deadline);
+    }
+
+    map<string, cacheEntry>::const_iterator it = cacheEntries.find(key);
+    if (it != cacheEntries.end()) {
+      // Copy the future so we may wait on it without holding the lock
+      shared_future<cachedPtr> f = it->second.future;
+      lock.unlock();
+      // Wait in short steps, so that our deadline can stop us even if the
+      // caller that is finding them has no deadline
+      while (f.wait_for(chrono::milliseconds(10)) != future_status::ready) {
+        RandSpgDeadline::reason reason = deadline.check();
+        if (reason != RandSpgDeadline::notExpired)
+          throw RandSpgExpiredError(reason);
+      }
+      try {
+        return f.get();
+      }
+      catch (const RandSpgExpiredError&) {
+        // The deadline of the caller that was finding them expired, and its
+        // entry is gone. Look again unless ours expired too.
+        if (deadline.hasExpired()) throw;
+        continue;
+      }
+    }
+
+    generation = ++cacheGeneration;
+    cacheEntry& entry = cacheEntries[key];
+    entry.future = newEntry.get_future().share();
+    entry.generation = generation;
+    cacheInsertionOrder.push_back(make_pair(key, generation));
+    trimCache();
+    break;
+  }
+
+  // We are responsible for finding this one
+  cachedPtr ret;
+  try {
+    ret = findPossibilities(spg, sortedAtoms, forceMostGeneralWyckPos,
+                            sortedForced, deadline);
+  }
+  catch (...) {
+    // Don't keep the entry around, and then let anyone waiting on it know.
+    // It is removed first so that a waiter that looks again does not find
+    // it. It may already have been trimmed and replaced by another caller's
+    // entry, which is left alone. Its place in the insertion order is
+    // skipped.
+    {
+      lock_guard<mutex> lock(cacheMutex);
+      map<string, cacheEntry>::iterator it = cacheEntries.find(key);
+      if (it != cacheEntries.end() && it->second.generation == generation)
+        cacheEntries.erase(it);
+    }
+    newEntry.set_exception(current_exception());
+    throw;
+  }
+  newEntry.set_value(ret);
+  return ret;
+}
+
+void PossibilitiesCache::clear()
+{
+  lock_guard<mutex> lock(cacheMutex);
+  cacheEntries.clear();
+  cacheInsertionOrder.clear();
+}
+
+size_t PossibilitiesCache::size()
+{
+  lock_guard<mutex> lock(cacheMutex);
+  return cacheEntries.size();
+}
+
+void PossibilitiesCache::setMaxSize(size_t maxSize)
+{
+  lock_guard<mutex> lock(cacheMutex);
+  cacheMaxSize = maxSize;
+  trimCache();
+}
+
+size_t PossibilitiesCache::maxSize()
+{
+  lock_guard<mutex> lock(cacheMutex);
+  return cacheMaxSize;
+}
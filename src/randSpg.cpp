@@ -13,12 +13,14 @@
 
  ***********************************************************************/
 
-#include "elemInfo.h"
-
 #include "randSpg.h"
+#include "randSpgContext.h"
+#include "randSpgGenerator.h"
 #include "randSpgCombinatorics.h"
+#include "spgFeasibility.h"
 #include "wyckoffDatabase.h"
 #include "fillCellDatabase.h"
+#include "logWriter.h"
 #include "utilityFunctions.h"
 
 // For getRandDouble()
@@ -28,7 +30,6 @@
 #include "functionTracker.h"
 
 #include <cassert>
-#include <fstream>
 #include <tuple>
 #include <iostream>
 
@@ -45,20 +46,6 @@ using namespace std;
 string e_logfilename = "randSpg.log";
 char e_verbosity = 'r';
 
-// Check if all the multiplicities of a spacegroup are even
-static inline bool spgMultsAreAllEven(uint spg)
-{
-  START_FT;
-  wyckoffPositions wyckVector = RandSpg::getWyckoffPositions(spg);
-  // An error message should already be printed if this returns false
-  if (wyckVector.size() == 0) return false;
-
-  for (size_t i = 0; i < wyckVector.size(); i++) {
-    if (numIsOdd(RandSpg::getMultiplicity(wyckVector[i]))) return false;
-  }
-  return true;
-}
-
 vector<numAndType> RandSpg::getNumOfEachType(const vector<uint>& atoms)
 {
   START_FT;
@@ -253,7 +240,8 @@ inline unsigned char numVariablesInCoord(const string& coord)
 }
 
 bool RandSpg::addWyckoffAtomRandomly(Crystal& crystal, const wyckPos& position,
-                                     uint atomicNum, uint spg, int maxAttempts)
+                                     uint atomicNum, uint spg, int maxAttempts,
+                                     const RandSpgDeadline& deadline)
 {
   START_FT;
 #ifdef RANDSPG_WYCK_DEBUG
@@ -284,17 +272,28 @@ bool RandSpg::addWyckoffAtomRandomly(Crystal& crystal, const wyckPos& position,
       maxAttempts = 500;
   }
 
+  // The components are the same for every trial
+  vector<string> components = split(wyckCoords, ',');
+
+  // The trials add and remove atoms, which clears the asymmetric unit, so
+  // it is put back afterwards. It is only kept if it is known for all of
+  // the atoms that are already there.
+  vector<atomStruct> asymmetricUnit = crystal.getAsymmetricUnit();
+  bool keepAsymmetricUnit = (crystal.getAtoms().empty() ||
+                             crystal.getSpacegroup() == spg);
+
   int i = 0;
   bool success = false;
+  atomStruct newAtom;
   do {
+    if (deadline.hasExpired()) break;
+
     // Generate random coordinates in the wyckoff position
     // Numbers are between 0 and 1
     double x = getRandDouble(0,1);
     double y = getRandDouble(0,1);
     double z = getRandDouble(0,1);
 
-    vector<string> components = split(wyckCoords, ',');
-
     // Interpret the three components of the Wyckoff position coordinates...
     double newX = interpretComponent(components[0], x, y, z);
     double newY = interpretComponent(components[1], x, y, z);
@@ -304,10 +303,10 @@ bool RandSpg::addWyckoffAtomRandomly(Crystal& crystal, const wyckPos& position,
     if (newX == -1 || newY == -1 || newZ == -1) {
       cout << "addWyckoffAtomRandomly() failed due to a component not being "
            << "read successfully!\n";
-      return false;
+      break;
     }
 
-    atomStruct newAtom(atomicNum, newX, newY, newZ);
+    newAtom = atomStruct(atomicNum, newX, newY, newZ);
     crystal.addAtom(newAtom);
 
     // Check the interatomic distances
@@ -323,6 +322,13 @@ bool RandSpg::addWyckoffAtomRandomly(Crystal& crystal, const wyckPos& position,
     i++;
   } while (i < maxAttempts && !success);
 
+  if (keepAsymmetricUnit) {
+    crystal.setAsymmetricUnit(asymmetricUnit,
+                              asymmetricUnit.empty() ? 0 : spg);
+    // The atom we picked is the one the rest of this position is made from
+    if (success) crystal.addAsymmetricUnitAtom(newAtom, spg);
+  }
+
   if (!success) return false;
 
 #ifdef RANDSPG_WYCK_DEBUG
@@ -334,298 +340,44 @@ bool RandSpg::addWyckoffAtomRandomly(Crystal& crystal, const wyckPos& position,
   return true;
 }
 
-// This just converts the second element in the pair (the 'char') to a wyckPos
-static vector<pair<uint, wyckPos>>
-getModifiedForcedWyckVector(const vector<pair<uint, char>>& v, uint spg)
+Crystal RandSpg::randSpgCrystal(const randSpgInput& input)
 {
-  vector<pair<uint, wyckPos>> ret;
-  for (size_t i = 0; i < v.size(); i++)
-    ret.push_back(make_pair(v[i].first,
-                          RandSpg::getWyckPosFromWyckLet(spg, v[i].second)));
-  return ret;
+  return randSpgCrystal(input, make_shared<const RandSpgContext>(input));
 }
 
-// Convenience function for counting the number of times a forced Wyck
-// assignment is used and storing the information in a vector of tuples
-static vector<tuple<uint, char, uint>>
-getForcedWyckAssignmentsAndNumber(const vector<pair<uint, char>>& forcedWyckAssignments)
+Crystal RandSpg::randSpgCrystal(const randSpgInput& input,
+                                const shared_ptr<const RandSpgContext>& context)
 {
-  vector<pair<uint, char>> alreadyUsedForcedWyckAssignments;
-  // The tuple is as follows: <atomicNum, wyckLet, numTimesUsed>
-  vector<tuple<uint, char, uint>> forcedWyckAssignmentsAndNumber;
-  for (size_t i = 0; i < forcedWyckAssignments.size(); i++) {
-    // Check to see if we've already looked at this assignment
-    bool alreadyUsed = false;
-    for (size_t j = 0; j < alreadyUsedForcedWyckAssignments.size(); j++) {
-      if (forcedWyckAssignments[i] ==
-          alreadyUsedForcedWyckAssignments[j]) {
-        alreadyUsed = true;
-        break;
-      }
-    }
-    // If we've already looked at it, just continue
-    if (alreadyUsed) continue;
-    // Now count how many times we use this
-    uint numTimesUsed = 1;
-    for (size_t j = i + 1; j < forcedWyckAssignments.size(); j++) {
-      if (forcedWyckAssignments[i] == forcedWyckAssignments[j])
-        numTimesUsed++;
-    }
-    alreadyUsedForcedWyckAssignments.push_back(forcedWyckAssignments[i]);
-    forcedWyckAssignmentsAndNumber.push_back(make_tuple(
-      forcedWyckAssignments[i].first,
-      forcedWyckAssignments[i].second,
-      numTimesUsed));
-  }
-  return forcedWyckAssignmentsAndNumber;
+  randSpgStatus status;
+  return randSpgCrystal(input, context, status);
 }
 
-Crystal createValidCrystal(uint spg, const latticeStruct& latticeMins,
-                           const latticeStruct& latticeMaxes,
-                           double minVolume, double maxVolume)
+Crystal RandSpg::randSpgCrystal(const randSpgInput& input,
+                                const shared_ptr<const RandSpgContext>& context,
+                                randSpgStatus& status)
 {
-  Crystal ret;
-  // If we fail to do this 1000 times, return an empty crystal
-  size_t maxAttempts = 1000;
-  size_t numAttempts = 0;
-  bool validCrystal = false;
-  while (maxAttempts > numAttempts && !validCrystal) {
-    numAttempts++;
-
-    // First let's get a lattice...
-    latticeStruct st = RandSpg::generateLatticeForSpg(spg, latticeMins, latticeMaxes);
-    Crystal crystal(st);
-
-    // Make sure it's a valid lattice
-    if (st.a == 0 || st.b == 0 || st.c == 0 ||
-        st.alpha == 0 || st.beta == 0 || st.gamma == 0) {
-      cout << "Error in RandSpg::createValidCrystal(): an invalid lattice was "
-           << "generated.\n";
-      return Crystal();
-    }
-
-    // Rescale the volume of the crystal if necessary
-    if (maxVolume != -1 && crystal.getVolume() > maxVolume)
-      // Pick a random number between the min and max volume and rescale to it
-      crystal.rescaleVolume(getRandDouble(minVolume, maxVolume));
-    else if (minVolume != -1 && crystal.getVolume() < minVolume)
-      crystal.rescaleVolume(getRandDouble(minVolume, maxVolume));
-
-    // After rescaling, check again to make sure a, b, and c are within
-    // the correct limits
-    st = crystal.getLattice();
-    if (latticeMins.a <= st.a && st.a <= latticeMaxes.a &&
-        latticeMins.b <= st.b && st.b <= latticeMaxes.b &&
-        latticeMins.c <= st.c && st.c <= latticeMaxes.c) {
-      ret = crystal;
-      validCrystal = true;
-    }
-    // If the crystal is not valid, we'll try again
-  }
-
-  // If we get to the point without a valid crystal,
-  // we exceeded the max attempts
-  if (!validCrystal) {
-    cerr << "After " << maxAttempts
-         << " attempts, a valid crystal could not be made for "
-         << "spg '" << spg << "' and the given latticeMins, latticeMaxes, "
-         << "minVolume of '" << minVolume << "' and maxVolume of '"
-         << maxVolume << "'\n";
-    cerr << "Aborting this crystal.\n";
-    return Crystal();
-  }
-  return ret;
+  START_FT;
+  return RandSpgGenerator(input, context).generate(status);
 }
 
-Crystal RandSpg::randSpgCrystal(const randSpgInput& input)
+crystalBatch RandSpg::generateBatch(const randSpgInput& input, size_t n,
+                                    randSpgStatus& status)
 {
-  START_FT;
-
-  // Convenience: so we don't have to say 'input.<option>' for every call
-  uint spg                                                      = input.spg;
-  const vector<uint>& atoms                                     = input.atoms;
-  const latticeStruct& latticeMins                              = input.latticeMins;
-  const latticeStruct& latticeMaxes                             = input.latticeMaxes;
-  double IADScalingFactor                                       = input.IADScalingFactor;
-  double minRadius                                              = input.minRadius;
-  const std::vector<std::pair<uint, double>>& manualAtomicRadii = input.manualAtomicRadii;
-  const std::vector<std::pair<std::pair<uint, uint>, double>>& customMinIADs = input.customMinIADs;
-  double minVolume                                              = input.minVolume;
-  double maxVolume                                              = input.maxVolume;
-  vector<pair<uint, char>> forcedWyckAssignments                = input.forcedWyckAssignments;
-  char verbosity                                                = input.verbosity;
-  int numAttempts                                               = input.maxAttempts;
-  bool forceMostGeneralWyckPos                                  = input.forceMostGeneralWyckPos;
-
-  // Change the atomic radii as necessary
-  ElemInfo::applyScalingFactor(IADScalingFactor);
-
-  // Set the min radius
-  ElemInfo::setMinRadius(minRadius);
-
-  // Set some explicit radii
-  for (size_t i = 0; i < manualAtomicRadii.size(); i++) {
-    uint atomicNum = manualAtomicRadii[i].first;
-    double rad = manualAtomicRadii[i].second;
-    ElemInfo::setRadius(atomicNum, rad);
-  }
-
-  // Set the custom minIADs
-  // Clear any previous runs first
-  ElemInfo::clearCustomMinIADs();
-  for (size_t i = 0; i < customMinIADs.size(); ++i) {
-    uint atomicNum1 = customMinIADs[i].first.first;
-    uint atomicNum2 = customMinIADs[i].first.second;
-    double minIAD = customMinIADs[i].second;
-    ElemInfo::appendCustomMinIAD(atomicNum1, atomicNum2, minIAD);
-  }
-
-  systemPossibilities possibilities = RandSpgCombinatorics::getSystemPossibilities(spg, atoms);
-
-  if (possibilities.size() == 0) {
-    cout << "Error in RandSpg::" << __FUNCTION__ << "(): this spg '" << spg
-         << "' cannot be generated with this composition\n";
-    return Crystal();
-  }
-
-  // force the most general Wyckoff position to be used at least once?
-  if (forceMostGeneralWyckPos)
-    possibilities = RandSpgCombinatorics::removePossibilitiesWithoutGeneralWyckPos(possibilities, spg);
-
-  if (possibilities.size() == 0) {
-    cout << "Error in RandSpg::" << __FUNCTION__ << "(): this spg '" << spg
-         << "' cannot be generated with this composition.\n";
-    cout << "It can be generated if option 'forceMostGeneralWyckPos' is "
-         << "turned off, but the correct spacegroup will not be guaranteed.\n";
-    return Crystal();
-  }
-
-  // The tuple is as follows: <atomicNum, wyckLet, numTimesUsed>
-  vector<tuple<uint, char, uint>> forcedWyckAssignmentsAndNumber = getForcedWyckAssignmentsAndNumber(forcedWyckAssignments);
-
-  for (size_t i = 0; i < forcedWyckAssignmentsAndNumber.size(); i++) {
-    possibilities =
-      RandSpgCombinatorics::removePossibilitiesWithoutWyckPos(possibilities,
-                  get<1>(forcedWyckAssignmentsAndNumber[i]),
-                  get<2>(forcedWyckAssignmentsAndNumber[i]),
-                  get<0>(forcedWyckAssignmentsAndNumber[i]));
-  }
-
-  if (possibilities.size() == 0) {
-    cout << "Error in RandSpg::" << __FUNCTION__ << "(): this spg '" << spg
-         << "' cannot be generated with this composition due to the forced "
-         << "Wyckoff position constraints.\nPlease change them or remove them "
-         << "if you wish to generate the space group.\n";
-    return Crystal();
-  }
-
-  //RandSpgCombinatorics::printSystemPossibilities(possibilities);
-  // If we desire verbose output, print the system possibility to the log file
-  if (verbosity == 'v')
-    appendToLogFile(RandSpgCombinatorics::getVerbosePossibilitiesString(possibilities));
-
-  // Create a modified forced wyck vector for later...
-  vector<pair<uint, wyckPos>> modifiedForcedWyckVector = getModifiedForcedWyckVector(forcedWyckAssignments, spg);
-
-  // Begin the attempt loop!
-  for (size_t i = 0; i < numAttempts; i++) {
-
-    Crystal crystal = createValidCrystal(spg, latticeMins, latticeMaxes,
-                                         minVolume, maxVolume);
-
-    // Now, let's assign some atoms!
-    atomAssignments assignments = RandSpgCombinatorics::getRandomAtomAssignments(possibilities, modifiedForcedWyckVector);
-
-    //printAtomAssignments(assignments);
-    // If we desire any output, print the atom assignments to the log file
-    if (verbosity == 'r' || verbosity == 'v')
-      appendToLogFile(getAtomAssignmentsString(assignments));
-
-    if (assignments.size() == 0) {
-      cout << "Error in RandSpg::randSpgXtal(): atoms were not successfully"
-           << " assigned positions in assignAtomsToWyckPos()\n";
-      continue;
-    }
-
-#ifdef RANDSPG_DEBUG
-    cout << "\natomAssignments are the following (atomicNum, wyckLet, wyckPos):"
-         << "\n";
-    for (size_t j = 0; j < assignments.size(); j++)
-      cout << "  " << assignments[j].second << ", "
-           << getWyckLet(assignments[j].first)
-           << ", " << getWyckCoords(assignments[j].first) << "\n";
-    cout << "\n";
-#endif
-
-    bool assignmentsSuccessful = true;
-    for (size_t j = 0; j < assignments.size(); j++) {
-      const wyckPos& pos = assignments[j].first;
-      uint atomicNum = assignments[j].second;
-      if (!addWyckoffAtomRandomly(crystal, pos, atomicNum, spg)) {
-        assignmentsSuccessful = false;
-        break;
-      }
-    }
-
-    // If we succeeded, and the number of atoms match, return the crystal!
-    // There are rare cases where an atom may be placed on top of another
-    // one and the essentially get merged into one. We check to make sure the
-    // sizes of the atomic numbers match for this reason. We shouldn't have to
-    // worry about types.
-    if (assignmentsSuccessful &&
-        atoms.size() == crystal.getVectorOfAtomicNums().size()) {
-      if (verbosity != 'n') appendToLogFile("*** Success! ***\n");
-      return crystal;
-    }
-    else {
-      if (verbosity == 'r' || verbosity == 'v') {
-        stringstream ss;
-        ss << "Failed to add atoms to satisfy MinIAD.\nObtaining new atom "
-           << "assignments and trying again. Failure count: " << i + 1 << "\n\n";
-        appendToLogFile(ss.str());
-      }
-      continue;
-    }
-  }
+  return RandSpgGenerator(input).generateBatch(n, status);
+}
 
-  // If we made it here, we failed to generate the crystal
-  stringstream errMsg;
-  errMsg << "After " << numAttempts << " attempts: failed to generate "
-         << "a crystal of spg " << spg << ".\n";
-  if (verbosity != 'n') appendToLogFile(errMsg.str());
-  cerr << errMsg.str();
-  return Crystal();
+crystalBatch RandSpg::generateBatch(const randSpgInput& input, size_t n)
+{
+  randSpgStatus status;
+  return generateBatch(input, n, status);
 }
 
 bool RandSpg::isSpgPossible(uint spg, const vector<uint>& atoms)
 {
   START_FT;
-
-  if (spg < 1 || spg > 230) return false;
-
-  // Add in a test here to shorten the time checking if a spg is possible
-  // If a spacegroup contains all even number multiplicities (many do),
-  // and there is an atom with an odd amount, then that spacegroup is not
-  // not possible
-  vector<numAndType> numOfEachType = getNumOfEachType(atoms);
-  bool containsOdd = false;
-  for (size_t i = 0; i < numOfEachType.size(); i++) {
-    if (numIsOdd(numOfEachType[i].first)) {
-      containsOdd = true;
-      break;
-    }
-  }
-
-  if (containsOdd && spgMultsAreAllEven(spg)) return false;
-
-  // If the test failed, we must just try to assign atoms and see if it works
-  // The third boolean parameter is telling it to find only one combination
-  // This speeds it up significantly
-  if (RandSpgCombinatorics::getSystemPossibilities(spg, atoms,
-                                                   true, false).size() == 0)
-    return false;
-
-  return true;
+  // This uses precomputed multiplicity info for each spacegroup instead of
+  // searching for a combination of Wyckoff positions
+  return SpgFeasibility::isSpgPossible(spg, atoms);
 }
 
 template <typename T>
@@ -885,13 +637,15 @@ latticeStruct RandSpg::generateLatticeForSpg(uint spg,
 
 string RandSpg::getAtomAssignmentsString(const atomAssignments& a)
 {
-  stringstream s;
-  s << "printing atom assignments:\n";
-  s << "Atomic num : Wyckoff letter\n";
+  // This is made for every attempt, so it is built without a stringstream
+  string s = "printing atom assignments:\nAtomic num : Wyckoff letter\n";
   for (size_t i = 0; i < a.size(); i++) {
-    s << a[i].second << " : " << getWyckLet(a[i].first) << "\n";
+    s += to_string(a[i].second);
+    s += " : ";
+    s += getWyckLet(a[i].first);
+    s += '\n';
   }
-  return s.str();
+  return s;
 }
 
 void RandSpg::printAtomAssignments(const atomAssignments& a)
@@ -902,16 +656,5 @@ void RandSpg::printAtomAssignments(const atomAssignments& a)
 // The name of the log file is available in the header as an extern
 void RandSpg::appendToLogFile(const std::string& text)
 {
-  fstream fs;
-  fs.open(e_logfilename, std::fstream::out | std::fstream::app);
-
-  if (!fs.is_open()) {
-    cout << "Error opening log file, " << e_logfilename << ".\n"
-         << "The program will keep running, but log info will not be written.\n";
-    return;
-  }
-
-  fs << text;
-
-  fs.close();
+  LogWriter::forFile(e_logfilename).append(text);
 }
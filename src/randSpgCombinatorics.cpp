@@ -14,12 +14,18 @@
 
  ***********************************************************************/
 
+#include <algorithm>
+#include <cassert>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <sstream>
 
 #include "rng.h"
 #include "randSpg.h"
 #include "randSpgCombinatorics.h"
+#include "threadPool.h"
+#include "wyckAssignmentSampler.h"
 #include "wyckPosTrackingInfo.h"
 
 // For FunctionTracker
@@ -38,6 +44,8 @@ struct combinationSettings {
   uint numAtoms;
   bool findOnlyOne;
   bool findOnlyNonUnique;
+  // The search throws a RandSpgExpiredError when this expires
+  RandSpgDeadline deadline;
   combinationSettings() :
     numAtoms(0),
     findOnlyOne(false),
@@ -52,63 +60,119 @@ struct combinationSettings {
 
 typedef std::vector<WyckPosTrackingInfo> usageTracker;
 
+// The assignments for a single atom type. This is what
+// findAllCombinations() throws when it is only looking for one.
+typedef std::vector<similarWyckPosAndNumToChoose> assignments;
+
+// Searches for at least this many atoms are split into pieces that are run
+// on the thread pool. Smaller searches take well under a millisecond.
+static const uint parallelSearchMinAtoms = 64;
+
+// The deadline of a search is checked once every this many steps, since
+// reading the clock costs more than a step does
+static const uint deadlineCheckInterval = 4096;
+
+static wyckGroupTable wyckGroupTables[231];
+static once_flag wyckGroupTableFlags[231];
+
 #ifdef PRINT_RAND_SPG_COMB_DEBUG
-static inline void printSingleAtomPossibility(const singleAtomPossibility&
-                                              possib)
+static inline void printAtomAssignments(const atomAssignments& assigns)
 {
-  cout << "   singleAtomPossibility is:\n";
-  for (size_t i = 0; i < possib.size(); i++)
-    cout << "    " << RandSpg::getWyckLet(possib[i]) << "\n";
+  cout << "Printing atom assignments!\n";
+  for (size_t i = 0; i < assigns.size(); i++) {
+    cout << "  atomicNum is '" << assigns[i].second << "' and wyckLet is '"
+         << RandSpg::getWyckLet(assigns[i].first) << "'.\n";
+  }
+  cout << "\n\n";
 }
+#endif
 
-static inline void printSingleAtomPossibilities(const singleAtomPossibilities&
-                                                possibs)
+int wyckGroupTable::getPositionIndex(char wyckLet) const
 {
-  cout << "Printing single atom possibilities!\n";
-  for (size_t i = 0; i < possibs.size(); i++) {
-    cout << " at i == " << i << ":\n";
-    printSingleAtomPossibility(possibs[i]);
+  const wyckoffPositions& wyckVec = RandSpg::getWyckoffPositions(spg);
+  for (size_t i = 0; i < wyckVec.size(); i++) {
+    if (RandSpg::getWyckLet(wyckVec[i]) == wyckLet) return i;
   }
-  cout << "\n\n";
+  return -1;
 }
 
-static inline void printSystemPossibility(const systemPossibility& possib)
+void systemPossibilities::appendPossibility(const systemPossibilities& other,
+                                            size_t i)
 {
-  cout << " Printing system possibility\n";
-  for (size_t i = 0; i < possib.size(); i++) {
-    cout << "  at i == " << i << ":\n";
-    cout << "   atomic num is " << possib[i].first << "\n";
-    printSingleAtomPossibility(possib[i].second);
+  for (size_t t = 0; t < other.numTypes(); t++) {
+    assigns.insert(assigns.end(), other.assignsBegin(i, t),
+                   other.assignsEnd(i, t));
+    endType();
   }
+  endPossibility(other.uniqueUsages[i]);
 }
 
-static inline void printSystemPossibilities(const systemPossibilities& possib)
+// For the purposes of the group table, we need the grouped
+// Wyckoff positions to have the same multiplicity and uniqueness
+static inline bool wyckPositionsAreSimilar(const wyckPos& wyckPos1,
+                                           const wyckPos& wyckPos2)
 {
-  cout << "Printing system possibilities\n";
-  for (size_t i = 0; i < possib.size(); i++) {
-    printSystemPossibility(possib[i]);
-  }
-  cout << "\n\n";
+  if (RandSpg::containsUniquePosition(wyckPos1) ==
+      RandSpg::containsUniquePosition(wyckPos2) &&
+      RandSpg::getMultiplicity(wyckPos1) ==
+      RandSpg::getMultiplicity(wyckPos2)) return true;
+  return false;
 }
 
-static inline void printAtomAssignments(const atomAssignments& assigns)
+// Groups similar Wyckoff positions together. The groups are in the order
+// of the first position in each of them.
+static void buildWyckGroupTable(uint spg)
 {
-  cout << "Printing atom assignments!\n";
-  for (size_t i = 0; i < assigns.size(); i++) {
-    cout << "  atomicNum is '" << assigns[i].second << "' and wyckLet is '"
-         << RandSpg::getWyckLet(assigns[i].first) << "'.\n";
+  wyckGroupTable& table = wyckGroupTables[spg];
+  table.spg = spg;
+  const wyckoffPositions& wyckVec = RandSpg::getWyckoffPositions(spg);
+
+  // 255 means it has not been added to a group yet
+  table.groupOfPosition.assign(wyckVec.size(), 255);
+  table.groupOffsets.push_back(0);
+  for (size_t i = 0; i < wyckVec.size(); i++) {
+    // If we've already used this one, don't include it
+    if (table.groupOfPosition[i] != 255) continue;
+    uint8_t group = table.multiplicities.size();
+    table.multiplicities.push_back(RandSpg::getMultiplicity(wyckVec[i]));
+    table.unique.push_back(RandSpg::containsUniquePosition(wyckVec[i]));
+    // Add on similar positions
+    for (size_t j = i; j < wyckVec.size(); j++) {
+      if (table.groupOfPosition[j] == 255 &&
+          wyckPositionsAreSimilar(wyckVec[i], wyckVec[j])) {
+        table.groupOfPosition[j] = group;
+        table.positionIndices.push_back(j);
+      }
+    }
+    table.groupOffsets.push_back(table.positionIndices.size());
   }
-  cout << "\n\n";
+
+  // Give each unique group a field in the packed usage. A field of 'k'
+  // bits with a bias of 2^k - 1 - numPositions overflows into the guard bit
+  // exactly when more than numPositions are used.
+  table.uniqueShifts.assign(table.numGroups(), 0);
+  table.uniqueBias = 0;
+  table.uniqueGuardMask = 0;
+  uint shift = 0;
+  for (size_t g = 0; g < table.numGroups(); g++) {
+    if (!table.unique[g]) continue;
+    uint numPositions = table.numPositionsInGroup(g);
+    uint k = 1;
+    while ((1u << k) - 1 < numPositions) k++;
+    table.uniqueShifts[g] = shift;
+    table.uniqueBias |= static_cast<uint64_t>((1u << k) - 1 - numPositions)
+                        << shift;
+    table.uniqueGuardMask |= static_cast<uint64_t>(1) << (shift + k);
+    shift += k + 1;
+  }
+  // The largest spacegroup needs 9 bits
+  assert(shift <= 64);
 }
-#endif
 
-template<typename T>
-static bool vecContains(const vector<T>& vec, const T& element)
+const wyckGroupTable& RandSpgCombinatorics::getWyckGroupTable(uint spg)
 {
-  for (size_t i = 0; i < vec.size(); i++) {
-    if (vec[i] == element) return true;
-  }
-  return false;
+  call_once(wyckGroupTableFlags[spg], buildWyckGroupTable, spg);
+  return wyckGroupTables[spg];
 }
 
 static inline uint getNumAtomsUsed(const usageTracker& tracker)
@@ -135,6 +199,18 @@ static inline uint getNumAtomsLeft(const usageTracker& tracker, uint numAtoms)
   return numAtomsLeft;
 }
 
+// The number of atoms that are still needed to satisfy the minimum uses
+static inline uint getNumAtomsRequired(const usageTracker& tracker)
+{
+  uint sum = 0;
+  for (size_t i = 0; i < tracker.size(); i++) {
+    if (tracker[i].numTimesUsed < tracker[i].minNumUses)
+      sum += tracker[i].multiplicity *
+             (tracker[i].minNumUses - tracker[i].numTimesUsed);
+  }
+  return sum;
+}
+
 static inline bool positionIsUsable(const WyckPosTrackingInfo& info,
                                     uint numAtomsLeft, bool findOnlyNonUnique)
 {
@@ -154,198 +230,156 @@ static inline bool positionIsUsable(const WyckPosTrackingInfo& info,
   return false;
 }
 
-static inline singleAtomPossibility
-convertToPossibility(const usageTracker& tempTracker, uint atomicNum)
+static inline assignments convertToAssignments(const usageTracker& tempTracker)
 {
-  singleAtomPossibility poss;
-  poss.atomicNum = atomicNum;
+  assignments ret;
   for (size_t i = 0; i < tempTracker.size(); i++) {
     const WyckPosTrackingInfo& info = tempTracker[i];
     if (info.numTimesUsed == 0) continue;
 
     similarWyckPosAndNumToChoose temp;
     temp.numToChoose = info.numTimesUsed;
-    temp.choosablePositions = info.getPositions();
-    poss.assigns.push_back(temp);
+    temp.group = info.group;
+    ret.push_back(temp);
   }
-  return poss;
+  return ret;
 }
 
-// For the purposes of 'groupSimilarWyckPositions()', we need the grouped
-// Wyckoff positions to have the same multiplicity and uniqueness
-static inline bool wyckPositionsAreSimilar(const wyckPos& wyckPos1,
-                                           const wyckPos& wyckPos2)
+static inline void appendAssignments(singleAtomPossibilities& appendVec,
+                                     const assignments& assigns)
 {
-  if (RandSpg::containsUniquePosition(wyckPos1) ==
-      RandSpg::containsUniquePosition(wyckPos2) &&
-      RandSpg::getMultiplicity(wyckPos1) ==
-      RandSpg::getMultiplicity(wyckPos2)) return true;
-  return false;
+  const wyckGroupTable& table =
+    RandSpgCombinatorics::getWyckGroupTable(appendVec.spg);
+  uint64_t usage = 0;
+  for (size_t i = 0; i < assigns.size(); i++)
+    usage += table.uniqueUsage(assigns[i].group, assigns[i].numToChoose);
+
+  appendVec.assigns.insert(appendVec.assigns.end(), assigns.begin(),
+                           assigns.end());
+  appendVec.endType();
+  appendVec.endPossibility(usage);
 }
 
-// Takes a Wyckoff vector and groups similar Wyckoff positions together
-// Stores the similar Wyckoff positions as a vector
-static vector<vector<wyckPos>> groupSimilarWyckPositions(
-                                               const wyckoffPositions& wyckVec)
-{
-  vector<char> wyckPositionsUsed;
-  vector<vector<wyckPos>> ret;
-  for (size_t i = 0; i < wyckVec.size(); i++) {
-    const wyckPos& pos_i = wyckVec[i];
-    char wyckLet = RandSpg::getWyckLet(pos_i);
-    // If we've already used this one, don't include it
-    if (!vecContains<char>(wyckPositionsUsed, wyckLet)) {
-      wyckPositionsUsed.push_back(wyckLet);
-      vector<wyckPos> tempVec;
-      tempVec.push_back(pos_i);
-      // Add on similar positions
-      for (size_t j = i + 1; j < wyckVec.size(); j++) {
-        const wyckPos& pos_j = wyckVec[j];
-        char wyckLet_j = RandSpg::getWyckLet(pos_j);
-        // wyckPositionsUsed should not contain the character, but check
-        // just in case
-        if (wyckPositionsAreSimilar(pos_i, pos_j) &&
-            !vecContains<char>(wyckPositionsUsed, wyckLet_j)) {
-          wyckPositionsUsed.push_back(wyckLet_j);
-          tempVec.push_back(pos_j);
-        }
-      }
-      ret.push_back(tempVec);
-    }
-  }
-  return ret;
-}
-
-// Create a basic usage tracker from the wyckoff positions
-static usageTracker createUsageTracker(const wyckoffPositions& wyckVec)
+// Create a basic usage tracker from the group table
+static usageTracker createUsageTracker(const wyckGroupTable& table)
 {
   usageTracker tracker;
-  tracker.reserve(wyckVec.size());
-  vector<vector<wyckPos>> similarWyckPos = groupSimilarWyckPositions(wyckVec);
-  for (size_t i = 0; i < similarWyckPos.size(); i++) {
-    WyckPosTrackingInfo info(similarWyckPos[i]);
-    tracker.push_back(info);
-  }
+  tracker.reserve(table.numGroups());
+  for (size_t i = 0; i < table.numGroups(); i++)
+    tracker.push_back(WyckPosTrackingInfo(table, i));
   return tracker;
 }
 
-static inline usageTracker createUsageTracker(uint spg)
+// Does type 't' of possibility 'i' use the group?
+static inline bool usesGroup(const systemPossibilities& poss, size_t i,
+                             size_t t, int group)
 {
-  return createUsageTracker(RandSpg::getWyckoffPositions(spg));
-}
-
-// Checks to see if the Wyckoff positions in a similar wyckoff vector
-// are unique or not
-static inline bool similarWyckPosAndNumToChooseIsUnique(const similarWyckPosAndNumToChoose& s)
-{
-  if (s.choosablePositions.size() == 0) return false;
-  return RandSpg::containsUniquePosition(s.choosablePositions[0]);
-}
-
-// Check to make sure we don't use more unique positions than are available
-// in a single atom possibility
-static inline bool moreUniquePositionsUsedThanAvailable(const singleAtomPossibility& poss)
-{
-  const assignments& assigns = poss.assigns;
-  for (size_t i = 0; i < assigns.size(); i++) {
-    // Check to see if our similar Wyck positions are unique
-    if (similarWyckPosAndNumToChooseIsUnique(assigns[i])) {
-      // If they are, find the number to choose and the number available
-      uint numToChoose = assigns[i].numToChoose;
-      uint numAvailable = assigns[i].choosablePositions.size();
-      // If we have to choose more than we have available, return true
-      if (numToChoose > numAvailable) return true;
-    }
+  for (const similarWyckPosAndNumToChoose* it = poss.assignsBegin(i, t);
+       it != poss.assignsEnd(i, t); ++it) {
+    if (it->group == group) return true;
   }
   return false;
 }
 
-static inline uint numTimesAPositionIsUsed(const singleAtomPossibility& sPoss,
-                                           const similarWyckPositions& simPos)
+// Throw a RandSpgExpiredError if the deadline expired. Only every
+// 'deadlineCheckInterval'th call on a thread looks at it.
+static inline void checkDeadline(const RandSpgDeadline& deadline)
 {
-  uint numTimesUsed = 0;
-  for (size_t i = 0; i < sPoss.assigns.size(); i++) {
-    if (sPoss.assigns[i].choosablePositions == simPos) {
-      numTimesUsed += sPoss.assigns[i].numToChoose;
-    }
-  }
-  return numTimesUsed;
-}
-
-// This should only be called to compare Wyckoff positions generated
-// from the same spacegroup
-// This assumes
-static inline bool tooManyOfAUniquePositionUsed(const systemPossibility& s)
-{
-  for (size_t i = 0; i < s.size(); i++) {
-    // Check to make sure the single atom possibility doesn't use
-    // too many unique positions
-    if (moreUniquePositionsUsedThanAvailable(s[i])) return true;
-    const assignments& assigns = s[i].assigns;
-    for (size_t j = 0; j < assigns.size(); j++) {
-      const similarWyckPosAndNumToChoose& simPos = assigns[j];
-      if (similarWyckPosAndNumToChooseIsUnique(simPos)) {
-        uint numTimesUsed = simPos.numToChoose;
-        // We need to loop through the other system possibilities and count the
-        // number of times each one of them uses this position
-        for (size_t k = i + 1; k < s.size(); k++) {
-          numTimesUsed += numTimesAPositionIsUsed(s[k], simPos.choosablePositions);
-        }
-        // If, in total, we used too many of a unique position, return true
-        if (numTimesUsed > simPos.choosablePositions.size()) return true;
-      }
-    }
-  }
-  return false;
+  static thread_local uint numCalls = 0;
+  if (++numCalls % deadlineCheckInterval != 0) return;
+  RandSpgDeadline::reason reason = deadline.check();
+  if (reason != RandSpgDeadline::notExpired) throw RandSpgExpiredError(reason);
 }
 
+// Join the single atom possibilities with every system possibility.
+// If 'generalGroup' is not -1, the results must use that group at least
+// once. If none of the types after this one can use it, results that
+// don't use it yet are dropped right away.
 systemPossibilities joinSingleWithSystem(const singleAtomPossibilities& saPoss,
-                                         const systemPossibilities& sysPoss)
+                                         const systemPossibilities& sysPoss,
+                                         int generalGroup = -1,
+                                         bool laterTypesCanUseGroup = true,
+                                         const RandSpgDeadline& deadline =
+                                           RandSpgDeadline())
 {
   START_FT;
-  systemPossibilities newSysPossibilities;
-
-  // If sysPoss is empty, then our job is easy
-  if (sysPoss.size() == 0) {
-    for (size_t i = 0; i < saPoss.size(); i++) {
-      systemPossibility tempSysPossibility;
-      tempSysPossibility.push_back(saPoss[i]);
-      // We're assuming the single atom possibility has already been
-      // checked internally for uniqueness violations
-      newSysPossibilities.push_back(tempSysPossibility);
+  bool checkGroup = (generalGroup != -1 && !laterTypesCanUseGroup);
+
+  // If sysPoss has no types yet, then our job is easy
+  // We're assuming the single atom possibilities have already been
+  // checked internally for uniqueness violations
+  if (sysPoss.numTypes() == 0) {
+    if (!checkGroup) return saPoss;
+    systemPossibilities ret(saPoss.spg);
+    ret.atomicNums = saPoss.atomicNums;
+    for (size_t j = 0; j < saPoss.size(); j++) {
+      if (usesGroup(saPoss, j, 0, generalGroup))
+        ret.appendPossibility(saPoss, j);
     }
-    return newSysPossibilities;
+    return ret;
+  }
+
+  const wyckGroupTable& table =
+    RandSpgCombinatorics::getWyckGroupTable(sysPoss.spg);
+
+  systemPossibilities newSysPossibilities(sysPoss.spg);
+  newSysPossibilities.atomicNums = sysPoss.atomicNums;
+  newSysPossibilities.atomicNums.push_back(saPoss.atomicNums[0]);
+
+  // Which single atom possibilities use the group
+  vector<bool> saUsesGroup(saPoss.size(), false);
+  if (checkGroup) {
+    for (size_t j = 0; j < saPoss.size(); j++)
+      saUsesGroup[j] = usesGroup(saPoss, j, 0, generalGroup);
   }
 
   // We're going to add a single atom possibilities to all of the system
   // possibilities
   for (size_t i = 0; i < sysPoss.size(); i++) {
+    checkDeadline(deadline);
+    uint64_t sysUsage = sysPoss.uniqueUsages[i];
+    bool sysUsesGroup = false;
+    if (checkGroup) {
+      for (size_t t = 0; t < sysPoss.numTypes() && !sysUsesGroup; t++)
+        sysUsesGroup = usesGroup(sysPoss, i, t, generalGroup);
+    }
+
     for (size_t j = 0; j < saPoss.size(); j++) {
-      systemPossibility tempSysPoss = sysPoss[i];
-      // Add this to the system possibility
-      tempSysPoss.push_back(saPoss[j]);
+      // Nothing left can use the group, so this one never will
+      if (checkGroup && !sysUsesGroup && !saUsesGroup[j]) continue;
+      uint64_t saUsage = saPoss.uniqueUsages[j];
       // Only add it if too many of a unique position is NOT used
       // If it violates the uniqueness rule, we can't use it
-      if (!tooManyOfAUniquePositionUsed(tempSysPoss))
-        newSysPossibilities.push_back(tempSysPoss);
+      if (!table.uniqueUsagesFit(sysUsage, saUsage)) continue;
+      for (size_t t = 0; t < sysPoss.numTypes(); t++) {
+        newSysPossibilities.assigns.insert(newSysPossibilities.assigns.end(),
+                                           sysPoss.assignsBegin(i, t),
+                                           sysPoss.assignsEnd(i, t));
+        newSysPossibilities.endType();
+      }
+      newSysPossibilities.assigns.insert(newSysPossibilities.assigns.end(),
+                                         saPoss.assignsBegin(j, 0),
+                                         saPoss.assignsEnd(j, 0));
+      newSysPossibilities.endType();
+      newSysPossibilities.endPossibility(sysUsage + saUsage);
     }
   }
   return newSysPossibilities;
 }
 
-// This will only throw if "findOnlyOne" is set to be true
-// If that is the case, it may throw a single atom possibility (the possibility
-// that it finds successfully)
+// This will only throw if "findOnlyOne" is set to be true or the deadline
+// expires. If "findOnlyOne" is set, it may throw the assignments (the
+// possibility that it finds successfully)
 // onlyNonUnique should typically be set to 'true' if findOnlyOne is true unless
 // we are looking for the last atom combination
 // This will ensure that a combination will be found
 static void findAllCombinations(singleAtomPossibilities& appendVec,
                                 usageTracker tracker,
-                                uint atomicNum,
                                 const combinationSettings& sets)
 {
   START_FT;
   if (sets.numAtoms == 0) return;
+  checkDeadline(sets.deadline);
 
   uint numAtomsLeft = getNumAtomsLeft(tracker, sets.numAtoms);
   // Returns -1 if no index is available
@@ -353,8 +387,7 @@ static void findAllCombinations(singleAtomPossibilities& appendVec,
 
   if (firstAvailableIndex == -1) return;
 
-  WyckPosTrackingInfo info = tracker[firstAvailableIndex];
-  size_t firstMultiplicity = info.multiplicity;
+  const WyckPosTrackingInfo& info = tracker[firstAvailableIndex];
 
   // Check to see if we can use the first available position ('again', if
   // it has already been used). Find all possible combinations while using it
@@ -363,27 +396,146 @@ static void findAllCombinations(singleAtomPossibilities& appendVec,
     usageTracker tempTracker = tracker;
     tempTracker[firstAvailableIndex].numTimesUsed += 1;
 
+    uint newNumAtomsLeft = getNumAtomsLeft(tempTracker, sets.numAtoms);
+    uint numAtomsRequired = getNumAtomsRequired(tempTracker);
     // If we have used all the atoms, append this possibility to the vector
-    if (getNumAtomsLeft(tempTracker, sets.numAtoms) == 0) {
-      // If we are to only find one, we are done. Easiest way to get out
-      // of here is to throw an exception and catch it on the outside.
-      if (sets.findOnlyOne) throw convertToPossibility(tempTracker, atomicNum);
-      appendVec.push_back(convertToPossibility(tempTracker, atomicNum));
+    // (if it uses every position as many times as it must)
+    if (newNumAtomsLeft == 0) {
+      if (numAtomsRequired == 0) {
+        // If we are to only find one, we are done. Easiest way to get out
+        // of here is to throw an exception and catch it on the outside.
+        if (sets.findOnlyOne) throw convertToAssignments(tempTracker);
+        appendAssignments(appendVec, convertToAssignments(tempTracker));
+      }
     }
 
-    // Otherwise, keep on checking for more possibilities!
-    else findAllCombinations(appendVec, tempTracker, atomicNum, sets);
+    // Otherwise, keep on checking for more possibilities if there are
+    // enough atoms left for the positions that must be used
+    else if (numAtomsRequired <= newNumAtomsLeft)
+      findAllCombinations(appendVec, tempTracker, sets);
   }
 
   // Find all possible combinations without using this position ('again', if
-  // it has already been used).
+  // it has already been used). We can't stop using it if it must be used
+  // more times.
+  if (info.numTimesUsed < info.minNumUses) return;
   tracker[firstAvailableIndex].keepUsing = false;
-  findAllCombinations(appendVec, tracker, atomicNum, sets);
+  findAllCombinations(appendVec, tracker, sets);
+}
+
+// A piece of the search for one atom type. It is either a set of
+// assignments that was found while splitting the search, or a subtree that
+// still needs to be searched.
+struct searchPiece {
+  bool finished;
+  assignments assigns;
+  usageTracker tracker;
+};
+
+// This follows the same path as findAllCombinations(), but it stops at
+// 'depth' and saves the subtrees instead of searching them. The pieces are
+// in the same order that findAllCombinations() would find them.
+static void splitSearch(vector<searchPiece>& pieces,
+                        usageTracker tracker,
+                        const combinationSettings& sets,
+                        uint depth)
+{
+  if (sets.numAtoms == 0) return;
+  if (getFirstAvailableIndex(tracker) == -1) return;
+
+  if (depth == 0) {
+    searchPiece piece;
+    piece.finished = false;
+    piece.tracker = tracker;
+    pieces.push_back(piece);
+    return;
+  }
+
+  uint numAtomsLeft = getNumAtomsLeft(tracker, sets.numAtoms);
+  int firstAvailableIndex = getFirstAvailableIndex(tracker);
+  const WyckPosTrackingInfo& info = tracker[firstAvailableIndex];
+
+  if (positionIsUsable(info, numAtomsLeft, sets.findOnlyNonUnique)) {
+    usageTracker tempTracker = tracker;
+    tempTracker[firstAvailableIndex].numTimesUsed += 1;
+
+    uint newNumAtomsLeft = getNumAtomsLeft(tempTracker, sets.numAtoms);
+    uint numAtomsRequired = getNumAtomsRequired(tempTracker);
+    if (newNumAtomsLeft == 0) {
+      if (numAtomsRequired == 0) {
+        searchPiece piece;
+        piece.finished = true;
+        piece.assigns = convertToAssignments(tempTracker);
+        pieces.push_back(piece);
+      }
+    }
+    else if (numAtomsRequired <= newNumAtomsLeft)
+      splitSearch(pieces, tempTracker, sets, depth - 1);
+  }
+
+  if (info.numTimesUsed < info.minNumUses) return;
+  tracker[firstAvailableIndex].keepUsing = false;
+  splitSearch(pieces, tracker, sets, depth - 1);
+}
+
+// Find all combinations for one atom type. Large searches are split into
+// subtrees that are searched on the thread pool. The results are the same,
+// and in the same order, as findAllCombinations().
+static singleAtomPossibilities findSingleAtomPossibilities(
+                                             uint spg,
+                                             uint atomicNum,
+                                             const usageTracker& tracker,
+                                             const combinationSettings& sets)
+{
+  START_FT;
+  singleAtomPossibilities ret(spg);
+  ret.atomicNums.push_back(atomicNum);
+
+  if (sets.numAtoms < parallelSearchMinAtoms ||
+      ThreadPool::global()->numThreads() < 2) {
+    findAllCombinations(ret, tracker, sets);
+    return ret;
+  }
+
+  shared_ptr<ThreadPool> pool = ThreadPool::global();
+
+  // Go deeper until there are enough subtrees to keep every thread busy
+  vector<searchPiece> pieces;
+  size_t targetNumSubtrees = 4 * pool->numThreads();
+  for (uint depth = 1; depth <= 32; depth++) {
+    pieces.clear();
+    splitSearch(pieces, tracker, sets, depth);
+    size_t numSubtrees = 0;
+    for (size_t i = 0; i < pieces.size(); i++)
+      if (!pieces[i].finished) numSubtrees++;
+    if (numSubtrees >= targetNumSubtrees || numSubtrees == 0) break;
+  }
+
+  vector<future<singleAtomPossibilities>> futures(pieces.size());
+  for (size_t i = 0; i < pieces.size(); i++) {
+    if (pieces[i].finished) continue;
+    usageTracker subtree = pieces[i].tracker;
+    futures[i] = pool->submit([spg, atomicNum, subtree, sets]() {
+      singleAtomPossibilities sub(spg);
+      sub.atomicNums.push_back(atomicNum);
+      findAllCombinations(sub, subtree, sets);
+      return sub;
+    });
+  }
+
+  for (size_t i = 0; i < pieces.size(); i++) {
+    if (pieces[i].finished) {
+      appendAssignments(ret, pieces[i].assigns);
+      continue;
+    }
+    singleAtomPossibilities sub = pool->wait(futures[i]);
+    for (size_t j = 0; j < sub.size(); j++) ret.appendPossibility(sub, j);
+  }
+  return ret;
 }
 
 static void findOnlyOneCombinationIfPossible(singleAtomPossibilities& appendVec,
                                              usageTracker tracker,
-                                             uint atomicNum,
                                              const combinationSettings& sets,
                                              bool finalAtom)
 {
@@ -403,18 +555,20 @@ static void findOnlyOneCombinationIfPossible(singleAtomPossibilities& appendVec,
     if (sets.findOnlyNonUnique); // Do nothing
     // If we are looking at the final atom, we may use a non unique setup
     else if (finalAtom) tempSets.findOnlyNonUnique = false;
-    findAllCombinations(appendVec, tracker, atomicNum, tempSets);
+    findAllCombinations(appendVec, tracker, tempSets);
     // If we can't find any, then proceed with the normal algorithm
     if (appendVec.size() == 0) {
       tempSets.findOnlyOne = false;
       tempSets.findOnlyNonUnique = sets.findOnlyNonUnique;
-      findAllCombinations(appendVec, tracker, atomicNum, tempSets);
+      findAllCombinations(appendVec, tracker, tempSets);
     }
   }
   // If we caught a possibility, then that's the one we're gonna use!
-  catch (singleAtomPossibility pos) {
-    appendVec.clear();
-    appendVec.push_back(pos);
+  catch (const assignments& assigns) {
+    appendVec.assigns.clear();
+    appendVec.offsets.resize(1);
+    appendVec.uniqueUsages.clear();
+    appendAssignments(appendVec, assigns);
   }
 }
 
@@ -425,40 +579,139 @@ RandSpgCombinatorics::getSystemPossibilities(uint spg,
                                              bool findOnlyOne,
                                              bool findOnlyNonUnique)
 {
-  START_FT;
-  vector<numAndType> numOfEachType = RandSpg::getNumOfEachType(atoms);
-
-  systemPossibilities sysPossibilities;
-  sysPossibilities.reserve(numOfEachType.size());
+  return getSystemPossibilities(spg, atoms, wyckConstraints(), findOnlyOne,
+                                findOnlyNonUnique, RandSpgDeadline());
+}
 
-  for (size_t i = 0; i < numOfEachType.size(); i++) {
+// Create the usage trackers for each type with the minimum number of uses
+// from the forced Wyckoff assignments. Returns false if the forced
+// assignments cannot be satisfied.
+static bool createConstrainedTrackers(vector<usageTracker>& trackers,
+                                      const wyckGroupTable& table,
+                                      const vector<numAndType>& numOfEachType,
+                                      const wyckConstraints& constraints)
+{
+  const vector<pair<uint, char>>& forced = constraints.forcedWyckAssignments;
+  trackers.assign(numOfEachType.size(), createUsageTracker(table));
+  for (size_t i = 0; i < forced.size(); i++) {
+    int posIndex = table.getPositionIndex(forced[i].second);
+    if (posIndex < 0) return false;
+    uint8_t group = table.groupOfPosition[posIndex];
+
+    // A unique position may only be forced once
+    if (table.unique[group]) {
+      for (size_t j = 0; j < i; j++) {
+        if (forced[j].second == forced[i].second) return false;
+      }
+    }
 
-    uint atomicNum = numOfEachType[i].second;
+    size_t type = 0;
+    while (type < numOfEachType.size() &&
+           numOfEachType[type].second != forced[i].first) type++;
+    // The atomic number must be in the composition
+    if (type == numOfEachType.size()) return false;
 
-    // Create inputs for 'findAllCombinations()'
-    singleAtomPossibilities saPossibilities;
-    usageTracker tracker = createUsageTracker(spg);
-    uint numAtoms = numOfEachType[i].first;
+    trackers[type][group].minNumUses++;
+  }
+  return true;
+}
 
-    combinationSettings sets(numAtoms, findOnlyOne, findOnlyNonUnique);
+systemPossibilities
+RandSpgCombinatorics::getSystemPossibilities(uint spg,
+                                             const vector<uint>& atoms,
+                                             const wyckConstraints& constraints,
+                                             bool findOnlyOne,
+                                             bool findOnlyNonUnique,
+                                             const RandSpgDeadline& deadline)
+{
+  START_FT;
+  vector<numAndType> numOfEachType = RandSpg::getNumOfEachType(atoms);
+  const wyckGroupTable& table = getWyckGroupTable(spg);
+
+  vector<usageTracker> trackers;
+  if (!createConstrainedTrackers(trackers, table, numOfEachType, constraints))
+    return systemPossibilities(spg);
+
+  // The most general position is the last one
+  int generalGroup = -1;
+  if (constraints.forceMostGeneralWyckPos)
+    generalGroup = table.groupOfPosition.back();
+
+  // The searches for each type are independent, so if there is enough
+  // work, start all of them on the thread pool
+  uint totalNumAtoms = atoms.size();
+  vector<singleAtomPossibilities> saPossibilities(numOfEachType.size());
+  if (!findOnlyOne && numOfEachType.size() > 1 &&
+      totalNumAtoms >= parallelSearchMinAtoms &&
+      ThreadPool::global()->numThreads() > 1) {
+    shared_ptr<ThreadPool> pool = ThreadPool::global();
+    vector<future<singleAtomPossibilities>> futures;
+    for (size_t i = 0; i < numOfEachType.size(); i++) {
+      uint atomicNum = numOfEachType[i].second;
+      combinationSettings sets(numOfEachType[i].first, false,
+                               findOnlyNonUnique);
+      sets.deadline = deadline;
+      const usageTracker& tracker = trackers[i];
+      futures.push_back(pool->submit([spg, atomicNum, tracker, sets]() {
+        return findSingleAtomPossibilities(spg, atomicNum, tracker, sets);
+      }));
+    }
+    for (size_t i = 0; i < numOfEachType.size(); i++)
+      saPossibilities[i] = pool->wait(futures[i]);
+  }
+  else {
+    for (size_t i = 0; i < numOfEachType.size(); i++) {
+      uint atomicNum = numOfEachType[i].second;
+      combinationSettings sets(numOfEachType[i].first, findOnlyOne,
+                               findOnlyNonUnique);
+      sets.deadline = deadline;
+      if (findOnlyOne) {
+        saPossibilities[i] = singleAtomPossibilities(spg);
+        saPossibilities[i].atomicNums.push_back(atomicNum);
+        bool last = (i == numOfEachType.size() - 1);
+        findOnlyOneCombinationIfPossible(saPossibilities[i], trackers[i],
+                                         sets, last);
+      }
+      else {
+        saPossibilities[i] = findSingleAtomPossibilities(spg, atomicNum,
+                                                         trackers[i], sets);
+      }
+      // If we didn't find any single atom possibilities, we won't find any
+      // system possibilities either. Return empty
+      if (saPossibilities[i].size() == 0) return systemPossibilities(spg);
+    }
+  }
 
-    bool last = (i == numOfEachType.size() - 1);
-    // This appends all possibilities found to 'saPossibilities'
-    if (findOnlyOne)
-      findOnlyOneCombinationIfPossible(saPossibilities, tracker, atomicNum, sets, last);
-    else findAllCombinations(saPossibilities, tracker, atomicNum, sets);
+  // Whether any type after type 'i' can use the most general position
+  vector<bool> laterTypesCanUseGeneral(numOfEachType.size(), false);
+  if (generalGroup != -1) {
+    bool canUse = false;
+    for (size_t i = numOfEachType.size(); i-- > 0; ) {
+      laterTypesCanUseGeneral[i] = canUse;
+      for (size_t j = 0; j < saPossibilities[i].size() && !canUse; j++)
+        canUse = usesGroup(saPossibilities[i], j, 0, generalGroup);
+    }
+  }
 
-    // If we didn't find any single atom possibilities, we won't find any
-    // system possibilities either. Return empty
-    if (saPossibilities.size() == 0) return systemPossibilities();
+  systemPossibilities sysPossibilities(spg);
+  for (size_t i = 0; i < numOfEachType.size(); i++) {
+    if (saPossibilities[i].size() == 0) return systemPossibilities(spg);
 
 #ifdef PRINT_RAND_SPG_COMB_DEBUG
-    cout << "For atomic num '" << atomicNum << "' calling "
-         << "printSingleAtomPossibilities()\n";
-    printSingleAtomPossibilities(saPossibilities);
+    cout << "For atomic num '" << numOfEachType[i].second << "' calling "
+         << "printSystemPossibilities()\n";
+    printSystemPossibilities(saPossibilities[i]);
 #endif
 
-    sysPossibilities = joinSingleWithSystem(saPossibilities, sysPossibilities);
+    sysPossibilities = joinSingleWithSystem(saPossibilities[i],
+                                            sysPossibilities, generalGroup,
+                                            laterTypesCanUseGeneral[i],
+                                            deadline);
+    // We don't need these anymore
+    saPossibilities[i] = singleAtomPossibilities(spg);
+
+    // If none of them could be joined, there are no system possibilities
+    if (sysPossibilities.size() == 0) return systemPossibilities(spg);
   }
 
 #ifdef PRINT_RAND_SPG_COMB_DEBUG
@@ -468,67 +721,194 @@ RandSpgCombinatorics::getSystemPossibilities(uint spg,
   return sysPossibilities;
 }
 
-uint countNumTimesWyckPosMayBeUsed(const systemPossibility& sysPos,
-                                   char wyckLet)
+// Addition and multiplication that stop at UINT64_MAX instead of wrapping
+static inline uint64_t saturatingAdd(uint64_t a, uint64_t b)
 {
-  uint numTimesUsed = 0;
-  for (size_t i = 0; i < sysPos.size(); i++) {
-    const singleAtomPossibility& sinPos = sysPos[i];
-    const assignments& assigns = sinPos.assigns;
-    for (size_t j = 0; j < assigns.size(); j++) {
-      uint numToChoose = assigns[j].numToChoose;
-      const similarWyckPositions& cp = assigns[j].choosablePositions;
-      for (size_t k = 0; k < cp.size(); k++) {
-        const wyckPos& wp = cp[k];
-        if (RandSpg::getWyckLet(wp) == wyckLet) {
-          // If this is a unique wyckoff position, we may only use it once
-          if (RandSpg::containsUniquePosition(wp)) return 1;
-          // Otherwise, we can use it up to the maximum number of times
-          else numTimesUsed += numToChoose;
+  return (a > UINT64_MAX - b) ? UINT64_MAX : a + b;
+}
+
+static inline uint64_t saturatingMultiply(uint64_t a, uint64_t b)
+{
+  if (a == 0 || b == 0) return 0;
+  return (a > UINT64_MAX / b) ? UINT64_MAX : a * b;
+}
+
+// The unique positions that are used, and whether the most general
+// position is used
+typedef pair<uint64_t, bool> countState;
+typedef map<countState, uint64_t> countStates;
+
+// Count the assignments for one atom type, sorted by the state they leave
+// behind. These are the same assignments that findAllCombinations() finds.
+//
+// The non-unique groups are counted like making change for 'numAtoms'
+// with coins of each multiplicity: ways[used][n] is the number of ways to
+// place n atoms, where 'used' is whether the general group was used. The
+// unique groups can only be used a few times each, so their usages are
+// listed out and paired with the ways to place the remaining atoms.
+static countStates countSingleAtomPossibilities(const wyckGroupTable& table,
+                                                const usageTracker& tracker,
+                                                uint numAtoms,
+                                                int generalGroup)
+{
+  vector<vector<uint64_t>> ways(2, vector<uint64_t>(numAtoms + 1, 0));
+  ways[0][0] = 1;
+  // The unique usage, general use, and number of atoms used
+  map<pair<countState, uint>, uint64_t> uniqueWays;
+  uniqueWays[make_pair(countState(0, false), 0)] = 1;
+
+  for (size_t g = 0; g < tracker.size(); g++) {
+    uint mult = tracker[g].multiplicity;
+    uint minUses = tracker[g].minNumUses;
+    bool isGeneral = (static_cast<int>(g) == generalGroup);
+
+    if (!tracker[g].unique) {
+      vector<vector<uint64_t>> newWays(2, vector<uint64_t>(numAtoms + 1, 0));
+      for (size_t used = 0; used < 2; used++) {
+        for (uint n = 0; n <= numAtoms; n++) {
+          if (ways[used][n] == 0) continue;
+          for (uint k = minUses; n + k * mult <= numAtoms; k++) {
+            size_t newUsed = (used || (isGeneral && k != 0)) ? 1 : 0;
+            uint64_t& w = newWays[newUsed][n + k * mult];
+            w = saturatingAdd(w, ways[used][n]);
+          }
         }
       }
+      ways.swap(newWays);
+      continue;
+    }
+
+    map<pair<countState, uint>, uint64_t> newUniqueWays;
+    for (map<pair<countState, uint>, uint64_t>::const_iterator it =
+           uniqueWays.begin(); it != uniqueWays.end(); ++it) {
+      const countState& state = it->first.first;
+      uint n = it->first.second;
+      for (uint k = minUses; k <= tracker[g].getNumPositions() &&
+                             n + k * mult <= numAtoms; k++) {
+        countState newState(state.first + table.uniqueUsage(g, k),
+                            state.second || (isGeneral && k != 0));
+        uint64_t& w = newUniqueWays[make_pair(newState, n + k * mult)];
+        w = saturatingAdd(w, it->second);
+      }
     }
+    uniqueWays.swap(newUniqueWays);
   }
-  return numTimesUsed;
+
+  countStates ret;
+  for (map<pair<countState, uint>, uint64_t>::const_iterator it =
+         uniqueWays.begin(); it != uniqueWays.end(); ++it) {
+    const countState& state = it->first.first;
+    uint numAtomsLeft = numAtoms - it->first.second;
+    for (size_t used = 0; used < 2; used++) {
+      uint64_t w = saturatingMultiply(it->second, ways[used][numAtomsLeft]);
+      if (w == 0) continue;
+      countState newState(state.first, state.second || used);
+      ret[newState] = saturatingAdd(ret[newState], w);
+    }
+  }
+  return ret;
 }
 
-uint countNumTimesWyckPosMayBeUsedForSpecificAtom(
-                                   const systemPossibility& sysPos,
-                                   char wyckLet,
-                                   uint atomicNum)
+uint64_t RandSpgCombinatorics::countSystemPossibilities(
+                                  uint spg,
+                                  const vector<uint>& atoms,
+                                  const wyckConstraints& constraints)
 {
-  uint numTimesUsed = 0;
-  for (size_t i = 0; i < sysPos.size(); i++) {
-    const singleAtomPossibility& sinPos = sysPos[i];
-    if (sinPos.atomicNum != atomicNum) continue;
-    const assignments& assigns = sinPos.assigns;
-    for (size_t j = 0; j < assigns.size(); j++) {
-      uint numToChoose = assigns[j].numToChoose;
-      const similarWyckPositions& cp = assigns[j].choosablePositions;
-      for (size_t k = 0; k < cp.size(); k++) {
-        const wyckPos& wp = cp[k];
-        if (RandSpg::getWyckLet(wp) == wyckLet) {
-          // If this is a unique wyckoff position, we may only use it once
-          if (RandSpg::containsUniquePosition(wp)) return 1;
-          // Otherwise, we can use it up to the maximum number of times
-          else numTimesUsed += numToChoose;
-        }
+  START_FT;
+  vector<numAndType> numOfEachType = RandSpg::getNumOfEachType(atoms);
+  const wyckGroupTable& table = getWyckGroupTable(spg);
+  if (numOfEachType.empty()) return 0;
+
+  vector<usageTracker> trackers;
+  if (!createConstrainedTrackers(trackers, table, numOfEachType, constraints))
+    return 0;
+
+  int generalGroup = -1;
+  if (constraints.forceMostGeneralWyckPos)
+    generalGroup = table.groupOfPosition.back();
+
+  // Join the types one at a time like joinSingleWithSystem() does, but
+  // only keep the number of system possibilities in each state
+  countStates sysStates;
+  sysStates[countState(0, false)] = 1;
+  for (size_t i = 0; i < numOfEachType.size(); i++) {
+    countStates saStates =
+      countSingleAtomPossibilities(table, trackers[i],
+                                   numOfEachType[i].first, generalGroup);
+    countStates newSysStates;
+    for (countStates::const_iterator sys = sysStates.begin();
+         sys != sysStates.end(); ++sys) {
+      for (countStates::const_iterator sa = saStates.begin();
+           sa != saStates.end(); ++sa) {
+        if (!table.uniqueUsagesFit(sys->first.first, sa->first.first))
+          continue;
+        countState state(sys->first.first + sa->first.first,
+                         sys->first.second || sa->first.second);
+        uint64_t w = saturatingMultiply(sys->second, sa->second);
+        newSysStates[state] = saturatingAdd(newSysStates[state], w);
       }
     }
+    sysStates.swap(newSysStates);
+    if (sysStates.empty()) return 0;
+  }
+
+  uint64_t ret = 0;
+  for (countStates::const_iterator it = sysStates.begin();
+       it != sysStates.end(); ++it) {
+    if (generalGroup == -1 || it->first.second)
+      ret = saturatingAdd(ret, it->second);
+  }
+  return ret;
+}
+
+// Count the number of times the position at 'posIndex' may be used in
+// possibility 'i'. If 'type' is -1, every type is counted.
+static uint countNumTimesWyckPosMayBeUsed(const systemPossibilities& sysPos,
+                                          size_t i, int posIndex, int type)
+{
+  if (posIndex < 0) return 0;
+  const wyckGroupTable& table =
+    RandSpgCombinatorics::getWyckGroupTable(sysPos.spg);
+  uint8_t group = table.groupOfPosition[posIndex];
+  uint numTimesUsed = 0;
+  for (size_t t = 0; t < sysPos.numTypes(); t++) {
+    if (type != -1 && t != static_cast<size_t>(type)) continue;
+    for (const similarWyckPosAndNumToChoose* it = sysPos.assignsBegin(i, t);
+         it != sysPos.assignsEnd(i, t); ++it) {
+      if (it->group != group) continue;
+      // If this is a unique wyckoff position, we may only use it once
+      if (table.unique[group]) return 1;
+      // Otherwise, we can use it up to the maximum number of times
+      else numTimesUsed += it->numToChoose;
+    }
   }
   return numTimesUsed;
 }
+
+// Keep the possibilities where the position may be used at least
+// 'minNumUses' times
+static systemPossibilities filterPossibilities(const systemPossibilities& sysPos,
+                                               char wyckLet, uint minNumUses,
+                                               int type)
+{
+  int posIndex =
+    RandSpgCombinatorics::getWyckGroupTable(sysPos.spg).getPositionIndex(wyckLet);
+  systemPossibilities ret(sysPos.spg);
+  ret.atomicNums = sysPos.atomicNums;
+  for (size_t i = 0; i < sysPos.size(); i++) {
+    uint numTimesUsed = countNumTimesWyckPosMayBeUsed(sysPos, i, posIndex,
+                                                      type);
+    if (numTimesUsed >= minNumUses) ret.appendPossibility(sysPos, i);
+  }
+  return ret;
+}
+
 systemPossibilities RandSpgCombinatorics::removePossibilitiesWithoutWyckPos(
                                           const systemPossibilities& sysPos,
                                           char wyckLet,
                                           uint minNumUses)
 {
-  systemPossibilities ret;
-  for (size_t i = 0; i < sysPos.size(); i++) {
-    uint numTimesUsed = countNumTimesWyckPosMayBeUsed(sysPos[i], wyckLet);
-    if (numTimesUsed >= minNumUses) ret.push_back(sysPos[i]);
-  }
-  return ret;
+  return filterPossibilities(sysPos, wyckLet, minNumUses, -1);
 }
 
 // This version also specifies the atomic number
@@ -538,12 +918,16 @@ systemPossibilities RandSpgCombinatorics::removePossibilitiesWithoutWyckPos(
                                           uint minNumUses,
                                           uint atomicNum)
 {
-  systemPossibilities ret;
-  for (size_t i = 0; i < sysPos.size(); i++) {
-    uint numTimesUsed = countNumTimesWyckPosMayBeUsedForSpecificAtom(sysPos[i], wyckLet, atomicNum);
-    if (numTimesUsed >= minNumUses) ret.push_back(sysPos[i]);
+  const vector<uint>& nums = sysPos.atomicNums;
+  int type = find(nums.begin(), nums.end(), atomicNum) - nums.begin();
+  // If this atomic number isn't in the system, it can't use the position
+  if (type == static_cast<int>(nums.size())) {
+    if (minNumUses == 0) return sysPos;
+    systemPossibilities ret(sysPos.spg);
+    ret.atomicNums = sysPos.atomicNums;
+    return ret;
   }
-  return ret;
+  return filterPossibilities(sysPos, wyckLet, minNumUses, type);
 }
 
 systemPossibilities RandSpgCombinatorics::removePossibilitiesWithoutGeneralWyckPos(const systemPossibilities& sysPos,
@@ -554,29 +938,9 @@ systemPossibilities RandSpgCombinatorics::removePossibilitiesWithoutGeneralWyckP
   return removePossibilitiesWithoutWyckPos(sysPos, RandSpg::getWyckLet(wp[wp.size() - 1]), minNumUses);
 }
 
-// We call this when a unique position is assigned when getting
-// atom assignments.
-// It removes the unique position from the possibilities so that it will
-// not be used
-void removePositionFromSystemPossibility(systemPossibility& pos, char wyckLet)
-{
-  for (size_t i = 0; i < pos.size(); i++) {
-    singleAtomPossibility& siPos = pos[i];
-    for (size_t j = 0; j < siPos.assigns.size(); j++) {
-      similarWyckPositions& simPos = siPos.assigns[j].choosablePositions;
-      for (size_t k = 0; k < simPos.size(); k++) {
-        if (RandSpg::getWyckLet(simPos[k]) == wyckLet) {
-          simPos.erase(simPos.begin() + k);
-          k--;
-        }
-      }
-    }
-  }
-}
-
-systemPossibility RandSpgCombinatorics::getRandomSystemPossibility(const systemPossibilities& sysPoss)
+size_t RandSpgCombinatorics::getRandomSystemPossibility(const systemPossibilities& sysPoss)
 {
-  return sysPoss[getRandInt(0, sysPoss.size() - 1)];
+  return getRandInt(0, sysPoss.size() - 1);
 }
 
 // Get random atom assignments from all the possible system possibilities
@@ -587,153 +951,126 @@ atomAssignments RandSpgCombinatorics::getRandomAtomAssignments(const systemPossi
   return getRandomAtomAssignments(sysPoss, vector<pair<uint, wyckPos>>());
 }
 
-void decrementChoiceFromSystemPossibility(systemPossibility& sysPos, uint atomicNum, const wyckPos& wyckPos)
-{
-  // Remove this from the system possibility
-  for (size_t i = 0; i < sysPos.size(); i++) {
-    if (sysPos[i].atomicNum != atomicNum) continue;
-    bool decrementComplete = false;
-    for (size_t j = 0; j < sysPos[i].assigns.size(); j++) {
-      similarWyckPosAndNumToChoose& simAndNum = sysPos[i].assigns[j];
-      similarWyckPositions& simPos = simAndNum.choosablePositions;
-      // If we find that the position is used here, decrement the choosable
-      // positions and break. We are done.
-      for (size_t k = 0; k < simPos.size(); k++) {
-        if (simPos[k] == wyckPos) {
-          simAndNum.numToChoose--;
-          decrementComplete = true;
-          break;
-        }
-      }
-      // If we have decremented, we are done.
-      if (decrementComplete) break;
-    }
-    if (decrementComplete) break;
-  }
-}
-
 atomAssignments RandSpgCombinatorics::getRandomAtomAssignments(const systemPossibilities& sysPoss, const vector<pair<uint, wyckPos>>& forcedWyckPositions)
 {
   START_FT;
-  atomAssignments ret;
-  // Pick a random system possibility to use
-  systemPossibility tempPos = getRandomSystemPossibility(sysPoss);
-
-  // Add the forced Wyckoff positions
-  for (size_t i = 0; i < forcedWyckPositions.size(); i++) {
-    wyckPos pos = forcedWyckPositions[i].second;
-    uint atomicNum = forcedWyckPositions[i].first;
-    ret.push_back(make_pair(pos, atomicNum));
-    decrementChoiceFromSystemPossibility(tempPos, atomicNum, pos);
-  }
-
-  for (size_t i = 0; i < tempPos.size(); i++) {
-    uint atomicNum = tempPos[i].atomicNum;
-    for (size_t j = 0; j < tempPos[i].assigns.size(); j++) {
-      similarWyckPosAndNumToChoose& simAndNum = tempPos[i].assigns[j];
-      uint atomsLeft = simAndNum.numToChoose;
-      similarWyckPositions& simPos = simAndNum.choosablePositions;
-      // Keep adding atoms until there are none left
-      while (atomsLeft > 0) {
-        int rand = getRandInt(0, simPos.size() - 1);
-        const wyckPos& wyckPos = simPos[rand];
-        ret.push_back(make_pair(simPos[rand], atomicNum));
-        atomsLeft--;
-        // If we used a unique position, then remove all of this position from
-        // the rest of the choices so we don't accidentally re-use it
-        if (RandSpg::containsUniquePosition(wyckPos))
-          removePositionFromSystemPossibility(tempPos, RandSpg::getWyckLet(wyckPos));
-      }
-    }
-  }
+  // Callers that draw many assignments from the same possibilities should
+  // keep a sampler instead of building one every time
+  atomAssignments ret =
+    WyckAssignmentSampler(sysPoss, forcedWyckPositions).sample();
+
+#ifdef PRINT_RAND_SPG_COMB_DEBUG
+  printAtomAssignments(ret);
+#endif
 
   return ret;
 }
 
-string RandSpgCombinatorics::getSimilarWyckPosAndNumToChooseString(const similarWyckPosAndNumToChoose& simPos)
+string RandSpgCombinatorics::getSimilarWyckPosAndNumToChooseString(uint spg, const similarWyckPosAndNumToChoose& simPos)
 {
+  const wyckGroupTable& table = getWyckGroupTable(spg);
   stringstream s;
   s << "   printing similar Wyck pos and num to choose:\n";
   s << "   numToChoose is: " << simPos.numToChoose << "\n";
-  if (simPos.choosablePositions.size() != 0)
-    s << "   uniqueness is: "
-      << (RandSpg::containsUniquePosition(simPos.choosablePositions[0]) ? "true\n" : "false\n");
+  s << "   uniqueness is: "
+    << (table.unique[simPos.group] ? "true\n" : "false\n");
   s << "   Wyckoff positions are:\n    { ";
-  for (size_t i = 0; i < simPos.choosablePositions.size(); i++) {
-    s << RandSpg::getWyckLet(simPos.choosablePositions[i]) << " ";
+  for (size_t i = 0; i < table.numPositionsInGroup(simPos.group); i++) {
+    s << RandSpg::getWyckLet(table.getWyckPos(simPos.group, i)) << " ";
   }
   s << "}\n";
   return s.str();
 }
 
-void RandSpgCombinatorics::printSimilarWyckPosAndNumToChoose(const similarWyckPosAndNumToChoose& simPos)
+void RandSpgCombinatorics::printSimilarWyckPosAndNumToChoose(uint spg, const similarWyckPosAndNumToChoose& simPos)
 {
-  cout << getSimilarWyckPosAndNumToChooseString(simPos);
+  cout << getSimilarWyckPosAndNumToChooseString(spg, simPos);
 }
 
-string RandSpgCombinatorics::getSingleAtomPossibilityString(const singleAtomPossibility& pos)
+string RandSpgCombinatorics::getSingleAtomPossibilityString(const systemPossibilities& pos, size_t i, size_t t)
 {
   stringstream s;
   s << "  Printing single atom possibility:\n";
-  s << "  atomicNum is: " << pos.atomicNum << "\n";
-  for (size_t i = 0; i < pos.assigns.size(); i++) {
-    s << getSimilarWyckPosAndNumToChooseString(pos.assigns[i]);
+  s << "  atomicNum is: " << pos.atomicNums[t] << "\n";
+  for (const similarWyckPosAndNumToChoose* it = pos.assignsBegin(i, t);
+       it != pos.assignsEnd(i, t); ++it) {
+    s << getSimilarWyckPosAndNumToChooseString(pos.spg, *it);
   }
   return s.str();
 }
 
-void RandSpgCombinatorics::printSingleAtomPossibility(const singleAtomPossibility& pos)
+void RandSpgCombinatorics::printSingleAtomPossibility(const systemPossibilities& pos, size_t i, size_t t)
 {
-  cout << getSingleAtomPossibilityString(pos);
+  cout << getSingleAtomPossibilityString(pos, i, t);
 }
 
-string RandSpgCombinatorics::getSystemPossibilityString(const systemPossibility& pos)
+string RandSpgCombinatorics::getSystemPossibilityString(const systemPossibilities& pos, size_t i)
 {
   stringstream s;
   s << "\n Printing system possibility:\n";
-  for (size_t i = 0; i < pos.size(); i++) s << getSingleAtomPossibilityString(pos[i]);
+  for (size_t t = 0; t < pos.numTypes(); t++)
+    s << getSingleAtomPossibilityString(pos, i, t);
   return s.str();
 }
 
-void RandSpgCombinatorics::printSystemPossibility(const systemPossibility& pos)
+void RandSpgCombinatorics::printSystemPossibility(const systemPossibilities& pos, size_t i)
 {
-  cout << getSystemPossibilityString(pos);
+  cout << getSystemPossibilityString(pos, i);
 }
 
 string RandSpgCombinatorics::getSystemPossibilitiesString(const systemPossibilities& pos)
 {
   stringstream s;
   s << "Printing system possibilities:\n";
-  for (size_t i = 0; i < pos.size(); i++) s << getSystemPossibilityString(pos[i]);
+  for (size_t i = 0; i < pos.size(); i++) s << getSystemPossibilityString(pos, i);
   return s.str();
 }
 
 string RandSpgCombinatorics::getVerbosePossibilitiesString(const systemPossibilities& pos)
 {
-  stringstream s;
-  s << "Printing system possibilities:\n";
-  for (size_t i = 0; i < pos.size(); i++) {
-    const systemPossibility& sysPos = pos[i];
-    s << "  Possibility " << i+1 << ":\n";
-    for (size_t j = 0; j < sysPos.size(); j++) {
-      const singleAtomPossibility& sinPos = sysPos[j];
-      s << "    For atomicNum: " << sinPos.atomicNum << "\n";
-      for (size_t k = 0; k < sinPos.assigns.size(); k++) {
-        const similarWyckPosAndNumToChoose& simPos = sinPos.assigns[k];
-        s << "      We will choose " << simPos.numToChoose 
-          << " of the following positions:\n        { ";
-        for (size_t l = 0; l < simPos.choosablePositions.size(); l++) {
-          s << RandSpg::getWyckLet(simPos.choosablePositions[l]) << " ";
+  string ret;
+  writeVerbosePossibilities(pos, [&ret](const string& text) { ret += text; });
+  return ret;
+}
+
+void RandSpgCombinatorics::writeVerbosePossibilities(const systemPossibilities& pos,
+                                                     const function<void(const string&)>& out,
+                                                     size_t maxPossibilities)
+{
+  const wyckGroupTable& table = getWyckGroupTable(pos.spg);
+  size_t numToWrite = pos.size();
+  if (maxPossibilities != 0 && maxPossibilities < numToWrite)
+    numToWrite = maxPossibilities;
+
+  out("Printing system possibilities:\n");
+  // The text of one possibility at a time. The capacity is reused.
+  string s;
+  for (size_t i = 0; i < numToWrite; i++) {
+    s.clear();
+    s += "  Possibility " + to_string(i+1) + ":\n";
+    for (size_t t = 0; t < pos.numTypes(); t++) {
+      s += "    For atomicNum: " + to_string(pos.atomicNums[t]) + "\n";
+      for (const similarWyckPosAndNumToChoose* it = pos.assignsBegin(i, t);
+           it != pos.assignsEnd(i, t); ++it) {
+        s += "      We will choose " + to_string(it->numToChoose) +
+             " of the following positions:\n        { ";
+        for (size_t l = 0; l < table.numPositionsInGroup(it->group); l++) {
+          s += RandSpg::getWyckLet(table.getWyckPos(it->group, l));
+          s += ' ';
         }
-        s << "}\n";
-        if (simPos.choosablePositions.size() != 0)
-          s << "        uniqueness is: "
-            << (RandSpg::containsUniquePosition(simPos.choosablePositions[0]) ? "true - positions are not re-usable\n" : "false - positions are re-usable\n");
+        s += "}\n";
+        s += "        uniqueness is: ";
+        s += (table.unique[it->group] ? "true - positions are not re-usable\n" : "false - positions are re-usable\n");
       }
     }
-    s << "  End of possibility " << i+1 << "\n\n";
+    s += "  End of possibility " + to_string(i+1) + "\n\n";
+    out(s);
+  }
+
+  if (numToWrite < pos.size()) {
+    out("  ... " + to_string(pos.size() - numToWrite) + " more of the " +
+        to_string(pos.size()) + " possibilities were not printed.\n\n");
   }
-  return s.str();
 }
 
 void RandSpgCombinatorics::printSystemPossibilities(const systemPossibilities& pos)
@@ -0,0 +1,130 @@
+/**********************************************************************
+  randSpgContainer.cpp - Lists the structures in a structure container or
+                         binary structure file and prints any of them.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <functional>
+#include <iostream>
+
+#include "structureBinaryFile.h"
+#include "structureContainer.h"
+#include "utilityFunctions.h"
+
+using namespace std;
+
+// The position of a structure given as a position or as 'spg-index', or -1
+// if it is not one of the 'numStructures' structures
+static long getPosition(const string& arg, size_t numStructures,
+                        const function<long(uint, size_t)>& find)
+{
+  vector<string> theSplit = split(arg, '-');
+  long position = -1;
+  if (theSplit.size() == 1 && isNumber(arg)) {
+    position = stol(arg);
+  }
+  else if (theSplit.size() == 2 && isNumber(theSplit[0]) &&
+           isNumber(theSplit[1])) {
+    position = find(stoul(theSplit[0]), stoul(theSplit[1]));
+  }
+
+  if (position < 0 || static_cast<size_t>(position) >= numStructures) {
+    cout << "Error: the structure, '" << arg << "', is not in the file.\n";
+    return -1;
+  }
+  return position;
+}
+
+// A binary structure file (see structureBinaryFile.h). Its structures are
+// printed as POSCARs.
+static int readBinaryFile(int argc, char* argv[])
+{
+  StructureBinaryReader reader;
+  if (!reader.open(argv[1])) return -1;
+
+  if (argc == 2) {
+    cout << "Format: binary with float" << 8 * reader.getCoordSize()
+         << " coordinates\nNumber of structures: " << reader.numStructures()
+         << "\nNumber of atoms: " << reader.numAtoms() << "\n"
+         << "position firstAtom numAtoms spg index seed seconds\n";
+    for (size_t i = 0; i < reader.numStructures(); i++) {
+      const structureBinaryRecord& r = reader.getRecord(i);
+      cout << i << " " << r.firstAtom << " " << r.numAtoms << " " << r.spg
+           << " " << r.spgIndex << " " << r.seed << " " << r.time << "\n";
+    }
+    return 0;
+  }
+
+  auto find = [&reader](uint spg, size_t spgIndex) -> long
+  {
+    for (size_t i = 0; i < reader.numStructures(); i++) {
+      const structureBinaryRecord& r = reader.getRecord(i);
+      if (r.spg == spg && r.spgIndex == spgIndex) return i;
+    }
+    return -1;
+  };
+
+  for (int i = 2; i < argc; i++) {
+    long position = getPosition(argv[i], reader.numStructures(), find);
+    if (position < 0) return -1;
+    cout << reader.getCrystal(position).getPOSCARString(
+              "randSpg with spg of: " +
+              to_string(reader.getRecord(position).spg));
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    cout << "Usage: ./randSpgContainer <containerFile> [<structure> ...]\n"
+         << "With no structures, the index is listed. A structure is its "
+         << "position in the\nfile (starting at 0) or its spg and index, "
+         << "as in '225-3'. Binary structure\nfiles (ending in '.bin') may "
+         << "be read as well.\n";
+    return -1;
+  }
+
+  if (hasEnding(argv[1], ".bin")) return readBinaryFile(argc, argv);
+
+  StructureContainerReader reader;
+  if (!reader.open(argv[1])) return -1;
+
+  if (argc == 2) {
+    cout << "Format: " << StructureContainer::getFormatName(reader.getFormat())
+         << "\nNumber of structures: " << reader.numStructures() << "\n"
+         << "position offset size spg index seed seconds name\n";
+    for (size_t i = 0; i < reader.numStructures(); i++) {
+      const structureRecord& r = reader.getRecord(i);
+      cout << i << " " << r.offset << " " << r.size << " " << r.spg << " "
+           << r.spgIndex << " " << r.seed << " " << r.time << " " << r.name
+           << "\n";
+    }
+    return 0;
+  }
+
+  auto find = [&reader](uint spg, size_t spgIndex)
+  {
+    return reader.find(spg, spgIndex);
+  };
+
+  for (int i = 2; i < argc; i++) {
+    long position = getPosition(argv[i], reader.numStructures(), find);
+    if (position < 0) return -1;
+
+    string text;
+    if (!reader.readStructure(position, text)) return -1;
+    cout << text;
+  }
+  return 0;
+}
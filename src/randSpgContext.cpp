@@ -0,0 +1,165 @@
+/**********************************************************************
+  randSpgContext.cpp - The radii, minimum interatomic distances, and log
+                       destination used by one call to RandSpg.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <iostream>
+
+#include "elemInfoDatabase.h"
+#include "logWriter.h"
+#include "randSpgContext.h"
+
+using namespace std;
+
+RandSpgContext::RandSpgContext() :
+  m_covalentRadii(ElemInfoDatabase::_covalentRadii),
+  m_vdwRadii(ElemInfoDatabase::_vdwRadii),
+  m_tableIndices(ElemInfoDatabase::_covalentRadii.size(), -1),
+  m_tableSize(0)
+{
+}
+
+RandSpgContext::RandSpgContext(const randSpgInput& input,
+                               const logSink& sink) :
+  m_covalentRadii(ElemInfoDatabase::_covalentRadii.size(), 0.0),
+  m_vdwRadii(ElemInfoDatabase::_vdwRadii.size(), 0.0),
+  m_tableIndices(ElemInfoDatabase::_covalentRadii.size(), -1),
+  m_tableSize(0),
+  m_logSink(sink)
+{
+  if (!m_logSink) m_logSink = fileLogSink(e_logfilename);
+
+  // These are applied in the same order as ElemInfo applies them: the
+  // scaling factor, then the min radius, then the explicit radii
+  for (size_t i = 1; i < m_covalentRadii.size(); i++) {
+    m_covalentRadii[i] =
+      max(ElemInfoDatabase::_covalentRadii[i] * input.IADScalingFactor,
+          input.minRadius);
+    m_vdwRadii[i] =
+      max(ElemInfoDatabase::_vdwRadii[i] * input.IADScalingFactor,
+          input.minRadius);
+  }
+
+  for (size_t i = 0; i < input.manualAtomicRadii.size(); i++) {
+    uint atomicNum = input.manualAtomicRadii[i].first;
+    double newRadius = input.manualAtomicRadii[i].second;
+    if (atomicNum == 0 || atomicNum >= m_covalentRadii.size()) {
+      cout << "Error: Invalid atomicNum, " << atomicNum << ", was entered in "
+           << __FUNCTION__ << "!\n";
+      continue;
+    }
+    if (newRadius < 0) {
+      cout << "Error in " << __FUNCTION__ << ": a negative radius, '"
+           << newRadius << "', was entered.\n";
+      continue;
+    }
+    m_covalentRadii[atomicNum] = newRadius;
+    m_vdwRadii[atomicNum] = newRadius;
+  }
+
+  // The first custom minIAD for a pair is the one that is used
+  for (size_t i = 0; i < input.customMinIADs.size(); i++) {
+    uint atomicNum1 = input.customMinIADs[i].first.first;
+    uint atomicNum2 = input.customMinIADs[i].first.second;
+    bool found = false;
+    for (size_t j = 0; j < m_customMinIADs.size() && !found; j++) {
+      found = (m_customMinIADs[j].first.first == atomicNum1 &&
+               m_customMinIADs[j].first.second == atomicNum2) ||
+              (m_customMinIADs[j].first.first == atomicNum2 &&
+               m_customMinIADs[j].first.second == atomicNum1);
+    }
+    if (found) {
+      cout << "Error: Pair of atomic numbers: (" << atomicNum1 << ","
+           << atomicNum2 << ") have already been entered as a custom pair!\n"
+           << "Ignoring this new custom minIAD.\n";
+      continue;
+    }
+    m_customMinIADs.push_back(input.customMinIADs[i]);
+  }
+
+  // Build the table for the atomic numbers in the input
+  vector<uint> atomicNums;
+  for (size_t i = 0; i < input.atoms.size(); i++) {
+    uint atomicNum = input.atoms[i];
+    if (atomicNum == 0 || atomicNum >= m_tableIndices.size()) continue;
+    if (m_tableIndices[atomicNum] != -1) continue;
+    m_tableIndices[atomicNum] = atomicNums.size();
+    atomicNums.push_back(atomicNum);
+  }
+  m_tableSize = atomicNums.size();
+  m_covalentMinIADs.resize(m_tableSize * m_tableSize);
+  m_vdwMinIADs.resize(m_tableSize * m_tableSize);
+  for (size_t i = 0; i < m_tableSize; i++) {
+    for (size_t j = 0; j < m_tableSize; j++) {
+      m_covalentMinIADs[i * m_tableSize + j] =
+        computeMinIAD(atomicNums[i], atomicNums[j], false);
+      m_vdwMinIADs[i * m_tableSize + j] =
+        computeMinIAD(atomicNums[i], atomicNums[j], true);
+    }
+  }
+}
+
+double RandSpgContext::getRadius(uint atomicNum, bool usingVdwRadius) const
+{
+  if (atomicNum == 0 || atomicNum >= m_covalentRadii.size()) {
+    cout << "Error: Invalid atomicNum, " << atomicNum << ", was entered in "
+         << __FUNCTION__ << "!\n";
+    return 0;
+  }
+  return usingVdwRadius ? m_vdwRadii[atomicNum] : m_covalentRadii[atomicNum];
+}
+
+double RandSpgContext::computeMinIAD(uint atomicNum1, uint atomicNum2,
+                                     bool usingVdwRadii) const
+{
+  for (size_t i = 0; i < m_customMinIADs.size(); i++) {
+    if ((m_customMinIADs[i].first.first == atomicNum1 &&
+         m_customMinIADs[i].first.second == atomicNum2) ||
+        (m_customMinIADs[i].first.first == atomicNum2 &&
+         m_customMinIADs[i].first.second == atomicNum1)) {
+      return m_customMinIADs[i].second;
+    }
+  }
+  return getRadius(atomicNum1, usingVdwRadii) +
+         getRadius(atomicNum2, usingVdwRadii);
+}
+
+double RandSpgContext::getMinIAD(uint atomicNum1, uint atomicNum2,
+                                 bool usingVdwRadii) const
+{
+  if (atomicNum1 < m_tableIndices.size() &&
+      atomicNum2 < m_tableIndices.size()) {
+    int i = m_tableIndices[atomicNum1];
+    int j = m_tableIndices[atomicNum2];
+    if (i != -1 && j != -1) {
+      const vector<double>& table =
+        usingVdwRadii ? m_vdwMinIADs : m_covalentMinIADs;
+      return table[i * m_tableSize + j];
+    }
+  }
+  return computeMinIAD(atomicNum1, atomicNum2, usingVdwRadii);
+}
+
+void RandSpgContext::log(const string& text) const
+{
+  if (m_logSink) m_logSink(text);
+}
+
+RandSpgContext::logSink RandSpgContext::fileLogSink(const string& fileName)
+{
+  // The file is closed once no sink writes to it
+  shared_ptr<LogWriter> writer = LogWriter::open(fileName);
+  return [writer](const string& text) { writer->append(text); };
+}
@@ -0,0 +1,644 @@
+/**********************************************************************
+  randSpgGenerator.cpp - Generates any number of crystals with one set of
+                         inputs after doing the setup once.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include "possibilitiesCache.h"
+#include "randSpgCombinatorics.h"
+#include "randSpgContext.h"
+#include "randSpgGenerator.h"
+#include "rng.h"
+#include "threadPool.h"
+#include "wyckAssignmentSampler.h"
+
+// For FunctionTracker
+#include "functionTracker.h"
+
+// Uncomment the right side of this line to output function starts and endings
+#define START_FT //FunctionTracker functionTracker(__FUNCTION__);
+
+using namespace std;
+
+static Crystal createValidCrystal(uint spg,
+                                  const latticeStruct& latticeMins,
+                                  const latticeStruct& latticeMaxes,
+                                  double minVolume, double maxVolume)
+{
+  Crystal ret;
+  // If we fail to do this 1000 times, return an empty crystal
+  size_t maxAttempts = 1000;
+  size_t numAttempts = 0;
+  bool validCrystal = false;
+  while (maxAttempts > numAttempts && !validCrystal) {
+    numAttempts++;
+
+    // First let's get a lattice...
+    latticeStruct st = RandSpg::generateLatticeForSpg(spg, latticeMins, latticeMaxes);
+    Crystal crystal(st);
+
+    // Make sure it's a valid lattice
+    if (st.a == 0 || st.b == 0 || st.c == 0 ||
+        st.alpha == 0 || st.beta == 0 || st.gamma == 0) {
+      cout << "Error in RandSpg::createValidCrystal(): an invalid lattice was "
+           << "generated.\n";
+      return Crystal();
+    }
+
+    // Rescale the volume of the crystal if necessary
+    if (maxVolume != -1 && crystal.getVolume() > maxVolume)
+      // Pick a random number between the min and max volume and rescale to it
+      crystal.rescaleVolume(getRandDouble(minVolume, maxVolume));
+    else if (minVolume != -1 && crystal.getVolume() < minVolume)
+      crystal.rescaleVolume(getRandDouble(minVolume, maxVolume));
+
+    // After rescaling, check again to make sure a, b, and c are within
+    // the correct limits
+    st = crystal.getLattice();
+    if (latticeMins.a <= st.a && st.a <= latticeMaxes.a &&
+        latticeMins.b <= st.b && st.b <= latticeMaxes.b &&
+        latticeMins.c <= st.c && st.c <= latticeMaxes.c) {
+      ret = crystal;
+      validCrystal = true;
+    }
+    // If the crystal is not valid, we'll try again
+  }
+
+  // If we get to the point without a valid crystal,
+  // we exceeded the max attempts
+  if (!validCrystal) {
+    cerr << "After " << maxAttempts
+         << " attempts, a valid crystal could not be made for "
+         << "spg '" << spg << "' and the given latticeMins, latticeMaxes, "
+         << "minVolume of '" << minVolume << "' and maxVolume of '"
+         << maxVolume << "'\n";
+    cerr << "Aborting this crystal.\n";
+    return Crystal();
+  }
+  return ret;
+}
+
+// How far one attempt of randSpgCrystal() got
+struct attemptOutcome {
+  bool succeeded;
+  // The number of Wyckoff positions that were filled before it failed
+  size_t numPlaced;
+  // The number of Wyckoff positions that it tried to fill
+  size_t numPositions;
+  // If the deadline expired, the attempt was cut short and says nothing
+  // about whether the crystal can be made
+  RandSpgDeadline::reason expired;
+  attemptOutcome() : succeeded(false), numPlaced(0), numPositions(0),
+                     expired(RandSpgDeadline::notExpired) {}
+};
+
+// The early abort rule of randSpgCrystal(). An attempt fills its Wyckoff
+// positions one at a time and fails at the first one that cannot be filled.
+// The chance q_k that the k'th position is filled, given that the ones
+// before it were, is estimated separately for every depth k. A failed
+// attempt that filled d positions passed depths 0 to d - 1 and failed at
+// depth d. Each q_k is shrunk towards the pass rate of all depths together,
+// with the weight of one attempt, so that depths that few attempts reached
+// (or none did) look like the rest. An attempt with M positions then
+// succeeds with probability p = q_0 * ... * q_(M-1), where M is the average
+// number of positions of the attempts so far.
+//
+// The attempts stop when the chance that any of the remaining R attempts
+// succeeds, 1 - (1 - p)^R, is below the threshold. So attempts that keep
+// failing at the same early position stop quickly, while attempts that
+// fail at different positions, or near their end, keep going.
+class earlyAbortRule {
+ public:
+  earlyAbortRule(double threshold, size_t maxAttempts) :
+    m_threshold(threshold), m_maxAttempts(maxAttempts), m_numAttempts(0),
+    m_numPlaced(0), m_numFailed(0), m_numPositions(0),
+    m_numAttemptsWithPositions(0) {}
+
+  void addFailure(const attemptOutcome& outcome)
+  {
+    m_numAttempts++;
+    m_numPlaced += outcome.numPlaced;
+    if (outcome.numPositions == 0) return;
+
+    m_numPositions += outcome.numPositions;
+    m_numAttemptsWithPositions++;
+    m_numFailed++;
+
+    // If every position was filled, it failed after the last one
+    size_t depth = min(outcome.numPlaced, outcome.numPositions - 1);
+    if (m_numReached.size() <= depth) {
+      m_numReached.resize(depth + 1, 0);
+      m_numPassed.resize(depth + 1, 0);
+    }
+    for (size_t k = 0; k <= depth; k++) m_numReached[k]++;
+    for (size_t k = 0; k < depth; k++) m_numPassed[k]++;
+  }
+
+  // The estimated chance that one of the remaining attempts succeeds
+  double getRemainingSuccessProbability() const
+  {
+    if (m_numAttemptsWithPositions == 0 || m_numAttempts >= m_maxAttempts)
+      return 1.0;
+    size_t M = static_cast<size_t>(
+      round(static_cast<double>(m_numPositions) / m_numAttemptsWithPositions));
+    // The pass rate of all depths together, with a Jeffreys prior
+    double pooled = (m_numPlaced + 0.5) / (m_numPlaced + m_numFailed + 1.0);
+    double p = 1.0;
+    for (size_t k = 0; k < M; k++) {
+      if (k < m_numReached.size())
+        p *= (m_numPassed[k] + pooled) / (m_numReached[k] + 1.0);
+      else
+        p *= pooled;
+    }
+    return 1.0 - pow(1.0 - p, m_maxAttempts - m_numAttempts);
+  }
+
+  // One or two attempts say little about the rest, so we always make at
+  // least this many
+  static const size_t minAttempts = 10;
+
+  size_t getNumAttempts() const { return m_numAttempts; }
+
+  bool shouldAbort() const
+  {
+    return m_threshold > 0 && m_numAttempts >= minAttempts &&
+           getRemainingSuccessProbability() < m_threshold;
+  }
+
+  // Why we stopped, for the log
+  string getReason() const
+  {
+    stringstream ss;
+    ss << "Stopped early after " << m_numAttempts << " attempts: the "
+       << "estimated chance that any of the remaining "
+       << m_maxAttempts - m_numAttempts << " attempts succeeds is "
+       << getRemainingSuccessProbability() << ", which is below the "
+       << "earlyAbortThreshold of " << m_threshold << ". On average, "
+       << static_cast<double>(m_numPlaced) / m_numAttempts << " of "
+       << static_cast<double>(m_numPositions) /
+          max<size_t>(m_numAttemptsWithPositions, 1)
+       << " Wyckoff positions were filled before an attempt failed.\n";
+    return ss.str();
+  }
+
+ private:
+  double m_threshold;
+  size_t m_maxAttempts, m_numAttempts;
+  size_t m_numPlaced, m_numFailed;
+  size_t m_numPositions, m_numAttemptsWithPositions;
+  // For each depth k, the number of attempts that got to position k, and
+  // the number of those that filled it
+  vector<size_t> m_numReached, m_numPassed;
+};
+
+static randSpgStatus getExpiredStatus(RandSpgDeadline::reason reason)
+{
+  return reason == RandSpgDeadline::cancelled ? randSpgCancelled :
+                                                randSpgTimedOut;
+}
+
+// Run attempt 'i' of randSpgCrystal(). The text for the log file is
+// appended to 'log'. On success, 'crystal' is the new crystal.
+static attemptOutcome runAttempt(const randSpgInput& input,
+                                 const WyckAssignmentSampler& sampler,
+                                 const shared_ptr<const RandSpgContext>&
+                                   context,
+                                 const RandSpgDeadline& deadline,
+                                 size_t i, Crystal& crystal, string& log)
+{
+  uint spg = input.spg;
+  char verbosity = context->hasLogSink() ? input.verbosity : 'n';
+  attemptOutcome ret;
+
+  ret.expired = deadline.check();
+  if (ret.expired != RandSpgDeadline::notExpired) return ret;
+
+  crystal = createValidCrystal(spg, input.latticeMins, input.latticeMaxes,
+                               input.minVolume, input.maxVolume);
+  crystal.setContext(context);
+
+  // Now, let's assign some atoms!
+  atomAssignments assignments = sampler.sample();
+
+  //printAtomAssignments(assignments);
+  // If we desire any output, print the atom assignments to the log file
+  if (verbosity == 'r' || verbosity == 'v')
+    log += RandSpg::getAtomAssignmentsString(assignments);
+
+  if (assignments.size() == 0) {
+    cout << "Error in RandSpg::randSpgXtal(): atoms were not successfully"
+         << " assigned positions in assignAtomsToWyckPos()\n";
+    return ret;
+  }
+
+#ifdef RANDSPG_DEBUG
+  cout << "\natomAssignments are the following (atomicNum, wyckLet, wyckPos):"
+       << "\n";
+  for (size_t j = 0; j < assignments.size(); j++)
+    cout << "  " << assignments[j].second << ", "
+         << RandSpg::getWyckLet(assignments[j].first)
+         << ", " << RandSpg::getWyckCoords(assignments[j].first) << "\n";
+  cout << "\n";
+#endif
+
+  ret.numPositions = assignments.size();
+  bool assignmentsSuccessful = true;
+  for (size_t j = 0; j < assignments.size(); j++) {
+    const wyckPos& pos = assignments[j].first;
+    uint atomicNum = assignments[j].second;
+    if (!RandSpg::addWyckoffAtomRandomly(crystal, pos, atomicNum, spg, 1000,
+                                         deadline)) {
+      assignmentsSuccessful = false;
+      break;
+    }
+    ret.numPlaced++;
+  }
+
+  // If we succeeded, and the number of atoms match, return the crystal!
+  // There are rare cases where an atom may be placed on top of another
+  // one and the essentially get merged into one. We check to make sure the
+  // sizes of the atomic numbers match for this reason. We shouldn't have to
+  // worry about types.
+  if (assignmentsSuccessful &&
+      input.atoms.size() == crystal.getVectorOfAtomicNums().size()) {
+    if (verbosity != 'n') log += "*** Success! ***\n";
+    ret.succeeded = true;
+    return ret;
+  }
+
+  ret.expired = deadline.check();
+  if (ret.expired != RandSpgDeadline::notExpired) return ret;
+
+  if (verbosity == 'r' || verbosity == 'v') {
+    log += "Failed to add atoms to satisfy MinIAD.\nObtaining new atom "
+           "assignments and trying again. Failure count: ";
+    log += to_string(i + 1);
+    log += "\n\n";
+  }
+  return ret;
+}
+
+// Run the attempts of randSpgCrystal() on several threads. Every attempt
+// has its own random numbers, seeded with one number drawn on the calling
+// thread and the index of the attempt. The outcomes are looked at in the
+// order of their indices: the first success ends the attempts, and so do
+// the early abort rule and the deadline. No attempt after the end is
+// started, and the ones after it that are running are stopped. So the
+// result and the log are the same no matter how many threads there are or
+// how long each attempt takes.
+static randSpgStatus runParallelAttempts(const randSpgInput& input,
+                                         const WyckAssignmentSampler& sampler,
+                                         const shared_ptr<const RandSpgContext>&
+                                           context,
+                                         const RandSpgDeadline& deadline,
+                                         earlyAbortRule& rule, Crystal& ret)
+{
+  size_t numAttempts = max(input.maxAttempts, 0);
+  unsigned int baseSeed = getRandInt(0, INT_MAX);
+  // An attempt is not started until every attempt this many before it has
+  // been looked at, so the outcomes that are kept stay few
+  size_t window = 4 * static_cast<size_t>(input.numParallelAttempts);
+
+  // The state shared by the workers
+  size_t nextAttempt = 0;
+  // No attempt after this one is needed. It is the first success found so
+  // far or the attempt after which the rule stopped us.
+  size_t lastNeeded = numAttempts;
+  mutex m;
+  condition_variable checked;
+  // The outcomes and logs of the attempts that are done but not looked at
+  map<size_t, pair<attemptOutcome, string>> completed;
+  // The stop flags of the attempts that are running
+  map<size_t, atomic<bool>*> running;
+  Crystal neededCrystal;
+  // Every attempt before this one has been looked at, and its log is here.
+  // The log is written on the calling thread, like that of the other
+  // attempts, once they are all done.
+  size_t numChecked = 0;
+  string neededLog;
+  randSpgStatus status = randSpgMaxAttemptsReached;
+
+  // Stop the attempts after 'lastNeeded'. m must be locked.
+  auto stopUnneeded = [&]()
+  {
+    for (auto it = running.upper_bound(lastNeeded); it != running.end(); ++it)
+      *it->second = true;
+    checked.notify_all();
+  };
+
+  auto worker = [&]()
+  {
+    unique_lock<mutex> lock(m);
+    while (true) {
+      checked.wait(lock, [&]() {
+        return nextAttempt >= numAttempts || nextAttempt > lastNeeded ||
+               nextAttempt < numChecked + window;
+      });
+      size_t i = nextAttempt++;
+      if (i >= numAttempts || i > lastNeeded) return;
+      atomic<bool> stop(false);
+      running[i] = &stop;
+      lock.unlock();
+
+      seed_seq seq{baseSeed, static_cast<unsigned int>(i)};
+      unsigned int attemptSeed;
+      seq.generate(&attemptSeed, &attemptSeed + 1);
+      seedRandEngine(attemptSeed);
+
+      RandSpgDeadline attemptDeadline = deadline;
+      attemptDeadline.setStopFlag(&stop);
+      Crystal attemptCrystal;
+      string log;
+      attemptOutcome outcome = runAttempt(input, sampler, context,
+                                          attemptDeadline, i, attemptCrystal,
+                                          log);
+
+      lock.lock();
+      running.erase(i);
+      // A stopped attempt is after the end, so it is never looked at
+      if (i > lastNeeded) continue;
+      if (outcome.succeeded) {
+        neededCrystal = attemptCrystal;
+        lastNeeded = i;
+        stopUnneeded();
+      }
+      completed[i] = make_pair(outcome, log);
+
+      // Look at the outcomes that are now complete, in order. Each one that
+      // is looked at is needed, so its log is final.
+      while (status == randSpgMaxAttemptsReached &&
+             numChecked < numAttempts && numChecked <= lastNeeded) {
+        auto it = completed.find(numChecked);
+        if (it == completed.end()) break;
+        attemptOutcome o = it->second.first;
+        neededLog += it->second.second;
+        completed.erase(it);
+        if (o.succeeded) {
+          status = randSpgSucceeded;
+          break;
+        }
+        if (o.expired != RandSpgDeadline::notExpired) {
+          status = getExpiredStatus(o.expired);
+          lastNeeded = numChecked;
+          stopUnneeded();
+          break;
+        }
+        rule.addFailure(o);
+        if (rule.shouldAbort()) {
+          status = randSpgAbortedEarly;
+          lastNeeded = numChecked;
+          stopUnneeded();
+          break;
+        }
+        numChecked++;
+      }
+      checked.notify_all();
+    }
+  };
+
+  // One of the workers runs on this thread. While we wait, the pool runs
+  // the workers we submitted that have not started on this thread, so this
+  // cannot deadlock. The attempts reseed the random engine of the thread
+  // they run on, so the caller's engine is put back afterwards.
+  mt19937 callerEngine = getRandEngine();
+  shared_ptr<ThreadPool> pool = ThreadPool::global();
+  vector<future<void>> futures;
+  for (size_t i = 1; i < input.numParallelAttempts; i++)
+    futures.push_back(pool->submit(worker));
+  worker();
+  for (size_t i = 0; i < futures.size(); i++) pool->wait(futures[i]);
+  getRandEngine() = callerEngine;
+
+  if (!neededLog.empty()) context->log(neededLog);
+  if (status == randSpgSucceeded) ret = neededCrystal;
+  return status;
+}
+
+// Get the possibilities for the input from the cache. The search stops if
+// the time limit of the input passes or its cancel token expires first, and
+// then 'expired' says why.
+static shared_ptr<const cachedPossibilities> getCachedPossibilities(
+  const randSpgInput& input, RandSpgDeadline::reason& expired)
+{
+  expired = RandSpgDeadline::notExpired;
+  try {
+    return PossibilitiesCache::getPossibilities(
+             input.spg, input.atoms, input.forceMostGeneralWyckPos,
+             input.forcedWyckAssignments,
+             RandSpgDeadline(input.timeLimit, input.cancelToken));
+  }
+  catch (const RandSpgExpiredError& e) {
+    expired = e.getReason();
+    return make_shared<const cachedPossibilities>();
+  }
+}
+
+RandSpgGenerator::RandSpgGenerator(const randSpgInput& input) :
+  RandSpgGenerator(input, make_shared<const RandSpgContext>(input))
+{
+}
+
+RandSpgGenerator::RandSpgGenerator(
+  const randSpgInput& input,
+  const shared_ptr<const RandSpgContext>& context) :
+  m_input(input),
+  m_context(context),
+  // The possibilities are only found once for each set of inputs. Every
+  // later generator with the same inputs gets them from the cache.
+  m_cached(getCachedPossibilities(input, m_setupExpired))
+{
+  // The sampler is kept with the cached possibilities, so its tables are
+  // only built once for each set of inputs
+  if (isPossible()) m_sampler = m_cached->getSampler(input.wyckSampling);
+}
+
+bool RandSpgGenerator::isPossible() const
+{
+  return m_setupExpired == RandSpgDeadline::notExpired &&
+         m_cached->status == possibilitiesFound;
+}
+
+Crystal RandSpgGenerator::generate() const
+{
+  randSpgStatus status;
+  return generate(status);
+}
+
+Crystal RandSpgGenerator::generate(randSpgStatus& status) const
+{
+  START_FT;
+
+  // The time limit starts now
+  RandSpgDeadline deadline(m_input.timeLimit, m_input.cancelToken);
+
+  // Convenience: so we don't have to say 'input.<option>' for every call
+  const randSpgInput& input                                     = m_input;
+  const shared_ptr<const RandSpgContext>& context               = m_context;
+  uint spg                                                      = input.spg;
+  char verbosity                                                = context->hasLogSink() ? input.verbosity : 'n';
+  int numAttempts                                               = input.maxAttempts;
+  const systemPossibilities& possibilities                      = m_cached->possibilities;
+
+  if (m_setupExpired != RandSpgDeadline::notExpired) {
+    status = getExpiredStatus(m_setupExpired);
+    stringstream errMsg;
+    errMsg << "Stopped while finding the Wyckoff position possibilities: "
+           << (status == randSpgTimedOut ? "the time limit was reached" :
+                                           "the generation was cancelled")
+           << ".\nFailed to generate a crystal of spg " << spg << ".\n";
+    if (verbosity != 'n') context->log(errMsg.str());
+    cerr << errMsg.str();
+    return Crystal();
+  }
+
+  status = randSpgNoPossibilities;
+
+  if (m_cached->status == noPossibilitiesForComposition) {
+    cout << "Error in RandSpgGenerator::" << __FUNCTION__ << "(): this spg '"
+         << spg << "' cannot be generated with this composition\n";
+    return Crystal();
+  }
+
+  if (m_cached->status == noPossibilitiesWithGeneralWyckPos) {
+    cout << "Error in RandSpgGenerator::" << __FUNCTION__ << "(): this spg '"
+         << spg << "' cannot be generated with this composition.\n";
+    cout << "It can be generated if option 'forceMostGeneralWyckPos' is "
+         << "turned off, but the correct spacegroup will not be guaranteed.\n";
+    return Crystal();
+  }
+
+  if (m_cached->status == noPossibilitiesWithForcedWyckPos) {
+    cout << "Error in RandSpgGenerator::" << __FUNCTION__ << "(): this spg '"
+         << spg << "' cannot be generated with this composition due to the forced "
+         << "Wyckoff position constraints.\nPlease change them or remove them "
+         << "if you wish to generate the space group.\n";
+    return Crystal();
+  }
+
+  //RandSpgCombinatorics::printSystemPossibilities(possibilities);
+  // If we desire verbose output, print the system possibilities to the log
+  // file one at a time
+  if (verbosity == 'v') {
+    RandSpgCombinatorics::writeVerbosePossibilities(
+      possibilities,
+      [&context](const string& text) { context->log(text); },
+      input.maxVerbosePossibilities);
+  }
+
+  earlyAbortRule rule(input.earlyAbortThreshold, max(numAttempts, 0));
+  Crystal ret;
+  status = randSpgMaxAttemptsReached;
+  if (input.numParallelAttempts > 1) {
+    status = runParallelAttempts(input, *m_sampler, context, deadline, rule,
+                                 ret);
+  }
+  else {
+    // Begin the attempt loop!
+    for (size_t i = 0; i < numAttempts; i++) {
+      string log;
+      attemptOutcome outcome = runAttempt(input, *m_sampler, context, deadline,
+                                          i, ret, log);
+      if (!log.empty()) context->log(log);
+      if (outcome.succeeded) {
+        status = randSpgSucceeded;
+        break;
+      }
+      if (outcome.expired != RandSpgDeadline::notExpired) {
+        status = getExpiredStatus(outcome.expired);
+        break;
+      }
+      rule.addFailure(outcome);
+      if (rule.shouldAbort()) {
+        status = randSpgAbortedEarly;
+        break;
+      }
+    }
+  }
+
+  if (status == randSpgSucceeded) return ret;
+
+  // If we made it here, we failed to generate the crystal
+  stringstream errMsg;
+  if (status == randSpgAbortedEarly) {
+    errMsg << rule.getReason() << "Failed to generate a crystal of spg "
+           << spg << ".\n";
+  }
+  else if (status == randSpgTimedOut || status == randSpgCancelled) {
+    errMsg << "Stopped after " << rule.getNumAttempts() << " attempts: "
+           << (status == randSpgTimedOut ? "the time limit was reached" :
+                                           "the generation was cancelled")
+           << ".\nFailed to generate a crystal of spg " << spg << ".\n";
+  }
+  else {
+    errMsg << "After " << numAttempts << " attempts: failed to generate "
+           << "a crystal of spg " << spg << ".\n";
+  }
+  if (verbosity != 'n') context->log(errMsg.str());
+  cerr << errMsg.str();
+  return Crystal();
+}
+
+crystalBatch RandSpgGenerator::generateBatch(size_t n,
+                                             randSpgStatus& status) const
+{
+  crystalBatch ret;
+  // Every crystal that succeeds has all of the atoms of the input
+  ret.reserve(n, n * m_input.atoms.size());
+  status = randSpgSucceeded;
+  for (size_t i = 0; i < n; i++) {
+    Crystal c = generate(status);
+    if (status != randSpgSucceeded) break;
+    ret.append(c);
+  }
+  return ret;
+}
+
+RandSpgGenerator::iterator::iterator(crystalRange* range, size_t count) :
+  m_range(range), m_remaining(count)
+{
+  next();
+}
+
+void RandSpgGenerator::iterator::next()
+{
+  if (m_remaining == 0) {
+    m_range = nullptr;
+    return;
+  }
+  m_remaining--;
+  m_crystal = m_range->m_generator->generate(m_range->m_status);
+  if (m_range->m_status != randSpgSucceeded) m_range = nullptr;
+}
+
+RandSpgGenerator::iterator& RandSpgGenerator::iterator::operator++()
+{
+  next();
+  return *this;
+}
+
+RandSpgGenerator::iterator RandSpgGenerator::iterator::operator++(int)
+{
+  iterator ret = *this;
+  next();
+  return ret;
+}
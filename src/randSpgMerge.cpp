@@ -0,0 +1,128 @@
+/**********************************************************************
+  randSpgMerge.cpp -- Merges the shards of a randSpg run (made with
+                      '--shard i/N') into one log file and summary.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "shardResults.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3) {
+    cout << "Usage: ./randSpgMerge <mergedLogFileName> "
+         << "<shardResultsFile> [<shardResultsFile> ...]\n";
+    return -1;
+  }
+
+  vector<shardResults> shards;
+  for (int i = 2; i < argc; i++) {
+    shardResults shard;
+    if (!ShardResults::read(argv[i], shard)) return -1;
+    shards.push_back(shard);
+  }
+
+  shardResults merged;
+  string error;
+  if (!ShardResults::merge(shards, merged, error)) {
+    cout << "Error: the shards could not be merged: " << error << ".\n";
+    return -1;
+  }
+
+  size_t numAttempts = merged.jobs.size();
+  size_t numSucceeds = 0, numAbortedEarly = 0, numTimedOut = 0;
+  size_t numSkipped = 0, numDuplicates = 0, numDuplicateRetries = 0;
+  double successTime = 0, failTime = 0, duplicateTime = 0;
+  for (size_t i = 0; i < merged.jobs.size(); i++) {
+    const jobRecord& job = merged.jobs[i];
+    if (job.status == jobSucceeded) {
+      successTime += job.time;
+      numSucceeds++;
+    }
+    else if (job.status == jobDuplicate) {
+      duplicateTime += job.time;
+      numDuplicates++;
+    }
+    else failTime += job.time;
+    if (job.status == jobAbortedEarly) numAbortedEarly++;
+    if (job.status == jobTimedOut) numTimedOut++;
+    if (job.status == jobSkipped) numSkipped++;
+    numDuplicateRetries += job.duplicateRetries;
+  }
+  size_t numFails = numAttempts - numSucceeds - numDuplicates;
+
+  stringstream summary;
+  summary << "\n-------------------------------------------------------------\n"
+          << "Number of structures attempted: " << numAttempts << "\n"
+          << "Number of structures succeeded: " << numSucceeds << "\n";
+  if (merged.earlyAbort) {
+    summary << "Number of structures stopped early: " << numAbortedEarly
+            << "\n";
+  }
+  if (merged.timeLimit) {
+    summary << "Number of structures that ran out of time: " << numTimedOut
+            << "\n";
+  }
+  if (merged.spgTimeBudget) {
+    summary << "Number of structures skipped by the spacegroup time budget: "
+            << numSkipped << "\n";
+  }
+  if (merged.removeDuplicates) {
+    // Each shard only removes the duplicates of its own structures
+    size_t numMade = numSucceeds + numDuplicates + numDuplicateRetries;
+    size_t numFound = numDuplicates + numDuplicateRetries;
+    summary << "Number of duplicate structures made again: "
+            << numDuplicateRetries << "\n"
+            << "Number of duplicate structures removed: " << numDuplicates
+            << "\n"
+            << "Duplicate rate: " << numFound << " of " << numMade
+            << " structures made ("
+            << (numMade != 0 ? 100.0 * numFound / numMade : 0) << "%)\n";
+  }
+  summary << "Number of shards: " << merged.numShards << "\n"
+          << "Longest shard setup wall time (in seconds): "
+          << merged.setupTime << "\n"
+          << "Longest shard generation wall time (in seconds): "
+          << merged.loopTime << "\n"
+          << "Sum of the job wall times (in seconds): "
+          << successTime + failTime + duplicateTime << "\n"
+          << "Average success wall time (in seconds): "
+          << ((numSucceeds != 0) ?
+              successTime / ((double)numSucceeds) : 0)
+          << "\n"
+          << "Average failure wall time (in seconds): "
+          << ((numFails != 0) ? failTime / ((double)numFails) : 0)
+          << "\n"
+          << "------------------------------------------------------------ \n";
+
+  // The log looks like that of a run without shards: the options, the seed,
+  // and then the log of every job in order
+  ofstream log(argv[1]);
+  if (!log.is_open()) {
+    cout << "Error: could not open the merged log file, " << argv[1]
+         << ", for writing.\n";
+    return -1;
+  }
+  log << merged.optionsString
+      << "Seed used: " << merged.seed << "\n";
+  for (size_t i = 0; i < merged.jobs.size(); i++) log << merged.jobs[i].log;
+  log << summary.str();
+
+  cout << summary.str();
+  return 0;
+}
@@ -45,7 +45,20 @@ m_minVolume(-1),
 m_maxVolume(-1),
 m_maxAttempts(100),
 m_outputDir("."),
+m_outputFormat("poscar"),
+m_removeDuplicates(false),
+m_duplicateRetries(0),
 m_verbosity('r'),
+m_maxVerbosePossibilities(100),
+m_combinatoricsCacheFile(""),
+m_wyckSampling(wyckSamplingOptions()),
+m_numThreads(1),
+m_numParallelAttempts(1),
+m_earlyAbortThreshold(0.0),
+m_timeLimit(0.0),
+m_spgTimeBudget(0.0),
+m_seed(-1),
+m_jobCostHistoryFile(""),
 m_optionsAreValid(true)
 {
 
@@ -286,6 +299,32 @@ void RandSpgOptions::interpretLineAndSetOption(string line)
   else if (option == "outputDir") {
     m_outputDir = value;
   }
+  else if (option == "outputFormat") {
+    if (value != "poscar" && value != "poscarContainer" &&
+        value != "xyzContainer" && value != "binary" && value != "binary32" &&
+        value != "cif") {
+      cerr << "Error: the value given for outputFormat, '" << value << "', "
+           << "is not a valid option!\nValid options are: 'poscar', 'cif', "
+           << "'poscarContainer', 'xyzContainer', 'binary', or 'binary32'\n";
+      m_optionsAreValid = false;
+      return;
+    }
+    m_outputFormat = value;
+  }
+  else if (option == "removeDuplicates") {
+    if (value[0] == 'F' || value[0] == 'f')
+      m_removeDuplicates = false;
+    else if (value[0] == 'T' || value[0] == 't')
+      m_removeDuplicates = true;
+    else {
+      cerr << "Error reading 'removeDuplicates' setting: " << value
+           << "\nValid settings are 'True' or 'False' or 'T' or 'F'\n";
+      cerr << "The value will remain the default: false\n";
+    }
+  }
+  else if (option == "duplicateRetries") {
+    m_duplicateRetries = stoi(value);
+  }
   else if (option == "verbosity") {
     if (value[0] != 'n' && value[0] != 'r' && value[0] != 'v') {
       cerr << "Error: the value given for verbosity, '" << value << "', is "
@@ -296,6 +335,64 @@ void RandSpgOptions::interpretLineAndSetOption(string line)
     }
     m_verbosity = value[0];
   }
+  else if (option == "maxVerbosePossibilities") {
+    m_maxVerbosePossibilities = stoul(value);
+  }
+  else if (option == "combinatoricsCacheFile") {
+    m_combinatoricsCacheFile = value;
+  }
+  else if (option == "wyckSamplingPolicy") {
+    if (!getWyckSamplingPolicy(value, m_wyckSampling.policy)) {
+      cerr << "Error: the value given for wyckSamplingPolicy, '" << value
+           << "', is not a valid option!\nValid options are: "
+           << "uniformPossibilities, uniformAssignments, "
+           << "favorGeneralWyckPos, or wyckLetterWeights\n";
+      m_optionsAreValid = false;
+      return;
+    }
+  }
+  else if (option == "generalWyckPosWeight") {
+    m_wyckSampling.generalWyckPosWeight = stof(value);
+  }
+  else if (contains(option, "wyckLetterWeight")) {
+    // There should be a space after 'wyckLetterWeight' with the letter there
+    vector<string> tempSplit = split(option, ' ');
+    if (tempSplit.size() != 2 || tempSplit[1].size() != 1) {
+      cerr << "Error reading 'wyckLetterWeight' option: " << line
+           << "\nProper format is: wyckLetterWeight <char> = <value>\n";
+      m_optionsAreValid = false;
+      return;
+    }
+    m_wyckSampling.letterWeights.push_back(make_pair(tempSplit[1][0],
+                                                     stof(value)));
+  }
+  else if (option == "numThreads") {
+    m_numThreads = stoi(value);
+  }
+  else if (option == "numParallelAttempts") {
+    m_numParallelAttempts = stoi(value);
+  }
+  else if (option == "earlyAbortThreshold") {
+    m_earlyAbortThreshold = stof(value);
+  }
+  else if (option == "timeLimit") {
+    m_timeLimit = stof(value);
+  }
+  else if (option == "spgTimeBudget") {
+    m_spgTimeBudget = stof(value);
+  }
+  else if (option == "seed") {
+    m_seed = stoi(value);
+    if (m_seed < 0) {
+      cerr << "Error: the value given for seed, '" << value << "', is "
+           << "negative!\nThe seed must be zero or a positive integer\n";
+      m_optionsAreValid = false;
+      return;
+    }
+  }
+  else if (option == "jobCostHistoryFile") {
+    m_jobCostHistoryFile = value;
+  }
   else {
     cerr << "Warning: the following line contained an unrecognizable option: "
          << line << "\n";
@@ -400,7 +497,40 @@ string RandSpgOptions::getOptionsString() const
   s << "scalingFactor: " << m_scalingFactor << "\n";
   s << "maxAttempts: " << m_maxAttempts << "\n";
   s << "outputDir: " << m_outputDir << "\n";
+  if (m_outputFormat != "poscar")
+    s << "outputFormat: " << m_outputFormat << "\n";
+  if (m_removeDuplicates) {
+    s << "removeDuplicates: true\n";
+    s << "duplicateRetries: " << m_duplicateRetries << "\n";
+  }
   s << "output verbosity: " << m_verbosity << "\n";
+  if (m_verbosity == 'v')
+    s << "maxVerbosePossibilities: " << m_maxVerbosePossibilities << "\n";
+  if (!m_combinatoricsCacheFile.empty())
+    s << "combinatoricsCacheFile: " << m_combinatoricsCacheFile << "\n";
+  s << "wyckSamplingPolicy: "
+    << getWyckSamplingPolicyName(m_wyckSampling.policy) << "\n";
+  if (m_wyckSampling.policy == favorGeneralWyckPos)
+    s << "generalWyckPosWeight: " << m_wyckSampling.generalWyckPosWeight
+      << "\n";
+  if (m_wyckSampling.policy == wyckLetterWeights) {
+    s << "wyckLetterWeights: \n";
+    for (size_t i = 0; i < m_wyckSampling.letterWeights.size(); i++) {
+      s << "  " << m_wyckSampling.letterWeights[i].first << ": "
+        << m_wyckSampling.letterWeights[i].second << "\n";
+    }
+  }
+  s << "numThreads: " << m_numThreads << "\n";
+  s << "numParallelAttempts: " << m_numParallelAttempts << "\n";
+  if (m_earlyAbortThreshold > 0)
+    s << "earlyAbortThreshold: " << m_earlyAbortThreshold << "\n";
+  if (m_timeLimit > 0) s << "timeLimit: " << m_timeLimit << "\n";
+  if (m_spgTimeBudget > 0)
+    s << "spgTimeBudget: " << m_spgTimeBudget << "\n";
+  if (m_seed == -1) s << "seed: random\n";
+  else s << "seed: " << m_seed << "\n";
+  if (!m_jobCostHistoryFile.empty())
+    s << "jobCostHistoryFile: " << m_jobCostHistoryFile << "\n";
   s << "\n";
   return s.str();
 }
@@ -0,0 +1,245 @@
+/**********************************************************************
+  shardResults.cpp - The results of one shard of a randSpg run, and how to
+                     merge the shards of a run back together.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "shardResults.h"
+#include "utilityFunctions.h"
+
+using namespace std;
+
+// Increment this if the layout of the results file changes
+static const uint shardResultsVersion = 2;
+
+bool ShardResults::parseShardArgument(const string& s, size_t& shardIndex,
+                                      size_t& numShards)
+{
+  vector<string> theSplit = split(s, '/');
+  if (theSplit.size() != 2 || !isNumber(trim(theSplit[0])) ||
+      !isNumber(trim(theSplit[1])))
+    return false;
+
+  shardIndex = stoul(trim(theSplit[0]));
+  numShards = stoul(trim(theSplit[1]));
+  return numShards > 0 && shardIndex < numShards;
+}
+
+static string getShardFileName(const string& logFileName, size_t shardIndex,
+                               size_t numShards, const string& ending)
+{
+  string base = logFileName;
+  if (hasEnding(base, ".log")) base = base.substr(0, base.length() - 4);
+  return base + ".shard-" + to_string(shardIndex) + "-of-" +
+         to_string(numShards) + ending;
+}
+
+string ShardResults::getResultsFileName(const string& logFileName,
+                                        size_t shardIndex, size_t numShards)
+{
+  return getShardFileName(logFileName, shardIndex, numShards, ".results");
+}
+
+string ShardResults::getLogFileName(const string& logFileName,
+                                    size_t shardIndex, size_t numShards)
+{
+  return getShardFileName(logFileName, shardIndex, numShards, ".log");
+}
+
+bool ShardResults::write(const string& fileName, const shardResults& results)
+{
+  ofstream f(fileName, ios::binary);
+  if (!f.is_open()) {
+    cout << "Error: could not open the shard results file, " << fileName
+         << ", for writing.\n";
+    return false;
+  }
+
+  f << setprecision(17);
+  f << "randSpg shard results " << shardResultsVersion << "\n"
+    << "shard " << results.shardIndex << " " << results.numShards << "\n"
+    << "seed " << results.seed << "\n"
+    << "numJobs " << results.numJobs << "\n"
+    << "setupTime " << results.setupTime << "\n"
+    << "loopTime " << results.loopTime << "\n"
+    << "rules " << results.earlyAbort << " " << results.timeLimit << " "
+    << results.spgTimeBudget << " " << results.removeDuplicates << "\n"
+    << "options " << results.optionsString.size() << "\n"
+    << results.optionsString;
+  for (size_t i = 0; i < results.jobs.size(); i++) {
+    const jobRecord& job = results.jobs[i];
+    f << "job " << job.index << " " << job.spg << " " << job.spgIndex << " "
+      << getJobStatusName(job.status) << " " << job.duplicateRetries << " "
+      << job.time << " " << job.log.size() << "\n"
+      << job.log;
+  }
+  return f.good();
+}
+
+// Read a number of bytes that follow the end of the current line
+static bool readText(istream& is, size_t size, string& text)
+{
+  if (is.get() != '\n') return false;
+  text.resize(size);
+  if (size != 0) is.read(&text[0], size);
+  return is.good() ||
+         (is.eof() && static_cast<size_t>(is.gcount()) == size);
+}
+
+static bool readJobStatus(istream& is, jobStatus& status)
+{
+  string name;
+  if (!(is >> name)) return false;
+  for (int i = jobSucceeded; i <= jobDuplicate; i++) {
+    if (name == getJobStatusName(static_cast<jobStatus>(i))) {
+      status = static_cast<jobStatus>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ShardResults::read(const string& fileName, shardResults& results)
+{
+  ifstream f(fileName, ios::binary);
+  if (!f.is_open()) {
+    cout << "Error: could not open the shard results file, " << fileName
+         << ".\n";
+    return false;
+  }
+
+  results = shardResults();
+  string word1, word2, word3;
+  uint version = 0;
+  size_t optionsSize = 0;
+  bool ok = (f >> word1 >> word2 >> word3 >> version) &&
+            word1 == "randSpg" && word2 == "shard" && word3 == "results";
+  if (ok && version != shardResultsVersion) {
+    cout << "Error: the shard results file, " << fileName << ", has version "
+         << version << ", but version " << shardResultsVersion
+         << " is needed.\n";
+    return false;
+  }
+  ok = ok &&
+       (f >> word1 >> results.shardIndex >> results.numShards) &&
+       word1 == "shard" && results.shardIndex < results.numShards &&
+       (f >> word1 >> results.seed) && word1 == "seed" &&
+       (f >> word1 >> results.numJobs) && word1 == "numJobs" &&
+       (f >> word1 >> results.setupTime) && word1 == "setupTime" &&
+       (f >> word1 >> results.loopTime) && word1 == "loopTime" &&
+       (f >> word1 >> results.earlyAbort >> results.timeLimit
+          >> results.spgTimeBudget >> results.removeDuplicates) &&
+       word1 == "rules" &&
+       (f >> word1 >> optionsSize) && word1 == "options" &&
+       readText(f, optionsSize, results.optionsString);
+
+  while (ok && f >> word1) {
+    jobRecord job;
+    size_t logSize;
+    ok = word1 == "job" &&
+         (f >> job.index >> job.spg >> job.spgIndex) &&
+         readJobStatus(f, job.status) &&
+         (f >> job.duplicateRetries >> job.time >> logSize) &&
+         readText(f, logSize, job.log);
+    if (ok) results.jobs.push_back(job);
+  }
+
+  if (!ok) {
+    cout << "Error: the shard results file, " << fileName
+         << ", could not be read.\n";
+    return false;
+  }
+  return true;
+}
+
+bool ShardResults::merge(const vector<shardResults>& shards,
+                         shardResults& merged, string& error)
+{
+  if (shards.empty()) {
+    error = "no shards were given";
+    return false;
+  }
+
+  const shardResults& first = shards[0];
+  vector<bool> found(first.numShards, false);
+  for (size_t i = 0; i < shards.size(); i++) {
+    const shardResults& shard = shards[i];
+    if (shard.numShards != first.numShards || shard.seed != first.seed ||
+        shard.numJobs != first.numJobs ||
+        shard.earlyAbort != first.earlyAbort ||
+        shard.timeLimit != first.timeLimit ||
+        shard.spgTimeBudget != first.spgTimeBudget ||
+        shard.removeDuplicates != first.removeDuplicates ||
+        shard.optionsString != first.optionsString) {
+      error = "shard " + to_string(shard.shardIndex) + " of " +
+              to_string(shard.numShards) + " is not from the same run as "
+              "shard " + to_string(first.shardIndex) + " of " +
+              to_string(first.numShards);
+      return false;
+    }
+    if (shard.shardIndex >= shard.numShards) {
+      error = "shard " + to_string(shard.shardIndex) + " of " +
+              to_string(shard.numShards) + " does not exist";
+      return false;
+    }
+    if (found[shard.shardIndex]) {
+      error = "shard " + to_string(shard.shardIndex) + " was given twice";
+      return false;
+    }
+    found[shard.shardIndex] = true;
+  }
+  for (size_t i = 0; i < found.size(); i++) {
+    if (!found[i]) {
+      error = "shard " + to_string(i) + " of " + to_string(first.numShards) +
+              " is missing";
+      return false;
+    }
+  }
+
+  merged = shardResults();
+  merged.numShards = first.numShards;
+  merged.seed = first.seed;
+  merged.numJobs = first.numJobs;
+  merged.earlyAbort = first.earlyAbort;
+  merged.timeLimit = first.timeLimit;
+  merged.spgTimeBudget = first.spgTimeBudget;
+  merged.removeDuplicates = first.removeDuplicates;
+  merged.optionsString = first.optionsString;
+  for (size_t i = 0; i < shards.size(); i++) {
+    merged.setupTime = max(merged.setupTime, shards[i].setupTime);
+    merged.loopTime = max(merged.loopTime, shards[i].loopTime);
+    merged.jobs.insert(merged.jobs.end(), shards[i].jobs.begin(),
+                       shards[i].jobs.end());
+  }
+  sort(merged.jobs.begin(), merged.jobs.end(),
+       [](const jobRecord& a, const jobRecord& b) { return a.index < b.index; });
+
+  if (merged.jobs.size() != merged.numJobs) {
+    error = "the shards have " + to_string(merged.jobs.size()) + " jobs, "
+            "but the run has " + to_string(merged.numJobs);
+    return false;
+  }
+  for (size_t i = 0; i < merged.jobs.size(); i++) {
+    if (merged.jobs[i].index != i) {
+      error = "job " + to_string(i) + " is missing or was run twice";
+      return false;
+    }
+  }
+  return true;
+}
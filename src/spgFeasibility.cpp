@@ -0,0 +1,255 @@
+/**********************************************************************
+  spgFeasibility.cpp - Fast checks for whether a composition may be
+                       generated with a spacegroup.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+
+#include "randSpg.h"
+#include "spgFeasibility.h"
+
+using namespace std;
+
+// Everything we need to know about a spacegroup to check a composition
+struct spgFeasibilityInfo {
+  // Bit n is set if n atoms can be placed in the non-unique positions.
+  // Only valid for n < sumsLimit.
+  vector<uint64_t> nonUniqueSums;
+  uint sumsLimit;
+  // The greatest common divisor of the non-unique multiplicities (zero if
+  // there are no non-unique positions). Every multiple of it that is at
+  // least 'sumsLimit' can be made with the non-unique positions.
+  uint nonUniqueGcd;
+
+  // The multiplicity and the number of unique positions in each group of
+  // unique positions with the same multiplicity
+  vector<uint> uniqueMults;
+  vector<uint> uniqueCounts;
+
+  // A 'state' is the number of positions used in each unique group, stored
+  // as a mixed-radix number. These are the digits and the number of atoms
+  // placed for each state.
+  uint numStates;
+  vector<vector<uint>> stateDigits;
+  vector<uint> stateNumAtoms;
+
+  spgFeasibilityInfo() : sumsLimit(0), nonUniqueGcd(0), numStates(1) {}
+};
+
+static spgFeasibilityInfo feasibilityInfo[231];
+static once_flag feasibilityInfoFlags[231];
+
+static inline uint gcd(uint a, uint b)
+{
+  while (b != 0) {
+    uint t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+static inline bool bitIsSet(const vector<uint64_t>& bits, uint i)
+{
+  return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+// bits |= (bits << shift), treating 'bits' as one long number
+static void orShiftedBits(vector<uint64_t>& bits, uint shift)
+{
+  size_t wordShift = shift / 64;
+  uint bitShift = shift % 64;
+  for (size_t w = bits.size(); w-- > wordShift; ) {
+    uint64_t v = bits[w - wordShift] << bitShift;
+    if (bitShift != 0 && w - wordShift > 0)
+      v |= bits[w - wordShift - 1] >> (64 - bitShift);
+    bits[w] |= v;
+  }
+}
+
+static void buildFeasibilityInfo(uint spg)
+{
+  spgFeasibilityInfo& info = feasibilityInfo[spg];
+  const wyckoffPositions& wyckVec = RandSpg::getWyckoffPositions(spg);
+
+  vector<uint> nonUniqueMults;
+  uint maxMult = 1;
+  for (size_t i = 0; i < wyckVec.size(); i++) {
+    uint mult = RandSpg::getMultiplicity(wyckVec[i]);
+    maxMult = max(maxMult, mult);
+    if (!RandSpg::containsUniquePosition(wyckVec[i])) {
+      if (find(nonUniqueMults.begin(), nonUniqueMults.end(), mult) ==
+          nonUniqueMults.end())
+        nonUniqueMults.push_back(mult);
+      continue;
+    }
+    vector<uint>::iterator it = find(info.uniqueMults.begin(),
+                                     info.uniqueMults.end(), mult);
+    if (it == info.uniqueMults.end()) {
+      info.uniqueMults.push_back(mult);
+      info.uniqueCounts.push_back(1);
+    }
+    else info.uniqueCounts[it - info.uniqueMults.begin()]++;
+  }
+
+  // The Frobenius number of the non-unique multiplicities is less than
+  // maxMult^2, so every larger multiple of the gcd can be made
+  info.sumsLimit = maxMult * maxMult + 1;
+  info.nonUniqueSums.assign(info.sumsLimit / 64 + 1, 0);
+  info.nonUniqueSums[0] = 1;
+  for (size_t i = 0; i < nonUniqueMults.size(); i++) {
+    uint mult = nonUniqueMults[i];
+    info.nonUniqueGcd = gcd(info.nonUniqueGcd, mult);
+    // After shifting by mult, 2 * mult, 4 * mult, ..., every number of
+    // copies of mult below the limit has been added
+    for (uint shift = mult; shift / 2 < info.sumsLimit; shift *= 2)
+      orShiftedBits(info.nonUniqueSums, shift);
+  }
+
+  // Set up the states of the unique positions
+  for (size_t i = 0; i < info.uniqueCounts.size(); i++)
+    info.numStates *= info.uniqueCounts[i] + 1;
+
+  info.stateDigits.resize(info.numStates);
+  info.stateNumAtoms.resize(info.numStates);
+  for (uint s = 0; s < info.numStates; s++) {
+    uint rest = s;
+    uint numAtoms = 0;
+    for (size_t i = 0; i < info.uniqueCounts.size(); i++) {
+      uint digit = rest % (info.uniqueCounts[i] + 1);
+      rest /= info.uniqueCounts[i] + 1;
+      info.stateDigits[s].push_back(digit);
+      numAtoms += digit * info.uniqueMults[i];
+    }
+    info.stateNumAtoms[s] = numAtoms;
+  }
+}
+
+static const spgFeasibilityInfo& getFeasibilityInfo(uint spg)
+{
+  call_once(feasibilityInfoFlags[spg], buildFeasibilityInfo, spg);
+  return feasibilityInfo[spg];
+}
+
+// Can 'numAtoms' atoms be placed in the non-unique positions alone?
+static inline bool fitsInNonUnique(const spgFeasibilityInfo& info,
+                                   uint numAtoms)
+{
+  if (numAtoms < info.sumsLimit)
+    return bitIsSet(info.nonUniqueSums, numAtoms);
+  return info.nonUniqueGcd != 0 && numAtoms % info.nonUniqueGcd == 0;
+}
+
+// Add the digits of two states. Returns false if any unique group would be
+// used more times than it has positions.
+static inline bool addStates(const spgFeasibilityInfo& info,
+                             uint s1, uint s2, uint& result)
+{
+  const vector<uint>& d1 = info.stateDigits[s1];
+  const vector<uint>& d2 = info.stateDigits[s2];
+  result = 0;
+  uint radix = 1;
+  for (size_t i = 0; i < d1.size(); i++) {
+    uint digit = d1[i] + d2[i];
+    if (digit > info.uniqueCounts[i]) return false;
+    result += digit * radix;
+    radix *= info.uniqueCounts[i] + 1;
+  }
+  return true;
+}
+
+bool SpgFeasibility::isSpgPossibleForCounts(uint spg,
+                                            const vector<uint>& numOfEachType)
+{
+  if (spg < 1 || spg > 230 || numOfEachType.empty()) return false;
+
+  const spgFeasibilityInfo& info = getFeasibilityInfo(spg);
+
+  // Which combined states of the unique positions can be reached after
+  // placing the types so far
+  vector<char> reachable(info.numStates, 0);
+  reachable[0] = 1;
+  vector<char> nextReachable(info.numStates);
+  vector<uint> typeStates;
+  for (size_t t = 0; t < numOfEachType.size(); t++) {
+    uint numAtoms = numOfEachType[t];
+
+    // The ways this type alone may use the unique positions
+    typeStates.clear();
+    for (uint s = 0; s < info.numStates; s++) {
+      uint numUnique = info.stateNumAtoms[s];
+      if (numUnique <= numAtoms && fitsInNonUnique(info, numAtoms - numUnique))
+        typeStates.push_back(s);
+    }
+    if (typeStates.empty()) return false;
+
+    fill(nextReachable.begin(), nextReachable.end(), 0);
+    bool anyReachable = false;
+    for (uint s = 0; s < info.numStates; s++) {
+      if (!reachable[s]) continue;
+      for (size_t i = 0; i < typeStates.size(); i++) {
+        uint combined;
+        if (addStates(info, s, typeStates[i], combined)) {
+          nextReachable[combined] = 1;
+          anyReachable = true;
+        }
+      }
+    }
+    if (!anyReachable) return false;
+    reachable.swap(nextReachable);
+  }
+  return true;
+}
+
+// Count the atoms of each type with a sort instead of nested loops
+static vector<uint> getCounts(const vector<uint>& atoms)
+{
+  vector<uint> sorted = atoms;
+  sort(sorted.begin(), sorted.end());
+  vector<uint> counts;
+  for (size_t i = 0; i < sorted.size(); ) {
+    size_t j = i;
+    while (j < sorted.size() && sorted[j] == sorted[i]) j++;
+    counts.push_back(j - i);
+    i = j;
+  }
+  return counts;
+}
+
+bool SpgFeasibility::isSpgPossible(uint spg, const vector<uint>& atoms)
+{
+  return isSpgPossibleForCounts(spg, getCounts(atoms));
+}
+
+spgMask SpgFeasibility::getPossibleSpgMask(const vector<uint>& atoms)
+{
+  vector<uint> counts = getCounts(atoms);
+  spgMask ret;
+  for (uint spg = 1; spg <= 230; spg++) {
+    if (isSpgPossibleForCounts(spg, counts)) ret.set(spg - 1);
+  }
+  return ret;
+}
+
+vector<spgMask> SpgFeasibility::getPossibleSpgMasks(
+                                const vector<vector<uint>>& compositions)
+{
+  vector<spgMask> ret;
+  ret.reserve(compositions.size());
+  for (size_t i = 0; i < compositions.size(); i++)
+    ret.push_back(getPossibleSpgMask(compositions[i]));
+  return ret;
+}
@@ -0,0 +1,330 @@
+/**********************************************************************
+  structureBinaryFile.cpp - Many structures in a binary file that can be
+                            memory-mapped and read without parsing.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "crystalBatch.h"
+#include "structureBinaryFile.h"
+
+using namespace std;
+
+// Increment this if the layout of the file changes
+static const uint32_t structureBinaryVersion = 1;
+
+static const char structureBinaryMagic[8] = "RSPGBIN";
+
+static_assert(sizeof(structureBinaryHeader) == 64,
+              "The header of a binary structure file must be 64 bytes");
+static_assert(sizeof(structureBinaryRecord) == 32,
+              "A structure record of a binary structure file must be 32 bytes");
+
+// The numbers are written as they are in memory, so the file is only
+// little-endian on a little-endian machine
+static bool isLittleEndian()
+{
+  uint16_t one = 1;
+  char first;
+  memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+static uint64_t roundUpTo8(uint64_t n)
+{
+  return (n + 7) / 8 * 8;
+}
+
+// Whether 'count' items of 'itemSize' bytes that start at 'offset' end by
+// 'end'. It is written so that nothing can overflow.
+static bool fitsBefore(uint64_t offset, uint64_t count, uint64_t itemSize,
+                       uint64_t end)
+{
+  return offset <= end && count <= (end - offset) / itemSize;
+}
+
+StructureBinaryWriter::StructureBinaryWriter() :
+  m_coordSize(8)
+{
+}
+
+StructureBinaryWriter::~StructureBinaryWriter()
+{
+  if (m_file.is_open()) close();
+}
+
+bool StructureBinaryWriter::open(const string& fileName, uint32_t coordSize)
+{
+  if (m_file.is_open()) close();
+  if (!isLittleEndian()) {
+    cout << "Error: binary structure files can only be written on "
+         << "little-endian machines.\n";
+    return false;
+  }
+
+  m_fileName = fileName;
+  m_coordSize = (coordSize == 4 ? 4 : 8);
+  m_species.clear();
+  m_lattices.clear();
+  m_records.clear();
+  m_file.open(fileName, ios::out | ios::trunc | ios::binary);
+  if (!m_file.is_open()) {
+    cout << "Error: could not open the binary structure file, " << fileName
+         << ", for writing.\n";
+    return false;
+  }
+
+  // The header is written again by close(), once the offsets are known
+  structureBinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  return m_file.good();
+}
+
+bool StructureBinaryWriter::append(const Crystal& crystal,
+                                   const structureRecord& record)
+{
+  if (!m_file.is_open()) return false;
+
+  const vector<atomStruct>& atoms = crystal.getAtoms();
+  m_coordBuffer.resize(3 * m_coordSize * atoms.size());
+  char* p = m_coordBuffer.data();
+  for (size_t i = 0; i < atoms.size(); i++) {
+    double coords[3] = { atoms[i].x, atoms[i].y, atoms[i].z };
+    for (size_t j = 0; j < 3; j++) {
+      if (m_coordSize == 4) {
+        float f = static_cast<float>(coords[j]);
+        memcpy(p, &f, 4);
+      }
+      else {
+        memcpy(p, &coords[j], 8);
+      }
+      p += m_coordSize;
+    }
+  }
+  m_file.write(m_coordBuffer.data(), m_coordBuffer.size());
+  if (!m_file.good()) {
+    cout << "Error: could not write to the binary structure file, "
+         << m_fileName << ".\n";
+    return false;
+  }
+
+  structureBinaryRecord r;
+  memset(&r, 0, sizeof(r));
+  r.firstAtom = m_species.size();
+  r.numAtoms = atoms.size();
+  r.spg = record.spg;
+  r.spgIndex = record.spgIndex;
+  r.seed = record.seed;
+  r.time = record.time;
+  m_records.push_back(r);
+
+  for (size_t i = 0; i < atoms.size(); i++)
+    m_species.push_back(atoms[i].atomicNum);
+
+  double vecs[3][3];
+  crystal.getLatticeVecs(vecs);
+  m_lattices.insert(m_lattices.end(), &vecs[0][0], &vecs[0][0] + 9);
+  return true;
+}
+
+bool StructureBinaryWriter::close()
+{
+  if (!m_file.is_open()) return false;
+
+  structureBinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, structureBinaryMagic, sizeof(header.magic));
+  header.version = structureBinaryVersion;
+  header.coordSize = m_coordSize;
+  header.numStructures = m_records.size();
+  header.numAtoms = m_species.size();
+  header.coordsOffset = sizeof(header);
+  header.speciesOffset = roundUpTo8(header.coordsOffset +
+                                    3 * m_coordSize * header.numAtoms);
+  header.latticesOffset = roundUpTo8(header.speciesOffset + header.numAtoms);
+  header.tableOffset = header.latticesOffset +
+                       m_lattices.size() * sizeof(double);
+
+  const char zeros[8] = {};
+  uint64_t end = header.coordsOffset + 3 * m_coordSize * header.numAtoms;
+  m_file.write(zeros, header.speciesOffset - end);
+  m_file.write(reinterpret_cast<const char*>(m_species.data()),
+               m_species.size());
+  end = header.speciesOffset + header.numAtoms;
+  m_file.write(zeros, header.latticesOffset - end);
+  m_file.write(reinterpret_cast<const char*>(m_lattices.data()),
+               m_lattices.size() * sizeof(double));
+  m_file.write(reinterpret_cast<const char*>(m_records.data()),
+               m_records.size() * sizeof(structureBinaryRecord));
+  m_file.seekp(0);
+  m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  bool ok = m_file.good();
+  m_file.close();
+  if (!ok) {
+    cout << "Error: could not finish the binary structure file, "
+         << m_fileName << ".\n";
+  }
+  return ok;
+}
+
+StructureBinaryReader::StructureBinaryReader() :
+  m_data(nullptr),
+  m_size(0)
+{
+  memset(&m_header, 0, sizeof(m_header));
+}
+
+StructureBinaryReader::~StructureBinaryReader()
+{
+  close();
+}
+
+bool StructureBinaryReader::open(const string& fileName)
+{
+  close();
+
+#ifdef _WIN32
+  ifstream f(fileName, ios::in | ios::binary);
+  if (f.is_open()) {
+    f.seekg(0, ios::end);
+    m_readData.resize(f.tellg());
+    f.seekg(0);
+    if (!m_readData.empty()) f.read(m_readData.data(), m_readData.size());
+    if (f.good()) {
+      m_data = m_readData.data();
+      m_size = m_readData.size();
+    }
+  }
+#else
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) {
+      m_data = static_cast<const char*>(p);
+      m_size = st.st_size;
+    }
+  }
+  if (fd >= 0) ::close(fd);
+#endif
+
+  if (!m_data) {
+    cout << "Error: could not open the binary structure file, " << fileName
+         << ".\n";
+    close();
+    return false;
+  }
+
+  bool ok = isLittleEndian() && m_size >= sizeof(m_header);
+  if (ok) memcpy(&m_header, m_data, sizeof(m_header));
+  ok = ok && memcmp(m_header.magic, structureBinaryMagic, 8) == 0;
+  if (ok && m_header.version != structureBinaryVersion) {
+    cout << "Error: the binary structure file, " << fileName << ", has "
+         << "version " << m_header.version << ", but version "
+         << structureBinaryVersion << " is needed.\n";
+    close();
+    return false;
+  }
+  // The coordinates, lattices, and records are read in place, so they must
+  // be aligned as the writer aligns them
+  const structureBinaryHeader& h = m_header;
+  ok = ok && (h.coordSize == 4 || h.coordSize == 8) &&
+       h.coordsOffset % 8 == 0 && h.latticesOffset % 8 == 0 &&
+       h.tableOffset % 8 == 0 &&
+       fitsBefore(h.coordsOffset, h.numAtoms, 3 * h.coordSize,
+                  h.speciesOffset) &&
+       fitsBefore(h.speciesOffset, h.numAtoms, 1, h.latticesOffset) &&
+       fitsBefore(h.latticesOffset, h.numStructures, 9 * sizeof(double),
+                  h.tableOffset) &&
+       fitsBefore(h.tableOffset, h.numStructures,
+                  sizeof(structureBinaryRecord), m_size);
+  for (size_t i = 0; ok && i < h.numStructures; i++) {
+    const structureBinaryRecord& r = getRecord(i);
+    ok = r.numAtoms <= h.numAtoms && r.firstAtom <= h.numAtoms - r.numAtoms;
+  }
+
+  if (!ok) {
+    cout << "Error: the binary structure file, " << fileName
+         << ", could not be read.\n";
+    close();
+    return false;
+  }
+  return true;
+}
+
+void StructureBinaryReader::close()
+{
+#ifndef _WIN32
+  if (m_data && m_readData.empty())
+    munmap(const_cast<char*>(m_data), m_size);
+#endif
+  m_data = nullptr;
+  m_size = 0;
+  vector<char>().swap(m_readData);
+  memset(&m_header, 0, sizeof(m_header));
+}
+
+const structureBinaryRecord& StructureBinaryReader::getRecord(size_t i) const
+{
+  return reinterpret_cast<const structureBinaryRecord*>(
+           m_data + m_header.tableOffset)[i];
+}
+
+const double* StructureBinaryReader::getLattice(size_t i) const
+{
+  return reinterpret_cast<const double*>(m_data + m_header.latticesOffset) +
+         9 * i;
+}
+
+const uint8_t* StructureBinaryReader::getSpecies() const
+{
+  return reinterpret_cast<const uint8_t*>(m_data + m_header.speciesOffset);
+}
+
+const void* StructureBinaryReader::getCoords() const
+{
+  return m_data + m_header.coordsOffset;
+}
+
+Crystal StructureBinaryReader::getCrystal(size_t i) const
+{
+  const structureBinaryRecord& r = getRecord(i);
+  const uint8_t* species = getSpecies();
+  const float* floats = static_cast<const float*>(getCoords());
+  const double* doubles = static_cast<const double*>(getCoords());
+
+  // A batch of one already knows how to turn lattice vectors into a Crystal
+  crystalBatch batch;
+  const double* lattice = getLattice(i);
+  batch.lattices.assign(lattice, lattice + 9);
+  for (size_t j = r.firstAtom; j < r.firstAtom + r.numAtoms; j++) {
+    batch.atomicNums.push_back(species[j]);
+    for (size_t k = 0; k < 3; k++) {
+      batch.fracCoords.push_back(m_header.coordSize == 4 ? floats[3 * j + k] :
+                                                           doubles[3 * j + k]);
+    }
+  }
+  batch.atomOffsets.push_back(r.numAtoms);
+  return batch.getCrystal(0);
+}
@@ -0,0 +1,209 @@
+/**********************************************************************
+  structureContainer.cpp - Many structures written to one file, with an
+                           index for finding any one of them.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "structureContainer.h"
+
+using namespace std;
+
+// Increment this if the layout of the index changes
+static const uint structureIndexVersion = 1;
+
+// "randSpg index at " and 20 digits and a newline
+static const size_t trailerSize = 38;
+
+string StructureContainer::getFormatName(structureContainerFormat format)
+{
+  return format == xyzContainer ? "xyz" : "poscar";
+}
+
+StructureContainerWriter::StructureContainerWriter() :
+  m_format(poscarContainer),
+  m_size(0)
+{
+}
+
+StructureContainerWriter::~StructureContainerWriter()
+{
+  if (m_file.is_open()) close();
+}
+
+bool StructureContainerWriter::open(const string& fileName,
+                                    structureContainerFormat format)
+{
+  if (m_file.is_open()) close();
+  m_fileName = fileName;
+  m_format = format;
+  m_size = 0;
+  m_records.clear();
+  m_file.open(fileName, ios::out | ios::trunc | ios::binary);
+  if (!m_file.is_open()) {
+    cout << "Error: could not open the structure container, " << fileName
+         << ", for writing.\n";
+    return false;
+  }
+  return true;
+}
+
+bool StructureContainerWriter::append(const Crystal& crystal,
+                                      const string& title,
+                                      const structureRecord& record)
+{
+  if (!m_file.is_open()) return false;
+
+  string xyz;
+  if (m_format == xyzContainer) xyz = crystal.getExtendedXYZString(title);
+  const string& text = (m_format == xyzContainer ?
+                        xyz : m_writer.formatPOSCAR(crystal, title));
+  m_file.write(text.data(), text.size());
+  if (!m_file.good()) {
+    cout << "Error: could not write to the structure container, "
+         << m_fileName << ".\n";
+    return false;
+  }
+
+  structureRecord r = record;
+  r.offset = m_size;
+  r.size = text.size();
+  m_records.push_back(r);
+  m_size += text.size();
+  return true;
+}
+
+bool StructureContainerWriter::close()
+{
+  if (!m_file.is_open()) return false;
+
+  stringstream ss;
+  ss << setprecision(17);
+  ss << "randSpg structure index " << structureIndexVersion << "\n"
+     << "format " << StructureContainer::getFormatName(m_format) << "\n"
+     << "structures " << m_records.size() << "\n";
+  for (size_t i = 0; i < m_records.size(); i++) {
+    const structureRecord& r = m_records[i];
+    ss << r.offset << " " << r.size << " " << r.spg << " " << r.spgIndex
+       << " " << r.seed << " " << r.time << " " << r.name << "\n";
+  }
+
+  char trailer[trailerSize + 1];
+  snprintf(trailer, sizeof(trailer), "randSpg index at %020llu\n",
+           static_cast<unsigned long long>(m_size));
+  ss << trailer;
+
+  string index = ss.str();
+  m_file.write(index.data(), index.size());
+  bool ok = m_file.good();
+  m_file.close();
+  if (!ok) {
+    cout << "Error: could not write the index of the structure container, "
+         << m_fileName << ".\n";
+  }
+  return ok;
+}
+
+bool StructureContainerReader::open(const string& fileName)
+{
+  m_fileName = fileName;
+  m_records.clear();
+  if (m_file.is_open()) m_file.close();
+  m_file.clear();
+  m_file.open(fileName, ios::in | ios::binary);
+  if (!m_file.is_open()) {
+    cout << "Error: could not open the structure container, " << fileName
+         << ".\n";
+    return false;
+  }
+
+  // Find the index from the last line
+  string trailer(trailerSize, '\0');
+  m_file.seekg(0, ios::end);
+  uint64_t fileSize = m_file.tellg();
+  unsigned long long indexOffset = 0;
+  bool ok = fileSize >= trailerSize;
+  if (ok) {
+    m_file.seekg(fileSize - trailerSize);
+    m_file.read(&trailer[0], trailerSize);
+    ok = m_file.good() &&
+         sscanf(trailer.c_str(), "randSpg index at %llu", &indexOffset) == 1 &&
+         indexOffset <= fileSize - trailerSize;
+  }
+
+  string word1, word2, word3, formatName;
+  uint version = 0;
+  size_t numStructures = 0;
+  if (ok) {
+    m_file.seekg(indexOffset);
+    ok = (m_file >> word1 >> word2 >> word3 >> version) &&
+         word1 == "randSpg" && word2 == "structure" && word3 == "index";
+  }
+  if (ok && version != structureIndexVersion) {
+    cout << "Error: the structure container, " << fileName << ", has index "
+         << "version " << version << ", but version " << structureIndexVersion
+         << " is needed.\n";
+    return false;
+  }
+  ok = ok &&
+       (m_file >> word1 >> formatName) && word1 == "format" &&
+       (formatName == "poscar" || formatName == "xyz") &&
+       (m_file >> word1 >> numStructures) && word1 == "structures";
+  m_format = (formatName == "xyz" ? xyzContainer : poscarContainer);
+
+  for (size_t i = 0; ok && i < numStructures; i++) {
+    structureRecord r;
+    ok = (m_file >> r.offset >> r.size >> r.spg >> r.spgIndex >> r.seed
+                 >> r.time >> r.name) &&
+         r.offset + r.size <= indexOffset;
+    if (ok) m_records.push_back(r);
+  }
+
+  if (!ok) {
+    cout << "Error: the index of the structure container, " << fileName
+         << ", could not be read. The run that wrote it may not have "
+         << "finished.\n";
+    m_records.clear();
+    return false;
+  }
+  return true;
+}
+
+long StructureContainerReader::find(uint spg, size_t spgIndex) const
+{
+  for (size_t i = 0; i < m_records.size(); i++) {
+    if (m_records[i].spg == spg && m_records[i].spgIndex == spgIndex)
+      return i;
+  }
+  return -1;
+}
+
+bool StructureContainerReader::readStructure(size_t i, string& text)
+{
+  if (i >= m_records.size()) return false;
+  const structureRecord& r = m_records[i];
+  m_file.clear();
+  m_file.seekg(r.offset);
+  text.resize(r.size);
+  if (r.size != 0) m_file.read(&text[0], r.size);
+  if (!m_file.good()) {
+    cout << "Error: structure " << i << " of the structure container, "
+         << m_fileName << ", could not be read.\n";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,206 @@
+/**********************************************************************
+  structureFingerprint.cpp - A fingerprint of a structure that is the same
+                             for structures that are the same.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#include "structureFingerprint.h"
+
+using namespace std;
+
+const double StructureFingerprint::cutoff = 2.5;
+const double StructureFingerprint::tolerance = 1e-4;
+const double StructureFingerprintSet::bucketWidth = 0.01;
+
+static void cross(const double a[3], const double b[3], double ret[3])
+{
+  ret[0] = a[1] * b[2] - a[2] * b[1];
+  ret[1] = a[2] * b[0] - a[0] * b[2];
+  ret[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static double norm(const double a[3])
+{
+  return sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+}
+
+structureFingerprint StructureFingerprint::getFingerprint(
+  const Crystal& crystal)
+{
+  structureFingerprint ret;
+  const vector<atomStruct>& atoms = crystal.getAtoms();
+  double volume = crystal.getVolume();
+  if (atoms.empty() || volume <= 0) return ret;
+
+  double vecs[3][3];
+  crystal.getLatticeVecs(vecs);
+
+  // Distances are in units of the cube root of the volume per atom. A
+  // little more than the cutoff is kept, so that a distance just below the
+  // cutoff in one crystal can be matched with one just above it in
+  // another.
+  double scale = cbrt(volume / atoms.size());
+  double maxDistance = (cutoff + tolerance) * scale;
+
+  // The number of images that are needed in each direction: the cutoff
+  // over the distance between the planes of the other two vectors, and one
+  // more since the atoms may be up to a cell apart
+  int numImages[3];
+  for (size_t i = 0; i < 3; i++) {
+    double normal[3];
+    cross(vecs[(i + 1) % 3], vecs[(i + 2) % 3], normal);
+    double spacing = volume / norm(normal);
+    numImages[i] = static_cast<int>(ceil(maxDistance / spacing)) + 1;
+  }
+
+  // The types, from the smallest atomic number to the largest
+  for (size_t i = 0; i < atoms.size(); i++)
+    ret.types.push_back(atoms[i].atomicNum);
+  sort(ret.types.begin(), ret.types.end());
+  ret.types.erase(unique(ret.types.begin(), ret.types.end()),
+                  ret.types.end());
+  size_t numTypes = ret.types.size();
+  ret.typeCounts.assign(numTypes, 0);
+  vector<size_t> typeIndices(atoms.size());
+  for (size_t i = 0; i < atoms.size(); i++) {
+    typeIndices[i] = lower_bound(ret.types.begin(), ret.types.end(),
+                                 atoms[i].atomicNum) - ret.types.begin();
+    ret.typeCounts[typeIndices[i]]++;
+  }
+
+  // The atoms wrapped into the cell
+  vector<double> frac(3 * atoms.size());
+  for (size_t i = 0; i < atoms.size(); i++) {
+    double coords[3] = { atoms[i].x, atoms[i].y, atoms[i].z };
+    for (size_t j = 0; j < 3; j++)
+      frac[3 * i + j] = coords[j] - floor(coords[j]);
+  }
+
+  // One list for each pair of types. Pair (t1, t2) is at index
+  // t1 * (2 * numTypes - t1 + 1) / 2 + t2 - t1.
+  ret.distances.resize(numTypes * (numTypes + 1) / 2);
+  double maxDistanceSquared = maxDistance * maxDistance;
+  for (size_t i = 0; i < atoms.size(); i++) {
+    for (size_t j = i; j < atoms.size(); j++) {
+      size_t t1 = min(typeIndices[i], typeIndices[j]);
+      size_t t2 = max(typeIndices[i], typeIndices[j]);
+      vector<float>& list =
+        ret.distances[t1 * (2 * numTypes - t1 + 1) / 2 + t2 - t1];
+      double d[3];
+      for (size_t k = 0; k < 3; k++) d[k] = frac[3 * j + k] - frac[3 * i + k];
+      for (int na = -numImages[0]; na <= numImages[0]; na++) {
+        for (int nb = -numImages[1]; nb <= numImages[1]; nb++) {
+          for (int nc = -numImages[2]; nc <= numImages[2]; nc++) {
+            if (i == j && na == 0 && nb == 0 && nc == 0) continue;
+            double fa = d[0] + na, fb = d[1] + nb, fc = d[2] + nc;
+            double x = fa * vecs[0][0] + fb * vecs[1][0] + fc * vecs[2][0];
+            double y = fa * vecs[0][1] + fb * vecs[1][1] + fc * vecs[2][1];
+            double z = fa * vecs[0][2] + fb * vecs[1][2] + fc * vecs[2][2];
+            double distanceSquared = x * x + y * y + z * z;
+            if (distanceSquared >= maxDistanceSquared) continue;
+            list.push_back(static_cast<float>(sqrt(distanceSquared) / scale));
+          }
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < ret.distances.size(); i++)
+    sort(ret.distances[i].begin(), ret.distances[i].end());
+  return ret;
+}
+
+// Whether every distance below the cutoff in either list matches the
+// distance at the same place in the other one. The lists go a little past
+// the cutoff, so a distance right at the cutoff still has a partner.
+static bool distancesMatch(const vector<float>& d1, const vector<float>& d2,
+                           double cutoff, double tolerance)
+{
+  size_t i = 0;
+  while ((i < d1.size() && d1[i] < cutoff) ||
+         (i < d2.size() && d2[i] < cutoff)) {
+    if (i >= d1.size() || i >= d2.size() ||
+        fabs(d1[i] - d2[i]) > tolerance) {
+      return false;
+    }
+    i++;
+  }
+  return true;
+}
+
+bool StructureFingerprint::areSame(const structureFingerprint& f1,
+                                   const structureFingerprint& f2)
+{
+  if (f1.types != f2.types || f1.typeCounts != f2.typeCounts ||
+      f1.distances.size() != f2.distances.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < f1.distances.size(); i++) {
+    if (!distancesMatch(f1.distances[i], f2.distances[i], cutoff, tolerance))
+      return false;
+  }
+  return true;
+}
+
+long long StructureFingerprintSet::getBucket(
+  const structureFingerprint& fingerprint)
+{
+  float shortest = numeric_limits<float>::max();
+  for (size_t i = 0; i < fingerprint.distances.size(); i++) {
+    if (!fingerprint.distances[i].empty())
+      shortest = min(shortest, fingerprint.distances[i][0]);
+  }
+  if (shortest == numeric_limits<float>::max()) return -1;
+  return static_cast<long long>(floor(shortest / bucketWidth));
+}
+
+string StructureFingerprintSet::getBucketKey(
+  const structureFingerprint& fingerprint, long long bucket)
+{
+  stringstream s;
+  for (size_t i = 0; i < fingerprint.types.size(); i++)
+    s << fingerprint.types[i] << "x" << fingerprint.typeCounts[i] << ",";
+  s << ";" << bucket;
+  return s.str();
+}
+
+bool StructureFingerprintSet::contains(
+  const structureFingerprint& fingerprint) const
+{
+  long long bucket = getBucket(fingerprint);
+  for (long long b = bucket - 1; b <= bucket + 1; b++) {
+    auto it = m_buckets.find(getBucketKey(fingerprint, b));
+    if (it == m_buckets.end()) continue;
+    for (size_t i = 0; i < it->second.size(); i++) {
+      if (StructureFingerprint::areSame(m_fingerprints[it->second[i]],
+                                        fingerprint)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool StructureFingerprintSet::insert(const structureFingerprint& fingerprint)
+{
+  if (contains(fingerprint)) return false;
+  m_buckets[getBucketKey(fingerprint, getBucket(fingerprint))].push_back(
+    m_fingerprints.size());
+  m_fingerprints.push_back(fingerprint);
+  return true;
+}
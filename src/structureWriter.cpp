@@ -0,0 +1,324 @@
+/**********************************************************************
+  structureWriter.cpp - Formats structures as POSCAR or CIF text in a
+                        buffer that is reused, and writes them to files.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "elemInfo.h"
+#include "randSpg.h"
+#include "structureWriter.h"
+#include "utilityFunctions.h"
+
+using namespace std;
+
+void StructureWriter::appendDouble(double d, int width)
+{
+  char s[64];
+  int len = snprintf(s, sizeof(s), "%*.15f", width, d);
+  // A number too large for the array is written as a stream would write it
+  if (len < 0 || len >= static_cast<int>(sizeof(s))) {
+    string big(len + 1, '\0');
+    snprintf(&big[0], big.size(), "%*.15f", width, d);
+    m_buffer.append(big.c_str(), len);
+    return;
+  }
+  m_buffer.append(s, len);
+}
+
+/* POSCAR format goes as such:
+ *
+ * Title
+ * Scaling factor
+ * Lattice vector for a
+ * Lattice vector for b
+ * Lattice vector for c
+ * Element Symbols
+ * Number of each element
+ * Cartesian or Direct
+ * Atom coordinates
+ */
+const string& StructureWriter::formatPOSCAR(const Crystal& crystal,
+                                            const string& title)
+{
+  const vector<atomStruct>& atoms = crystal.getAtoms();
+
+  // Count the atoms of each type in the order they first appear. They are
+  // sorted the same way RandSpg::getNumOfEachType() sorts them, so the
+  // order of the types is the same as it always was.
+  m_counts.clear();
+  for (size_t i = 0; i < atoms.size(); i++) {
+    size_t j = 0;
+    while (j < m_counts.size() && m_counts[j].second != atoms[i].atomicNum)
+      j++;
+    if (j == m_counts.size()) m_counts.push_back(make_pair(0, atoms[i].atomicNum));
+    m_counts[j].first++;
+  }
+  sort(m_counts.begin(), m_counts.end(), greaterThan);
+
+  double vecs[3][3];
+  crystal.getLatticeVecs(vecs);
+
+  char s[64];
+  m_buffer.clear();
+  m_buffer += title;
+  m_buffer += "\n1.00000\n";
+
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      m_buffer += ' ';
+      appendDouble(vecs[i][j], 20);
+    }
+    m_buffer += '\n';
+  }
+
+  for (size_t i = 0; i < m_counts.size(); i++) {
+    snprintf(s, sizeof(s), "  %3s",
+             ElemInfo::getAtomicSymbol(m_counts[i].second).c_str());
+    m_buffer += s;
+  }
+  m_buffer += '\n';
+
+  for (size_t i = 0; i < m_counts.size(); i++) {
+    snprintf(s, sizeof(s), "  %3u", m_counts[i].first);
+    m_buffer += s;
+  }
+  m_buffer += '\n';
+
+  m_buffer += "Direct\n";
+
+  for (size_t i = 0; i < atoms.size(); i++) {
+    m_buffer += "  ";
+    appendDouble(atoms[i].x);
+    m_buffer += "  ";
+    appendDouble(atoms[i].y);
+    m_buffer += "  ";
+    appendDouble(atoms[i].z);
+    m_buffer += '\n';
+  }
+
+  return m_buffer;
+}
+
+bool StructureWriter::writePOSCAR(const string& fileName,
+                                  const Crystal& crystal, const string& title)
+{
+  return writeFile(fileName, formatPOSCAR(crystal, title));
+}
+
+// A translation as CIF writes it: a fraction with a denominator of 24 or
+// less, such as "+1/3", or the number itself if it is not one. 0 is "".
+static string getTranslationString(double t)
+{
+  t -= floor(t);
+  double numerator = t * 24;
+  int n = static_cast<int>(numerator + 0.5);
+  if (n == 24) n = 0;
+  if (fabs(numerator - n) > 1e-3 && fabs(numerator - 24 - n) > 1e-3) {
+    char s[32];
+    snprintf(s, sizeof(s), "+%.6f", t);
+    return s;
+  }
+  if (n == 0) return "";
+  int d = 24;
+  while (n % 2 == 0 && d % 2 == 0) { n /= 2; d /= 2; }
+  while (n % 3 == 0 && d % 3 == 0) { n /= 3; d /= 3; }
+  return "+" + to_string(n) + "/" + to_string(d);
+}
+
+// Split a component of a Wyckoff position, such as "-x+y+0.5", into the
+// part with the variables ("-x+y") and the number (0.5)
+static void splitComponent(const string& component, string& variables,
+                           double& number)
+{
+  variables.clear();
+  number = 0;
+  size_t start = 0;
+  while (start < component.size()) {
+    size_t end = start + 1;
+    while (end < component.size() && component[end] != '+' &&
+           component[end] != '-')
+      end++;
+    string term = component.substr(start, end - start);
+    string unsignedTerm = (term[0] == '+' || term[0] == '-') ?
+                          term.substr(1) : term;
+    if (isNumber(unsignedTerm)) number += stod(term);
+    else variables += term;
+    start = end;
+  }
+  if (!variables.empty() && variables[0] == '+') variables.erase(0, 1);
+}
+
+vector<string> StructureWriter::getSymmetryOperations(uint spg)
+{
+  vector<string> dupVec = RandSpg::getVectorOfDuplications(spg);
+  vector<string> fpVec = RandSpg::getVectorOfFillPositions(spg);
+  vector<string> ret;
+  for (size_t j = 0; j < dupVec.size(); j++) {
+    vector<string> dupComponents = split(dupVec[j], ',');
+    for (size_t k = 0; k < fpVec.size(); k++) {
+      vector<string> fpComponents = split(fpVec[k], ',');
+      string op;
+      for (size_t c = 0; c < 3 && c < fpComponents.size(); c++) {
+        string variables;
+        double number;
+        splitComponent(fpComponents[c], variables, number);
+        if (c != 0) op += ',';
+        op += variables + getTranslationString(number +
+                                               stod(dupComponents[c]));
+      }
+      ret.push_back(op);
+    }
+  }
+  return ret;
+}
+
+const string& StructureWriter::formatCIF(const Crystal& crystal,
+                                         const string& title)
+{
+  uint spg = crystal.getSpacegroup();
+  const vector<atomStruct>& atoms = (spg == 0 ? crystal.getAtoms() :
+                                                crystal.getAsymmetricUnit());
+  if (spg == 0) spg = 1;
+  if (spg != m_symmetryOperationsSpg) {
+    m_symmetryOperations = getSymmetryOperations(spg);
+    m_symmetryOperationsSpg = spg;
+  }
+
+  m_buffer.clear();
+  m_buffer += "data_";
+  for (size_t i = 0; i < title.size(); i++) {
+    char c = title[i];
+    m_buffer += (isspace(static_cast<unsigned char>(c)) || c == '\'' ||
+                 c == '"' || c == '#' || c == '$' || c == '_' ||
+                 c == ';' || c == '[' || c == ']') ? '_' : c;
+  }
+  if (title.empty()) m_buffer += "randSpg";
+  m_buffer += "\n_symmetry_Int_Tables_number ";
+  m_buffer += to_string(spg);
+  m_buffer += '\n';
+
+  const latticeStruct lattice = crystal.getLattice();
+  const char* names[6] = { "length_a", "length_b", "length_c",
+                           "angle_alpha", "angle_beta", "angle_gamma" };
+  double values[6] = { lattice.a, lattice.b, lattice.c,
+                       lattice.alpha, lattice.beta, lattice.gamma };
+  for (size_t i = 0; i < 6; i++) {
+    m_buffer += "_cell_";
+    m_buffer += names[i];
+    m_buffer += ' ';
+    appendDouble(values[i]);
+    m_buffer += '\n';
+  }
+
+  m_buffer += "loop_\n_symmetry_equiv_pos_site_id\n"
+              "_symmetry_equiv_pos_as_xyz\n";
+  for (size_t i = 0; i < m_symmetryOperations.size(); i++) {
+    m_buffer += to_string(i + 1);
+    m_buffer += " '";
+    m_buffer += m_symmetryOperations[i];
+    m_buffer += "'\n";
+  }
+
+  m_buffer += "loop_\n_atom_site_label\n_atom_site_type_symbol\n"
+              "_atom_site_fract_x\n_atom_site_fract_y\n_atom_site_fract_z\n"
+              "_atom_site_occupancy\n";
+  // The atoms of each element are numbered from 1 in their labels
+  m_counts.clear();
+  for (size_t i = 0; i < atoms.size(); i++) {
+    size_t j = 0;
+    while (j < m_counts.size() && m_counts[j].second != atoms[i].atomicNum)
+      j++;
+    if (j == m_counts.size()) m_counts.push_back(make_pair(0, atoms[i].atomicNum));
+    m_counts[j].first++;
+
+    string symbol = ElemInfo::getAtomicSymbol(atoms[i].atomicNum);
+    m_buffer += symbol;
+    m_buffer += to_string(m_counts[j].first);
+    m_buffer += ' ';
+    m_buffer += symbol;
+    m_buffer += "  ";
+    appendDouble(atoms[i].x);
+    m_buffer += "  ";
+    appendDouble(atoms[i].y);
+    m_buffer += "  ";
+    appendDouble(atoms[i].z);
+    m_buffer += "  1\n";
+  }
+
+  return m_buffer;
+}
+
+bool StructureWriter::writeCIF(const string& fileName, const Crystal& crystal,
+                               const string& title)
+{
+  return writeFile(fileName, formatCIF(crystal, title));
+}
+
+bool StructureWriter::writeFile(const string& fileName, const string& text)
+{
+#ifdef _WIN32
+  int fd = _open(fileName.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
+#else
+  int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+  if (fd < 0) {
+    cout << "Error in " << __FUNCTION__ << ": failed to open '"
+         << fileName << "' for writing!\n";
+    return false;
+  }
+
+  const char* p = text.data();
+  size_t left = text.size();
+  bool ok = true;
+  while (left > 0) {
+#ifdef _WIN32
+    int n = _write(fd, p, static_cast<unsigned int>(left));
+#else
+    ssize_t n = write(fd, p, left);
+#endif
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      ok = false;
+      break;
+    }
+    p += n;
+    left -= n;
+  }
+
+#ifdef _WIN32
+  if (_close(fd) != 0) ok = false;
+#else
+  if (close(fd) != 0) ok = false;
+#endif
+  if (!ok) {
+    cout << "Error in " << __FUNCTION__ << ": failed to write '"
+         << fileName << "'!\n";
+  }
+  return ok;
+}
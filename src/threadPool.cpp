@@ -0,0 +1,204 @@
+/**********************************************************************
+  threadPool.cpp - A small work-stealing thread pool used to run independent
+                   parts of the setup at the same time.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include "threadPool.h"
+
+using namespace std;
+
+// The pool and queue of the worker running on this thread. The queue is -1
+// if this thread is not a worker.
+static thread_local const ThreadPool* t_workerPool = nullptr;
+static thread_local int t_workerQueue = -1;
+
+// The owner that the tasks submitted on this thread get: the id of the
+// task that is running, or an id of the thread. 0 means it has none yet.
+static thread_local uint64_t t_owner = 0;
+static atomic<uint64_t> nextOwner(0);
+
+static uint64_t getOwner()
+{
+  if (t_owner == 0) t_owner = ++nextOwner;
+  return t_owner;
+}
+
+static mutex globalPoolMutex;
+static shared_ptr<ThreadPool> globalPool;
+static size_t globalPoolNumThreads = 0;
+
+ThreadPool::ThreadPool(size_t numThreads) :
+  m_epoch(0),
+  m_numWaiting(0),
+  m_numPending(0),
+  m_nextQueue(0),
+  m_done(false)
+{
+  if (numThreads == 0) numThreads = thread::hardware_concurrency();
+  if (numThreads == 0) numThreads = 1;
+
+  for (size_t i = 0; i < numThreads; i++)
+    m_queues.push_back(unique_ptr<workQueue>(new workQueue));
+  for (size_t i = 0; i < numThreads; i++)
+    m_threads.push_back(thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    lock_guard<mutex> lock(m_sleepMutex);
+    m_done = true;
+  }
+  m_sleepCondition.notify_all();
+  for (size_t i = 0; i < m_threads.size(); i++) m_threads[i].join();
+}
+
+shared_ptr<ThreadPool> ThreadPool::global()
+{
+  lock_guard<mutex> lock(globalPoolMutex);
+  if (!globalPool) globalPool = make_shared<ThreadPool>(globalPoolNumThreads);
+  return globalPool;
+}
+
+bool ThreadPool::setGlobalNumThreads(size_t numThreads)
+{
+  lock_guard<mutex> lock(globalPoolMutex);
+  // The pool cannot be destroyed while a caller holds it, and the last one
+  // to let go of it might be one of its own workers
+  if (globalPool && globalPool.use_count() > 1) return false;
+  globalPoolNumThreads = numThreads;
+  globalPool.reset();
+  return true;
+}
+
+void ThreadPool::push(function<void()> f)
+{
+  poolTask task;
+  task.f = move(f);
+  task.owner = getOwner();
+  task.id = ++nextOwner;
+
+  // Workers push onto their own queue. Everyone else takes turns.
+  size_t index;
+  if (t_workerPool == this) index = t_workerQueue;
+  else index = m_nextQueue++ % m_queues.size();
+
+  {
+    lock_guard<mutex> lock(m_queues[index]->mutex);
+    m_queues[index]->tasks.push_back(move(task));
+  }
+  bool waiting;
+  {
+    lock_guard<mutex> lock(m_sleepMutex);
+    m_numPending++;
+    m_epoch++;
+    waiting = (m_numWaiting != 0);
+  }
+  m_sleepCondition.notify_one();
+  if (waiting) m_waitCondition.notify_all();
+}
+
+bool ThreadPool::popTask(poolTask& task, uint64_t owner)
+{
+  size_t numQueues = m_queues.size();
+  size_t first = (t_workerPool == this) ? t_workerQueue : 0;
+
+  // Our own queue first, newest task first
+  {
+    workQueue& q = *m_queues[first];
+    lock_guard<mutex> lock(q.mutex);
+    for (size_t j = q.tasks.size(); j > 0; j--) {
+      if (owner != 0 && q.tasks[j - 1].owner != owner) continue;
+      task = move(q.tasks[j - 1]);
+      q.tasks.erase(q.tasks.begin() + (j - 1));
+      m_numPending--;
+      return true;
+    }
+  }
+
+  // Then steal the oldest task from someone else
+  for (size_t i = 1; i < numQueues; i++) {
+    workQueue& q = *m_queues[(first + i) % numQueues];
+    lock_guard<mutex> lock(q.mutex);
+    for (size_t j = 0; j < q.tasks.size(); j++) {
+      if (owner != 0 && q.tasks[j].owner != owner) continue;
+      task = move(q.tasks[j]);
+      q.tasks.erase(q.tasks.begin() + j);
+      m_numPending--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::runTask(poolTask& task)
+{
+  // The tasks that this one submits are its own
+  uint64_t owner = t_owner;
+  t_owner = task.id;
+  task.f();
+  t_owner = owner;
+
+  bool waiting;
+  {
+    lock_guard<mutex> lock(m_sleepMutex);
+    m_epoch++;
+    waiting = (m_numWaiting != 0);
+  }
+  if (waiting) m_waitCondition.notify_all();
+}
+
+void ThreadPool::waitUntil(const function<bool()>& isDone)
+{
+  uint64_t owner = getOwner();
+  while (true) {
+    uint64_t epoch;
+    {
+      lock_guard<mutex> lock(m_sleepMutex);
+      epoch = m_epoch;
+    }
+    if (isDone()) return;
+
+    poolTask task;
+    if (popTask(task, owner)) {
+      runTask(task);
+      continue;
+    }
+
+    // Our tasks are all running on workers. Sleep until something changes.
+    unique_lock<mutex> lock(m_sleepMutex);
+    m_numWaiting++;
+    m_waitCondition.wait(lock, [this, epoch]() { return m_epoch != epoch; });
+    m_numWaiting--;
+  }
+}
+
+void ThreadPool::workerLoop(size_t index)
+{
+  t_workerPool = this;
+  t_workerQueue = index;
+  while (true) {
+    poolTask task;
+    if (popTask(task, 0)) {
+      runTask(task);
+      continue;
+    }
+
+    unique_lock<mutex> lock(m_sleepMutex);
+    m_sleepCondition.wait(lock, [this]() {
+      return m_done || m_numPending > 0;
+    });
+    if (m_done) return;
+  }
+}
@@ -0,0 +1,445 @@
+/**********************************************************************
+  wyckAssignmentSampler.cpp - Draws random atom assignments from a set of
+                              system possibilities using precomputed tables.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+#include "rng.h"
+#include "wyckAssignmentSampler.h"
+
+// For FunctionTracker
+#include "functionTracker.h"
+
+// Uncomment the right side of this line to output function starts and endings
+#define START_FT //FunctionTracker functionTracker(__FUNCTION__);
+
+using namespace std;
+
+string getWyckSamplingPolicyName(wyckSamplingPolicy policy)
+{
+  switch (policy) {
+    case uniformPossibilities:
+      return "uniformPossibilities";
+    case uniformAssignments:
+      return "uniformAssignments";
+    case favorGeneralWyckPos:
+      return "favorGeneralWyckPos";
+    case wyckLetterWeights:
+      return "wyckLetterWeights";
+  }
+  return "";
+}
+
+bool getWyckSamplingPolicy(const string& name, wyckSamplingPolicy& policy)
+{
+  const wyckSamplingPolicy policies[] = { uniformPossibilities,
+                                          uniformAssignments,
+                                          favorGeneralWyckPos,
+                                          wyckLetterWeights };
+  for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+    if (name == getWyckSamplingPolicyName(policies[i])) {
+      policy = policies[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+AliasTable::AliasTable(const vector<double>& weights)
+{
+  size_t n = weights.size();
+  double total = 0.0;
+  for (size_t i = 0; i < n; i++) total += weights[i];
+  if (n == 0 || !(total > 0.0)) return;
+
+  m_probs.resize(n);
+  m_aliases.resize(n);
+
+  // Scale the weights so that they average one. Each entry below one is
+  // topped up by an entry above one, which becomes its alias.
+  vector<double> scaled(n);
+  vector<uint32_t> small, large;
+  for (size_t i = 0; i < n; i++) {
+    scaled[i] = weights[i] * n / total;
+    if (scaled[i] < 1.0) small.push_back(i);
+    else large.push_back(i);
+  }
+
+  while (!small.empty() && !large.empty()) {
+    uint32_t s = small.back();
+    small.pop_back();
+    uint32_t l = large.back();
+    large.pop_back();
+
+    m_probs[s] = scaled[s];
+    m_aliases[s] = l;
+    scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+    if (scaled[l] < 1.0) small.push_back(l);
+    else large.push_back(l);
+  }
+
+  // Whatever is left is one, apart from rounding
+  for (size_t i = 0; i < large.size(); i++) {
+    m_probs[large[i]] = 1.0;
+    m_aliases[large[i]] = large[i];
+  }
+  for (size_t i = 0; i < small.size(); i++) {
+    m_probs[small[i]] = 1.0;
+    m_aliases[small[i]] = small[i];
+  }
+}
+
+size_t AliasTable::sample() const
+{
+  size_t i = getRandInt(0, m_probs.size() - 1);
+  return (getRandDouble(0.0, 1.0) < m_probs[i]) ? i : m_aliases[i];
+}
+
+// The weight of each Wyckoff position for the weighted policies
+static vector<double> getLetterWeights(uint spg,
+                                       const wyckSamplingOptions& options)
+{
+  const wyckoffPositions& wyckVec = RandSpg::getWyckoffPositions(spg);
+  vector<double> ret(wyckVec.size(), 1.0);
+  if (options.policy == favorGeneralWyckPos && !ret.empty()) {
+    ret.back() = max(0.0, options.generalWyckPosWeight);
+  }
+  else if (options.policy == wyckLetterWeights) {
+    for (size_t i = 0; i < wyckVec.size(); i++) {
+      char wyckLet = RandSpg::getWyckLet(wyckVec[i]);
+      for (size_t j = 0; j < options.letterWeights.size(); j++) {
+        if (options.letterWeights[j].first == wyckLet)
+          ret[i] = max(0.0, options.letterWeights[j].second);
+      }
+    }
+  }
+  return ret;
+}
+
+WyckAssignmentSampler::WyckAssignmentSampler(
+  const systemPossibilities& possibilities,
+  const vector<pair<uint, wyckPos>>& forcedWyckPositions,
+  const wyckSamplingOptions& options) :
+  m_possibilities(possibilities),
+  m_table(RandSpgCombinatorics::getWyckGroupTable(possibilities.spg)),
+  m_forced(forcedWyckPositions),
+  m_weighted(options.policy != uniformPossibilities)
+{
+  START_FT;
+  size_t numGroups = m_table.numGroups();
+  const vector<uint>& atomicNums = m_possibilities.atomicNums;
+
+  // Forced unique positions may not be picked again
+  vector<bool> positionForced(m_table.groupOfPosition.size(), false);
+  for (size_t i = 0; i < m_forced.size(); i++) {
+    int posIndex =
+      m_table.getPositionIndex(RandSpg::getWyckLet(m_forced[i].second));
+    int group = (posIndex < 0) ? -1 : m_table.groupOfPosition[posIndex];
+    int type = find(atomicNums.begin(), atomicNums.end(), m_forced[i].first) -
+               atomicNums.begin();
+    if (type == static_cast<int>(atomicNums.size())) type = -1;
+    m_forcedGroups.push_back(group);
+    m_forcedTypes.push_back(type);
+    if (group != -1 && m_table.unique[group]) positionForced[posIndex] = true;
+  }
+
+  m_available.resize(numGroups);
+  for (size_t g = 0; g < numGroups; g++) {
+    for (size_t k = 0; k < m_table.numPositionsInGroup(g); k++) {
+      uint8_t posIndex = m_table.positionIndices[m_table.groupOffsets[g] + k];
+      if (!positionForced[posIndex]) m_available[g].push_back(posIndex);
+    }
+  }
+
+  if (!m_weighted) return;
+
+  // The most sets of atoms that any possibility puts in each group
+  vector<uint> maxCounts(numGroups, 0);
+  for (size_t i = 0; i < m_possibilities.assigns.size(); i++) {
+    const similarWyckPosAndNumToChoose& a = m_possibilities.assigns[i];
+    maxCounts[a.group] = max<uint>(maxCounts[a.group], a.numToChoose);
+  }
+
+  vector<double> letterWeights =
+    getLetterWeights(m_possibilities.spg, options);
+  // The log of the number each group's weights were divided by
+  vector<double> logScales(numGroups, 0.0);
+  m_weights.resize(numGroups);
+  m_sums.resize(numGroups);
+  for (size_t g = 0; g < numGroups; g++) {
+    const vector<uint8_t>& avail = m_available[g];
+    size_t numAvail = avail.size();
+    double maxWeight = 0.0;
+    for (size_t j = 0; j < numAvail; j++)
+      maxWeight = max(maxWeight, letterWeights[avail[j]]);
+    for (size_t j = 0; j < numAvail; j++) {
+      m_weights[g].push_back(maxWeight > 0.0 ?
+                             letterWeights[avail[j]] / maxWeight : 0.0);
+    }
+    logScales[g] = log(maxWeight);
+
+    // A unique group can't hold more sets than it has positions
+    uint maxCount = m_table.unique[g] ? numAvail : maxCounts[g];
+    vector<vector<double>>& sums = m_sums[g];
+    sums.assign(numAvail + 1, vector<double>(maxCount + 1, 0.0));
+    sums[numAvail][0] = 1.0;
+    for (size_t j = numAvail; j-- > 0; ) {
+      double w = m_weights[g][j];
+      for (uint k = 0; k <= maxCount; k++) {
+        // Either position j is not used again, or it is used once more
+        sums[j][k] = sums[j + 1][k];
+        if (k == 0) continue;
+        if (m_table.unique[g]) sums[j][k] += w * sums[j + 1][k - 1];
+        else sums[j][k] += w * sums[j][k - 1];
+      }
+    }
+  }
+
+  // The total weight of the assignments of each possibility. Logs are used
+  // because the totals can be far too large for a double.
+  size_t numTypes = m_possibilities.numTypes();
+  size_t numPoss = m_possibilities.size();
+  const double negInf = -numeric_limits<double>::infinity();
+  vector<double> logWeights(numPoss, negInf);
+  double maxLogWeight = negInf;
+  vector<uint16_t> counts;
+  for (size_t i = 0; i < numPoss; i++) {
+    getCounts(i, counts);
+    double logWeight = 0.0;
+    for (size_t g = 0; g < numGroups && logWeight != negInf; g++) {
+      const vector<vector<double>>& sums = m_sums[g];
+      if (m_table.unique[g]) {
+        // The types share the positions, and each way of choosing the
+        // positions can be split between the types in
+        // K! / (k_1! k_2! ...) ways
+        uint total = 0;
+        double logSplits = 0.0;
+        for (size_t t = 0; t < numTypes; t++) {
+          uint k = counts[t * numGroups + g];
+          total += k;
+          logSplits -= lgamma(k + 1.0);
+        }
+        if (total == 0) continue;
+        if (total >= sums[0].size() || sums[0][total] <= 0.0) {
+          logWeight = negInf;
+          continue;
+        }
+        logWeight += log(sums[0][total]) + total * logScales[g] +
+                     lgamma(total + 1.0) + logSplits;
+      }
+      else {
+        for (size_t t = 0; t < numTypes; t++) {
+          uint k = counts[t * numGroups + g];
+          if (k == 0) continue;
+          if (sums[0][k] <= 0.0) {
+            logWeight = negInf;
+            break;
+          }
+          logWeight += log(sums[0][k]) + k * logScales[g];
+        }
+      }
+    }
+    logWeights[i] = logWeight;
+    maxLogWeight = max(maxLogWeight, logWeight);
+  }
+
+  if (maxLogWeight == negInf) return;
+  vector<double> weights(numPoss);
+  for (size_t i = 0; i < numPoss; i++)
+    weights[i] = exp(logWeights[i] - maxLogWeight);
+  m_possibilityTable = AliasTable(weights);
+}
+
+void WyckAssignmentSampler::getCounts(size_t i, vector<uint16_t>& counts) const
+{
+  size_t numGroups = m_table.numGroups();
+  size_t numTypes = m_possibilities.numTypes();
+  counts.assign(numTypes * numGroups, 0);
+  for (size_t t = 0; t < numTypes; t++) {
+    for (const similarWyckPosAndNumToChoose* it =
+           m_possibilities.assignsBegin(i, t);
+         it != m_possibilities.assignsEnd(i, t); ++it) {
+      counts[t * numGroups + it->group] = it->numToChoose;
+    }
+  }
+
+  // The forced positions are placed separately
+  for (size_t j = 0; j < m_forced.size(); j++) {
+    if (m_forcedTypes[j] == -1 || m_forcedGroups[j] == -1) continue;
+    uint16_t& count = counts[m_forcedTypes[j] * numGroups + m_forcedGroups[j]];
+    if (count > 0) count--;
+  }
+}
+
+size_t WyckAssignmentSampler::samplePossibility() const
+{
+  if (!m_weighted) return getRandInt(0, m_possibilities.size() - 1);
+  return m_possibilityTable.sample();
+}
+
+void WyckAssignmentSampler::sampleNonUniqueGroup(uint8_t g, uint count,
+                                                 vector<uint8_t>& ret) const
+{
+  const vector<uint8_t>& avail = m_available[g];
+  const vector<vector<double>>& sums = m_sums[g];
+  for (size_t j = 0; j < avail.size() && count > 0; j++) {
+    // The last position takes whatever is left
+    uint numUses = count;
+    if (j + 1 < avail.size()) {
+      // Pick the number of times position j is used in proportion to the
+      // weight of the ways the rest can be placed
+      double w = m_weights[g][j];
+      double r = getRandDouble(0.0, sums[j][count]);
+      double wPow = 1.0;
+      for (uint c = 0; c <= count; c++) {
+        double term = wPow * sums[j + 1][count - c];
+        if (term > 0.0) numUses = c;
+        if (r < term) break;
+        r -= term;
+        wPow *= w;
+      }
+    }
+    ret.insert(ret.end(), numUses, avail[j]);
+    count -= numUses;
+  }
+}
+
+void WyckAssignmentSampler::sampleUniqueGroup(uint8_t g, uint count,
+                                              vector<uint8_t>& ret) const
+{
+  const vector<uint8_t>& avail = m_available[g];
+  const vector<vector<double>>& sums = m_sums[g];
+  for (size_t j = 0; j < avail.size() && count > 0; j++) {
+    // Use position j in proportion to the weight of the ways the rest
+    // can be placed if it is used
+    double p = m_weights[g][j] * sums[j + 1][count - 1] / sums[j][count];
+    if (avail.size() - j == count || getRandDouble(0.0, 1.0) < p) {
+      ret.push_back(avail[j]);
+      count--;
+    }
+  }
+}
+
+atomAssignments WyckAssignmentSampler::sample() const
+{
+  START_FT;
+  atomAssignments ret;
+  if (m_possibilities.size() == 0) return ret;
+  if (m_weighted && m_possibilityTable.empty()) return ret;
+
+  const wyckoffPositions& wyckVec =
+    RandSpg::getWyckoffPositions(m_possibilities.spg);
+  size_t numGroups = m_table.numGroups();
+  size_t numTypes = m_possibilities.numTypes();
+
+  vector<uint16_t> counts;
+  getCounts(samplePossibility(), counts);
+
+  for (size_t i = 0; i < m_forced.size(); i++)
+    ret.push_back(make_pair(m_forced[i].second, m_forced[i].first));
+
+  if (!m_weighted) {
+    // Unique positions that have not been used yet. A group is copied the
+    // first time it is used.
+    vector<vector<uint8_t>> unused(numGroups);
+    vector<bool> copied(numGroups, false);
+    for (size_t t = 0; t < numTypes; t++) {
+      uint atomicNum = m_possibilities.atomicNums[t];
+      for (size_t g = 0; g < numGroups; g++) {
+        for (uint c = counts[t * numGroups + g]; c > 0; c--) {
+          uint8_t posIndex;
+          if (m_table.unique[g]) {
+            if (!copied[g]) {
+              unused[g] = m_available[g];
+              copied[g] = true;
+            }
+            vector<uint8_t>& pool = unused[g];
+            // This should not happen, but the caller treats an empty
+            // result as a failure
+            if (pool.empty()) return atomAssignments();
+            size_t r = getRandInt(0, pool.size() - 1);
+            posIndex = pool[r];
+            pool[r] = pool.back();
+            pool.pop_back();
+          }
+          else {
+            const vector<uint8_t>& avail = m_available[g];
+            if (avail.empty()) return atomAssignments();
+            posIndex = avail[getRandInt(0, avail.size() - 1)];
+          }
+          ret.push_back(make_pair(wyckVec[posIndex], atomicNum));
+        }
+      }
+    }
+    return ret;
+  }
+
+  // The types share the unique positions, so those are picked for every
+  // type at once. They are shuffled so that each type gets a random part.
+  vector<vector<uint8_t>> uniquePicks(numGroups);
+  vector<size_t> numUniqueTaken(numGroups, 0);
+  for (size_t g = 0; g < numGroups; g++) {
+    if (!m_table.unique[g]) continue;
+    uint total = 0;
+    for (size_t t = 0; t < numTypes; t++) total += counts[t * numGroups + g];
+    if (total == 0) continue;
+    if (total > m_available[g].size()) return atomAssignments();
+    sampleUniqueGroup(g, total, uniquePicks[g]);
+    vector<uint8_t>& picks = uniquePicks[g];
+    for (size_t j = picks.size(); j > 1; j--)
+      swap(picks[j - 1], picks[getRandInt(0, j - 1)]);
+  }
+
+  vector<uint8_t> picks;
+  for (size_t t = 0; t < numTypes; t++) {
+    uint atomicNum = m_possibilities.atomicNums[t];
+    for (size_t g = 0; g < numGroups; g++) {
+      uint count = counts[t * numGroups + g];
+      if (count == 0) continue;
+      if (m_table.unique[g]) {
+        for (uint c = 0; c < count; c++) {
+          uint8_t posIndex = uniquePicks[g][numUniqueTaken[g]++];
+          ret.push_back(make_pair(wyckVec[posIndex], atomicNum));
+        }
+      }
+      else {
+        picks.clear();
+        sampleNonUniqueGroup(g, count, picks);
+        for (size_t j = 0; j < picks.size(); j++)
+          ret.push_back(make_pair(wyckVec[picks[j]], atomicNum));
+      }
+    }
+  }
+  return ret;
+}
+
+string WyckAssignmentSampler::getKey(const wyckSamplingOptions& options)
+{
+  stringstream s;
+  s << getWyckSamplingPolicyName(options.policy);
+  if (options.policy == favorGeneralWyckPos) {
+    s << ";" << options.generalWyckPosWeight;
+  }
+  else if (options.policy == wyckLetterWeights) {
+    vector<pair<char, double>> sorted = options.letterWeights;
+    sort(sorted.begin(), sorted.end());
+    for (size_t i = 0; i < sorted.size(); i++)
+      s << ";" << sorted[i].first << "=" << sorted[i].second;
+  }
+  return s.str();
+}
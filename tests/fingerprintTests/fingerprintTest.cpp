@@ -0,0 +1,97 @@
+/**********************************************************************
+  fingerprintTest.cpp - Checks that structure fingerprints match for the
+                        same structure at different sizes and differ for
+                        different structures.
+
+  Copyright (C) 2015 - 2016 by Patrick S. Avery
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <iostream>
+#include <vector>
+
+#include "crystal.h"
+#include "structureFingerprint.h"
+
+using namespace std;
+
+// Rock salt in its conventional cell (spg 225, Na on 4a and Cl on 4b). The
+// nearest neighbors are a / 2 apart, which is exactly 1 in the units of the
+// fingerprint.
+static Crystal getRockSalt(double a)
+{
+  double fcc[4][3] = {{0, 0, 0}, {0, 0.5, 0.5}, {0.5, 0, 0.5}, {0.5, 0.5, 0}};
+  vector<atomStruct> atoms;
+  for (size_t i = 0; i < 4; i++)
+    atoms.push_back(atomStruct(11, fcc[i][0], fcc[i][1], fcc[i][2]));
+  for (size_t i = 0; i < 4; i++) {
+    atoms.push_back(atomStruct(17, fcc[i][0] + 0.5, fcc[i][1] + 0.5,
+                               fcc[i][2] + 0.5));
+  }
+  return Crystal(latticeStruct(a, a, a, 90, 90, 90), atoms);
+}
+
+// Cesium chloride with the same composition: a 2x2x1 supercell of spg 221
+// with Na on 1a and Cl on 1b
+static Crystal getCesiumChloride(double a)
+{
+  vector<atomStruct> atoms;
+  for (size_t i = 0; i < 2; i++) {
+    for (size_t j = 0; j < 2; j++) {
+      atoms.push_back(atomStruct(11, 0.5 * i, 0.5 * j, 0));
+      atoms.push_back(atomStruct(17, 0.5 * i + 0.25, 0.5 * j + 0.25, 0.5));
+    }
+  }
+  return Crystal(latticeStruct(2 * a, 2 * a, a, 90, 90, 90), atoms);
+}
+
+int main()
+{
+  int numFailures = 0;
+
+  // The same structure at several sizes has one fingerprint
+  StructureFingerprintSet set;
+  double sizes[] = {3.0, 4.1, 5.0, 5.64, 5.7, 7.3, 10.0 / 3.0};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    bool isNew = set.insert(StructureFingerprint::getFingerprint(
+                              getRockSalt(sizes[i])));
+    if (isNew != (i == 0)) {
+      cout << "Failed: rock salt with a = " << sizes[i] << " was "
+           << (isNew ? "not found" : "found") << " in the set\n";
+      numFailures++;
+    }
+  }
+
+  // Reordering the atoms and moving them together does not change it
+  Crystal moved = getRockSalt(4.2);
+  vector<atomStruct> atoms = moved.getAtoms();
+  vector<atomStruct> reordered(atoms.rbegin(), atoms.rend());
+  for (size_t i = 0; i < reordered.size(); i++) {
+    reordered[i].x += 0.125;
+    reordered[i].y += 0.375;
+  }
+  moved.setAtoms(reordered);
+  if (!set.contains(StructureFingerprint::getFingerprint(moved))) {
+    cout << "Failed: moved and reordered rock salt was not found in the "
+         << "set\n";
+    numFailures++;
+  }
+
+  // A different structure with the same composition is not the same
+  if (set.contains(StructureFingerprint::getFingerprint(
+                     getCesiumChloride(3.0)))) {
+    cout << "Failed: cesium chloride was found in the set of rock salt\n";
+    numFailures++;
+  }
+
+  if (numFailures == 0) cout << "All fingerprint checks passed\n";
+  return numFailures == 0 ? 0 : 1;
+}